@@ -0,0 +1,428 @@
+#include "../../src/common/memory.h"
+#include "../../src/util/clock.h"
+#include "../../src/vm/vm.h"
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#ifndef CLOX_CORPUS_DIR
+#define CLOX_CORPUS_DIR "benchmarks/corpus"
+#endif
+
+// measurements depend on the machine and the build, so they're kept out of the source tree
+#ifndef CLOX_BASELINE_FILE
+#define CLOX_BASELINE_FILE "baseline.txt"
+#endif
+
+/** The most programs a single run can measure */
+#define MAX_CASES 64
+
+/** Size of the generated sources */
+#define GENERATED_BYTES (8u * 1024u * 1024u)
+
+/** Small programs are run back to back for at least this long, so their times are stable */
+#define MIN_RUN_NS 20000000u
+
+/** Peak RSS moves this much between runs of the same binary, so it's never a regression */
+#define RSS_SLACK_KB 1024
+
+/** Measurements of one program, taken in a child process */
+typedef struct case_result {
+    char name[64];
+
+    /** Fastest `interpret()` of the program */
+    uint64_t wall_ns;
+
+    /** Peak resident set of the child process */
+    long peak_rss_kb;
+
+    /** Blocks allocated or resized by one `interpret()` */
+    size_t allocations;
+
+    /** Most bytes allocated at once by one `interpret()` */
+    size_t peak_bytes;
+
+    /** Whether the program compiled and ran without errors */
+    bool ok;
+} case_result;
+
+/** A program to measure, either a corpus file or generated in the child */
+typedef struct bench_case {
+    char name[64];
+    char path[512];
+    char *(*generate)();
+} bench_case;
+
+static struct {
+    const char *corpus;
+    const char *baseline;
+    double tolerance;
+    int reps;
+    bool update;
+} s_options = {
+    .corpus = CLOX_CORPUS_DIR,
+    .baseline = CLOX_BASELINE_FILE,
+    .tolerance = 15.0,
+    .reps = 5,
+    .update = false,
+};
+
+/**
+ * Repeats a line until a source is GENERATED_BYTES long, and wraps it up in one expression
+ * @param line The line to repeat, which must continue an expression
+ * @return The NUL-terminated source, owned by the caller
+ */
+static char *repeat_line(const char *line) {
+    size_t line_len = strlen(line);
+    char *source = malloc(GENERATED_BYTES + line_len + 8);
+
+    size_t n = 0;
+    source[n++] = '1';
+
+    while (n < GENERATED_BYTES) {
+        memcpy(source + n, line, line_len);
+        n += line_len;
+    }
+
+    source[n] = '\0';
+
+    return source;
+}
+
+static char *generate_arithmetic() {
+    return repeat_line(" + 12.5 * (3 - 1) / 4 - -0.25 + 1024 * 1024 - 7\n");
+}
+
+static char *generate_commented() {
+    return repeat_line("\n    // comments make up most of this source, the scanner skips them\n"
+                       "    + 1 // and some more at the end of a line\n");
+}
+
+static const bench_case s_generated[] = {
+    {"generated/arithmetic", "", generate_arithmetic},
+    {"generated/commented", "", generate_commented},
+};
+
+static char *read_file(const char *path) {
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) { return NULL; }
+
+    fseek(file, 0, SEEK_END);
+    size_t len = ftell(file);
+    rewind(file);
+
+    char *buffer = malloc(len + 1);
+    size_t len_read = fread(buffer, sizeof(char), len, file);
+    fclose(file);
+
+    buffer[len_read] = '\0';
+    return buffer;
+}
+
+static int compare_cases(const void *lhs, const void *rhs) {
+    return strcmp(((const bench_case *)lhs)->name, ((const bench_case *)rhs)->name);
+}
+
+/**
+ * Finds every program in the corpus directory, then appends the generated ones
+ * @param cases Array to fill, with room for MAX_CASES
+ * @return The number of cases found
+ */
+static size_t find_cases(bench_case *cases) {
+    size_t count = 0;
+    DIR *dir = opendir(s_options.corpus);
+
+    if (dir == NULL) {
+        fprintf(stderr, "Unable to open corpus '%s'.\n", s_options.corpus);
+    } else {
+        struct dirent *entry;
+
+        while ((entry = readdir(dir)) != NULL && count < MAX_CASES) {
+            size_t len = strlen(entry->d_name);
+            bool is_lox = len > 4 && strcmp(entry->d_name + len - 4, ".lox") == 0;
+            if (!is_lox || len >= sizeof(cases->name)) { continue; }
+
+            bench_case *c = &cases[count++];
+            memcpy(c->name, entry->d_name, len - 4);
+            c->name[len - 4] = '\0';
+            snprintf(c->path, sizeof(c->path), "%s/%s", s_options.corpus, entry->d_name);
+            c->generate = NULL;
+        }
+
+        closedir(dir);
+        qsort(cases, count, sizeof(bench_case), compare_cases);
+    }
+
+    for (size_t i = 0; i < sizeof(s_generated) / sizeof(s_generated[0]) && count < MAX_CASES; ++i) {
+        cases[count++] = s_generated[i];
+    }
+
+    return count;
+}
+
+/**
+ * Measures a program. Runs in the child process, so the peak RSS only covers this program
+ * @param c The program to measure
+ * @param res Filled with everything but the peak RSS
+ */
+static void measure(const bench_case *c, case_result *res) {
+    char *source = c->generate != NULL ? c->generate() : read_file(c->path);
+    if (source == NULL) { return; }
+
+    // the program's output is part of the work, but not of the report
+    int null_fd = open("/dev/null", O_WRONLY);
+    dup2(null_fd, STDOUT_FILENO);
+    close(null_fd);
+
+    init_vm();
+
+    // the first run is untimed, it warms up the caches and counts the allocations
+    alloc_stats before = g_alloc_stats;
+    g_alloc_stats.peak_bytes = g_alloc_stats.live_bytes;
+
+    uint64_t start = now_ns();
+    res->ok = interpret(source) == INTERPRET_OK;
+    free_vm();
+    uint64_t first_ns = now_ns() - start;
+
+    res->allocations = g_alloc_stats.allocations + g_alloc_stats.reallocations -
+                       before.allocations - before.reallocations;
+    res->peak_bytes = g_alloc_stats.peak_bytes - before.live_bytes;
+    res->wall_ns = UINT64_MAX;
+
+    uint64_t runs = first_ns >= MIN_RUN_NS ? 1 : MIN_RUN_NS / (first_ns + 1) + 1;
+
+    for (int i = 0; i < s_options.reps; ++i) {
+        start = now_ns();
+
+        for (uint64_t n = 0; n < runs; ++n) {
+            interpret(source);
+            free_vm();
+        }
+
+        uint64_t elapsed = (now_ns() - start) / runs;
+        if (elapsed < res->wall_ns) { res->wall_ns = elapsed; }
+    }
+
+    free(source);
+}
+
+/**
+ * Measures a program in a child process
+ * @param c The program to measure
+ * @param res Filled with the measurements
+ * @return Whether the child reported back
+ */
+static bool run_case(const bench_case *c, case_result *res) {
+    memset(res, 0, sizeof(case_result));
+    snprintf(res->name, sizeof(res->name), "%s", c->name);
+
+    int fds[2];
+    if (pipe(fds) != 0) { return false; }
+
+    pid_t pid = fork();
+    if (pid < 0) { return false; }
+
+    if (pid == 0) {
+        close(fds[0]);
+        measure(c, res);
+
+        ssize_t written = write(fds[1], res, sizeof(case_result));
+        _exit(written == sizeof(case_result) ? 0 : 1);
+    }
+
+    close(fds[1]);
+    ssize_t len = read(fds[0], res, sizeof(case_result));
+    close(fds[0]);
+
+    int status;
+    struct rusage usage;
+    wait4(pid, &status, 0, &usage);
+    res->peak_rss_kb = usage.ru_maxrss;
+
+    return len == sizeof(case_result) && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+/**
+ * Reads a baseline written by `write_baseline`
+ * @param results Array to fill, with room for MAX_CASES
+ * @return The number of results read, or -1 if there's no baseline
+ */
+static int read_baseline(case_result *results) {
+    FILE *file = fopen(s_options.baseline, "r");
+    if (file == NULL) { return -1; }
+
+    int count = 0;
+    char line[256];
+
+    while (count < MAX_CASES && fgets(line, sizeof(line), file)) {
+        if (line[0] == '#') { continue; }
+
+        case_result *res = &results[count];
+        unsigned long long wall_ns;
+
+        if (sscanf(line, "%63s %llu %ld %zu %zu", res->name, &wall_ns, &res->peak_rss_kb,
+                   &res->allocations, &res->peak_bytes) == 5) {
+            res->wall_ns = wall_ns;
+            res->ok = true;
+            ++count;
+        }
+    }
+
+    fclose(file);
+
+    return count;
+}
+
+static bool write_baseline(const case_result *results, size_t count) {
+    FILE *file = fopen(s_options.baseline, "w");
+    if (file == NULL) { return false; }
+
+    fprintf(file, "# name wall_ns peak_rss_kb allocations peak_bytes\n");
+
+    for (size_t i = 0; i < count; ++i) {
+        const case_result *res = &results[i];
+        if (!res->ok) { continue; }
+
+        fprintf(file, "%s %llu %ld %zu %zu\n", res->name, (unsigned long long)res->wall_ns,
+                res->peak_rss_kb, res->allocations, res->peak_bytes);
+    }
+
+    fclose(file);
+
+    return true;
+}
+
+/**
+ * Checks one measurement against its baseline, printing it if it regressed
+ * @param name The program
+ * @param metric The measurement
+ * @param current The measurement from this run
+ * @param baseline The measurement from the baseline
+ * @param slack An absolute change that is always allowed
+ * @return Whether the measurement is within the tolerance
+ */
+static bool check_metric(const char *name, const char *metric, double current, double baseline,
+                         double slack) {
+    double limit = baseline * (1.0 + s_options.tolerance / 100.0);
+    if (current <= limit || current - baseline <= slack) { return true; }
+
+    printf("REGRESSION %s: %s %.0f -> %.0f (+%.1f%%, tolerance %.1f%%)\n", name, metric, baseline,
+           current, (current / baseline - 1.0) * 100.0, s_options.tolerance);
+
+    return false;
+}
+
+/**
+ * Compares the results against the stored baseline
+ * @return The number of regressions
+ */
+static int compare(const case_result *results, size_t count) {
+    static case_result baseline[MAX_CASES];
+    int baseline_count = read_baseline(baseline);
+
+    if (baseline_count < 0) {
+        printf("No baseline at '%s', run with --update to store one.\n", s_options.baseline);
+        return 0;
+    }
+
+    int regressions = 0;
+
+    for (size_t i = 0; i < count; ++i) {
+        const case_result *res = &results[i];
+        const case_result *base = NULL;
+
+        for (int j = 0; j < baseline_count; ++j) {
+            if (strcmp(baseline[j].name, res->name) == 0) { base = &baseline[j]; }
+        }
+
+        if (base == NULL) {
+            printf("%s isn't in the baseline\n", res->name);
+            continue;
+        }
+
+        regressions +=
+            !check_metric(res->name, "wall_ns", (double)res->wall_ns, (double)base->wall_ns, 0);
+        regressions += !check_metric(res->name, "peak_rss_kb", (double)res->peak_rss_kb,
+                                     (double)base->peak_rss_kb, RSS_SLACK_KB);
+        regressions += !check_metric(res->name, "allocations", (double)res->allocations,
+                                     (double)base->allocations, 0);
+        regressions += !check_metric(res->name, "peak_bytes", (double)res->peak_bytes,
+                                     (double)base->peak_bytes, 0);
+    }
+
+    return regressions;
+}
+
+static void usage() {
+    fprintf(stderr, "Usage: clox_macro [--corpus DIR] [--baseline FILE] [--tolerance PERCENT] "
+                    "[--reps N] [--update]\n");
+    exit(64);
+}
+
+int main(int argc, const char **argv) {
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--update") == 0) {
+            s_options.update = true;
+            continue;
+        }
+
+        if (i + 1 == argc) { usage(); }
+
+        if (strcmp(argv[i], "--corpus") == 0) {
+            s_options.corpus = argv[++i];
+        } else if (strcmp(argv[i], "--baseline") == 0) {
+            s_options.baseline = argv[++i];
+        } else if (strcmp(argv[i], "--tolerance") == 0) {
+            s_options.tolerance = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--reps") == 0) {
+            s_options.reps = atoi(argv[++i]);
+        } else {
+            usage();
+        }
+    }
+
+    if (s_options.reps < 1 || s_options.tolerance < 0) { usage(); }
+
+    static bench_case cases[MAX_CASES];
+    static case_result results[MAX_CASES];
+    size_t count = find_cases(cases);
+    bool failed = false;
+
+    printf("%-24s %12s %12s %12s %12s\n", "program", "wall ms", "peak RSS kB", "allocations",
+           "peak bytes");
+
+    for (size_t i = 0; i < count; ++i) {
+        case_result *res = &results[i];
+
+        if (!run_case(&cases[i], res) || !res->ok) {
+            printf("%-24s failed to run\n", cases[i].name);
+            res->ok = false;
+            failed = true;
+            continue;
+        }
+
+        printf("%-24s %12.3f %12ld %12zu %12zu\n", res->name, res->wall_ns / 1e6, res->peak_rss_kb,
+               res->allocations, res->peak_bytes);
+    }
+
+    if (s_options.update) {
+        if (!write_baseline(results, count)) {
+            fprintf(stderr, "Unable to write '%s'.\n", s_options.baseline);
+            return 1;
+        }
+
+        printf("Stored the baseline in '%s'.\n", s_options.baseline);
+        return failed;
+    }
+
+    int regressions = compare(results, count);
+    if (regressions > 0) { printf("%d regression(s)\n", regressions); }
+
+    return failed || regressions > 0;
+}
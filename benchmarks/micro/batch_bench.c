@@ -0,0 +1,153 @@
+#include "../../src/compiler/compiler.h"
+#include "../../src/vm/batch.h"
+#include "../../src/vm/batch_simd.h"
+#include "../../src/vm/vm.h"
+#include "bench.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+/** Number of rows every benchmark evaluates */
+#define ROWS (1u << 20)
+
+/** Number of inputs the benchmark expression reads */
+#define INPUTS 3
+
+/** The benchmarked expression, over the inputs `a`, `b` and `c` */
+static const char *s_expression = "(a * 3 + b - c) * 2 > a - -c";
+
+static const char *s_inputs[INPUTS] = {"a", "b", "c"};
+
+/** State shared by the batch benchmarks */
+typedef struct batch_ctx {
+    batch_program prog;
+    chunk row_chunk;
+    column columns[INPUTS];
+    value *rows;
+    value *out;
+} batch_ctx;
+
+static void discard_output(void *ctx, const struct iovec *iov, int count) {
+    (void)ctx;
+    (void)iov;
+    (void)count;
+}
+
+static void run_rows(void *ctx) {
+    batch_ctx *bc = ctx;
+
+    for (size_t row = 0; row < ROWS; ++row) {
+        g_vm.inputs = &bc->rows[row * INPUTS];
+
+        if (run_chunk(&bc->row_chunk) != INTERPRET_OK) {
+            fprintf(stderr, "benchmark expression failed to run!\n");
+            exit(1);
+        }
+    }
+}
+
+static void run_blocks(void *ctx) {
+    batch_ctx *bc = ctx;
+
+    if (run_batch(&bc->prog, bc->columns, ROWS, bc->out, NULL) != 0) {
+        fprintf(stderr, "benchmark expression failed to run!\n");
+        exit(1);
+    }
+
+    bench_do_not_optimize(bc->out);
+}
+
+/**
+ * Benchmarks one kind of column, both a row at a time and with every batch
+ * instruction set the CPU supports
+ * @param bc The benchmark state, with `rows` filled in
+ * @param names Benchmark names, row at a time then one per instruction set
+ */
+static void bench_columns(batch_ctx *bc, const char *const *names) {
+    bench_spec spec = {
+        .name = names[0],
+        .run = run_rows,
+        .ctx = bc,
+        .ops = ROWS,
+    };
+
+    bench_run(&spec);
+
+    batch_isa native = active_batch_isa();
+
+    for (int isa = BATCH_ISA_SCALAR; isa <= BATCH_ISA_AVX2; ++isa) {
+        if (!select_batch_isa((batch_isa)isa)) { continue; }
+
+        spec.name = names[isa + 1];
+        spec.run = run_blocks;
+        bench_run(&spec);
+    }
+
+    select_batch_isa(native);
+}
+
+void bench_batch() {
+    static const char *int_names[] = {"batch/rows/int", "batch/scalar/int", "batch/sse2/int",
+                                      "batch/avx2/int"};
+    static const char *double_names[] = {"batch/rows/double", "batch/scalar/double",
+                                         "batch/sse2/double", "batch/avx2/double"};
+
+    batch_ctx bc;
+
+    batch_compile_result compiled = compile_batch(&bc.prog, s_expression, s_inputs, INPUTS);
+
+    if (compiled != BATCH_COMPILED) {
+        fprintf(stderr, compiled == BATCH_UNSUPPORTED
+                            ? "benchmark expression can't be evaluated in batches!\n"
+                            : "benchmark expression failed to compile!\n");
+        exit(1);
+    }
+
+    init_chunk(&bc.row_chunk);
+    compile_with_inputs(s_expression, &bc.row_chunk, s_inputs, INPUTS);
+
+    int64_t *ints = malloc(sizeof(int64_t) * ROWS * INPUTS);
+    double *doubles = malloc(sizeof(double) * ROWS * INPUTS);
+    bc.rows = malloc(sizeof(value) * ROWS * INPUTS);
+    bc.out = malloc(sizeof(value) * ROWS);
+
+    srand(42);
+
+    for (size_t i = 0; i < ROWS * INPUTS; ++i) {
+        ints[i] = rand() % 100000 - 50000;
+        doubles[i] = ints[i] / 7.0;
+    }
+
+    set_output_sink(&g_vm.out, discard_output, NULL, false);
+
+    for (int input = 0; input < INPUTS; ++input) {
+        bc.columns[input].type = COLUMN_INT;
+        bc.columns[input].as.ints = &ints[input * ROWS];
+
+        for (size_t row = 0; row < ROWS; ++row) {
+            bc.rows[row * INPUTS + input] = int_value(ints[input * ROWS + row]);
+        }
+    }
+
+    bench_columns(&bc, int_names);
+
+    for (int input = 0; input < INPUTS; ++input) {
+        bc.columns[input].type = COLUMN_DOUBLE;
+        bc.columns[input].as.doubles = &doubles[input * ROWS];
+
+        for (size_t row = 0; row < ROWS; ++row) {
+            bc.rows[row * INPUTS + input] = number_value(doubles[input * ROWS + row]);
+        }
+    }
+
+    bench_columns(&bc, double_names);
+
+    init_output(&g_vm.out);
+    g_vm.inputs = NULL;
+
+    free(ints);
+    free(doubles);
+    free(bc.rows);
+    free(bc.out);
+    free_chunk(&bc.row_chunk);
+    free_batch(&bc.prog);
+}
@@ -0,0 +1,143 @@
+#include "bench.h"
+#include "../../src/util/clock.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/** The most benchmarks a single run can record */
+#define MAX_RESULTS 128
+
+bench_options g_bench_options = {
+    .warmup = 3,
+    .reps = 15,
+    .filter = NULL,
+};
+
+/** Summary of one benchmark, all times are for a single repetition */
+typedef struct bench_result {
+    const char *name;
+    int reps;
+    size_t ops;
+    size_t bytes;
+    uint64_t min_ns;
+    uint64_t median_ns;
+    uint64_t p90_ns;
+    uint64_t p99_ns;
+    uint64_t max_ns;
+    double mean_ns;
+} bench_result;
+
+static bench_result s_results[MAX_RESULTS];
+static size_t s_result_count = 0;
+
+static int compare_u64(const void *lhs, const void *rhs) {
+    uint64_t a = *(const uint64_t *)lhs;
+    uint64_t b = *(const uint64_t *)rhs;
+
+    return (a > b) - (a < b);
+}
+
+/**
+ * Gets a percentile of sorted samples, using the nearest-rank method
+ * @param sorted The samples, in ascending order
+ * @param count The number of samples
+ * @param pct The percentile, in (0, 100]
+ * @return The sample at that percentile
+ */
+static uint64_t percentile(const uint64_t *sorted, int count, int pct) {
+    int rank = (pct * count + 99) / 100;
+
+    return sorted[rank < 1 ? 0 : rank - 1];
+}
+
+void bench_run(const bench_spec *spec) {
+    if (g_bench_options.filter != NULL && strstr(spec->name, g_bench_options.filter) == NULL) {
+        return;
+    }
+
+    for (int i = 0; i < g_bench_options.warmup; ++i) {
+        spec->run(spec->ctx);
+        if (spec->reset != NULL) { spec->reset(spec->ctx); }
+    }
+
+    int reps = g_bench_options.reps;
+    uint64_t *samples = malloc(sizeof(uint64_t) * reps);
+    double total = 0;
+
+    for (int i = 0; i < reps; ++i) {
+        uint64_t start = now_ns();
+        spec->run(spec->ctx);
+        samples[i] = now_ns() - start;
+        total += (double)samples[i];
+
+        if (spec->reset != NULL) { spec->reset(spec->ctx); }
+    }
+
+    qsort(samples, reps, sizeof(uint64_t), compare_u64);
+
+    bench_result res = {
+        .name = spec->name,
+        .reps = reps,
+        .ops = spec->ops,
+        .bytes = spec->bytes,
+        .min_ns = samples[0],
+        .median_ns = percentile(samples, reps, 50),
+        .p90_ns = percentile(samples, reps, 90),
+        .p99_ns = percentile(samples, reps, 99),
+        .max_ns = samples[reps - 1],
+        .mean_ns = total / reps,
+    };
+
+    free(samples);
+
+    double ops = res.ops == 0 ? 1.0 : (double)res.ops;
+    printf("%-28s %10.2f ns/op  p90 %10.2f  p99 %10.2f", res.name, res.median_ns / ops,
+           res.p90_ns / ops, res.p99_ns / ops);
+
+    if (res.bytes != 0) { printf("  %9.1f MB/s", res.bytes / (res.median_ns / 1e3)); }
+
+    printf("\n");
+    fflush(stdout);
+
+    if (s_result_count < MAX_RESULTS) { s_results[s_result_count++] = res; }
+}
+
+bool bench_write_json(const char *path) {
+    FILE *file = strcmp(path, "-") == 0 ? stdout : fopen(path, "w");
+    if (file == NULL) { return false; }
+
+    fprintf(file, "{\n  \"warmup\": %d,\n  \"reps\": %d,\n", g_bench_options.warmup,
+            g_bench_options.reps);
+#ifdef __OPTIMIZE__
+    fprintf(file, "  \"optimized\": true,\n");
+#else
+    fprintf(file, "  \"optimized\": false,\n");
+#endif
+    fprintf(file, "  \"benchmarks\": [\n");
+
+    for (size_t i = 0; i < s_result_count; ++i) {
+        bench_result *res = &s_results[i];
+
+        fprintf(file,
+                "    {\"name\": \"%s\", \"reps\": %d, \"ops\": %zu, \"bytes\": %zu, "
+                "\"min_ns\": %llu, \"median_ns\": %llu, \"p90_ns\": %llu, \"p99_ns\": %llu, "
+                "\"max_ns\": %llu, \"mean_ns\": %.1f}%s\n",
+                res->name,
+                res->reps,
+                res->ops,
+                res->bytes,
+                (unsigned long long)res->min_ns,
+                (unsigned long long)res->median_ns,
+                (unsigned long long)res->p90_ns,
+                (unsigned long long)res->p99_ns,
+                (unsigned long long)res->max_ns,
+                res->mean_ns,
+                i + 1 == s_result_count ? "" : ",");
+    }
+
+    fprintf(file, "  ]\n}\n");
+
+    if (file != stdout) { fclose(file); }
+
+    return true;
+}
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Describes a single benchmark. The harness calls `run` `warmup` times untimed, then
+ * times it for every repetition, calling `reset` (untimed) after each call.
+ */
+typedef struct bench_spec {
+    /** Name the benchmark is reported and filtered by, like "scan/avx2" */
+    const char *name;
+
+    /** Runs one repetition */
+    void (*run)(void *ctx);
+
+    /** Restores any state `run` changed, may be NULL */
+    void (*reset)(void *ctx);
+
+    /** Passed to `run` and `reset` */
+    void *ctx;
+
+    /** Operations performed by one repetition, used to report time per operation */
+    size_t ops;
+
+    /** Bytes processed by one repetition, used to report MB/s. 0 if meaningless */
+    size_t bytes;
+} bench_spec;
+
+/** Options shared by every benchmark, set from the command line */
+typedef struct bench_options {
+    /** Untimed repetitions before measuring */
+    int warmup;
+
+    /** Timed repetitions */
+    int reps;
+
+    /** Only benchmarks whose name contains this are run, NULL runs everything */
+    const char *filter;
+} bench_options;
+
+extern bench_options g_bench_options;
+
+/**
+ * Measures a benchmark, prints its summary and records it for the JSON report. Does
+ * nothing if the benchmark doesn't pass the filter.
+ * @param spec The benchmark to run
+ */
+void bench_run(const bench_spec *spec);
+
+/**
+ * Writes every recorded result as JSON
+ * @param path The file to write to, or "-" for stdout
+ * @return Whether the file could be written
+ */
+bool bench_write_json(const char *path);
+
+/**
+ * Stops the optimizer from deleting a computation whose result is otherwise unused
+ * @param ptr Pointer to the result
+ */
+static inline void bench_do_not_optimize(const void *ptr) {
+    __asm__ volatile("" : : "g"(ptr) : "memory");
+}
+
+/**
+ * `scan()` throughput on a large generated source, once for every scanner
+ * instruction set the CPU supports
+ */
+void bench_scanner();
+
+/**
+ * `compile()` throughput on one large generated expression
+ */
+void bench_compiler();
+
+/**
+ * `format_number` against printf on a million doubles
+ */
+void bench_format();
+
+/**
+ * `run()` dispatch for every opcode, string concatenation, `interpret` against a
+ * prepared expression, calls and property reads
+ */
+void bench_vm();
+
+/**
+ * `copy_string` and `reallocate`
+ */
+void bench_memory();
+
+/**
+ * `run_batch` against running the same expression once per row, on integer and
+ * double columns
+ */
+void bench_batch();
+
+/**
+ * Starting up from a library's source with `clox_prepare` against loading it from a
+ * snapshot
+ */
+void bench_snapshot();
+
+/**
+ * Collection pauses against the size of the heap and the number of threads marking it
+ */
+void bench_gc();
@@ -0,0 +1,86 @@
+#include "../../src/compiler/compiler.h"
+#include "bench.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/** Approximate size of the generated source */
+#define SOURCE_BYTES (8u * 1024u * 1024u)
+
+/** Terms the generated expression is built from, joined by `+` */
+static const char *s_terms[] = {
+    "(12.5 * 3 - 7 / 2)",
+    "-(1 + 2)",
+    "!(true == false) == (nil == 1)",
+    "4096.125",
+    "(((1 < 2) == (3 >= 4)) == (5 <= 6))",
+};
+
+/**
+ * Builds one long expression out of `s_terms`
+ * @param len Set to the length of the generated source
+ * @return The NUL-terminated source, owned by the caller
+ */
+static char *generate_source(size_t *len) {
+    char *source = malloc(SOURCE_BYTES + 256);
+    size_t n = 0;
+
+    for (size_t i = 0; n < SOURCE_BYTES; ++i) {
+        const char *term = s_terms[i % (sizeof(s_terms) / sizeof(s_terms[0]))];
+        size_t term_len = strlen(term);
+
+        if (i != 0) {
+            memcpy(source + n, i % 8 == 0 ? " +\n" : " + ", 3);
+            n += 3;
+        }
+
+        memcpy(source + n, term, term_len);
+        n += term_len;
+    }
+
+    source[n] = '\0';
+    *len = n;
+
+    return source;
+}
+
+/** State for the compiler benchmark */
+typedef struct compile_ctx {
+    const char *source;
+    chunk c;
+} compile_ctx;
+
+static void run_compile(void *ctx) {
+    compile_ctx *cc = ctx;
+
+    if (!compile(cc->source, &cc->c)) {
+        fprintf(stderr, "generated source failed to compile!\n");
+        exit(1);
+    }
+}
+
+static void reset_compile(void *ctx) {
+    compile_ctx *cc = ctx;
+
+    free_chunk(&cc->c);
+}
+
+void bench_compiler() {
+    size_t len;
+    char *source = generate_source(&len);
+
+    compile_ctx ctx = {.source = source};
+    init_chunk(&ctx.c);
+
+    bench_spec spec = {
+        .name = "compile",
+        .run = run_compile,
+        .reset = reset_compile,
+        .ctx = &ctx,
+        .ops = 1,
+        .bytes = len,
+    };
+
+    bench_run(&spec);
+    free(source);
+}
@@ -0,0 +1,75 @@
+#include "../../src/common/number_format.h"
+#include "bench.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+/** Number of values formatted per pass */
+#define VALUES 1000000
+
+/** A formatter under test */
+typedef size_t (*formatter)(double val, char *buf);
+
+static size_t format_ryu(double val, char *buf) {
+    return format_number(val, buf);
+}
+
+static size_t format_printf_g(double val, char *buf) {
+    return (size_t)snprintf(buf, NUMBER_FORMAT_MAX, "%g", val);
+}
+
+static size_t format_printf_17g(double val, char *buf) {
+    return (size_t)snprintf(buf, NUMBER_FORMAT_MAX, "%.17g", val);
+}
+
+/** State for one formatting benchmark */
+typedef struct format_ctx {
+    formatter fmt;
+    const double *values;
+} format_ctx;
+
+static void run_format(void *ctx) {
+    format_ctx *fc = ctx;
+    char buf[NUMBER_FORMAT_MAX];
+
+    for (size_t i = 0; i < VALUES; ++i) {
+        fc->fmt(fc->values[i], buf);
+        bench_do_not_optimize(buf);
+    }
+}
+
+void bench_format() {
+    static const struct {
+        const char *name;
+        formatter fmt;
+    } formatters[] = {
+        {"format/format_number", format_ryu},
+        {"format/printf_g", format_printf_g},
+        {"format/printf_17g", format_printf_17g},
+    };
+
+    double *values = malloc(sizeof(double) * VALUES);
+
+    // a mix of integers, "human" decimals and arbitrary doubles
+    srand(42);
+    for (size_t i = 0; i < VALUES; ++i) {
+        switch (i % 3) {
+            case 0: values[i] = (double)(rand() % 100000); break;
+            case 1: values[i] = (rand() % 1000000) / 1000.0; break;
+            default: values[i] = (double)rand() / rand() * (rand() % 2 ? 1e-5 : 1e12); break;
+        }
+    }
+
+    for (size_t i = 0; i < sizeof(formatters) / sizeof(formatters[0]); ++i) {
+        format_ctx ctx = {formatters[i].fmt, values};
+        bench_spec spec = {
+            .name = formatters[i].name,
+            .run = run_format,
+            .ctx = &ctx,
+            .ops = VALUES,
+        };
+
+        bench_run(&spec);
+    }
+
+    free(values);
+}
@@ -0,0 +1,82 @@
+#include "../../src/common/memory.h"
+#include "../../src/vm/gc.h"
+#include "bench.h"
+#include <stdio.h>
+
+/** Objects in each benchmarked heap */
+static const size_t s_heap_sizes[] = {10000, 100000, 1000000};
+
+/** Threads each heap is marked with */
+static const int s_thread_counts[] = {1, 2, 4, 8};
+
+#define HEAP_SIZES (sizeof(s_heap_sizes) / sizeof(s_heap_sizes[0]))
+#define THREAD_COUNTS (sizeof(s_thread_counts) / sizeof(s_thread_counts[0]))
+
+/** The shape of the tree's inner nodes, which have a `left` and a `right` */
+static shape *s_node_shape;
+
+/**
+ * Builds a binary tree of instances, with strings for leaves, which the markers can
+ * split between them
+ * @param objects The number of objects in the tree
+ * @return The root, nil for an empty tree
+ */
+static value build_tree(size_t objects) {
+    if (objects == 0) { return nil_value(); }
+    if (objects == 1) { return object_value((object *)copy_string("leaf", 4)); }
+
+    size_t left = (objects - 1) / 2;
+    value fields[2] = {build_tree(left), build_tree(objects - 1 - left)};
+
+    instance *node = new_instance(&g_vm.root_shape);
+    node->shape = s_node_shape;
+    node->fields = ALLOCATE(value, 2);
+    node->capacity = 2;
+    node->fields[0] = fields[0];
+    node->fields[1] = fields[1];
+
+    return object_value((object *)node);
+}
+
+static void run_collect(void *ctx) {
+    (void)ctx;
+    collect_garbage();
+}
+
+void bench_gc() {
+    static char names[HEAP_SIZES * THREAD_COUNTS][32];
+
+    s_node_shape = add_field(add_field(&g_vm.root_shape, "left", 4), "right", 5);
+
+    // whatever the other benchmarks left behind isn't part of the measured heaps
+    collect_garbage();
+
+    for (size_t i = 0; i < HEAP_SIZES; ++i) {
+        // everything lives, so every collection marks and sweeps the whole heap
+        push(build_tree(s_heap_sizes[i]));
+
+        for (size_t j = 0; j < THREAD_COUNTS; ++j) {
+            char *name = names[i * THREAD_COUNTS + j];
+            snprintf(name, sizeof(names[0]), "gc/pause/%zuk/%dt", s_heap_sizes[i] / 1000,
+                     s_thread_counts[j]);
+
+            if (!enable_gc(s_thread_counts[j])) {
+                fprintf(stderr, "benchmark marking threads couldn't be started!\n");
+                continue;
+            }
+
+            bench_spec spec = {
+                .name = name,
+                .run = run_collect,
+                .ops = s_heap_sizes[i],
+            };
+
+            bench_run(&spec);
+        }
+
+        pop();
+        collect_garbage();
+    }
+
+    disable_gc();
+}
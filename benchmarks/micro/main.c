@@ -0,0 +1,58 @@
+#include "../../src/vm/vm.h"
+#include "bench.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static void usage() {
+    fprintf(stderr, "Usage: clox_bench [--warmup N] [--reps N] [--filter SUBSTRING] "
+                    "[--json PATH]\n");
+    exit(64);
+}
+
+int main(int argc, const char **argv) {
+    const char *json = NULL;
+
+    for (int i = 1; i < argc; ++i) {
+        if (i + 1 == argc) { usage(); }
+
+        if (strcmp(argv[i], "--warmup") == 0) {
+            g_bench_options.warmup = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--reps") == 0) {
+            g_bench_options.reps = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--filter") == 0) {
+            g_bench_options.filter = argv[++i];
+        } else if (strcmp(argv[i], "--json") == 0) {
+            json = argv[++i];
+        } else {
+            usage();
+        }
+    }
+
+    if (g_bench_options.reps < 1 || g_bench_options.warmup < 0) { usage(); }
+
+#ifndef __OPTIMIZE__
+    fprintf(stderr, "warning: clox_bench was built without optimizations\n");
+#endif
+
+    init_vm();
+
+    bench_scanner();
+    bench_compiler();
+    bench_format();
+    bench_vm();
+    bench_memory();
+    bench_batch();
+    bench_snapshot();
+    // last, since it frees what the others left behind
+    bench_gc();
+
+    free_vm();
+
+    if (json != NULL && !bench_write_json(json)) {
+        fprintf(stderr, "Unable to write '%s'.\n", json);
+        return 1;
+    }
+
+    return 0;
+}
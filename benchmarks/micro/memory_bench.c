@@ -0,0 +1,52 @@
+#include "../../src/common/memory.h"
+#include "../../src/vm/vm.h"
+#include "bench.h"
+
+/** Number of operations in one repetition */
+#define ITERATIONS 10000
+
+static void run_copy_string(void *ctx) {
+    (void)ctx;
+
+    for (int i = 0; i < ITERATIONS; ++i) {
+        bench_do_not_optimize(copy_string("a short string!!", 16));
+    }
+}
+
+static void free_strings(void *ctx) {
+    (void)ctx;
+
+    free_vm();
+}
+
+static void run_reallocate(void *ctx) {
+    (void)ctx;
+
+    // allocate, grow, then free blocks between 16 bytes and 4 KiB
+    for (int i = 0; i < ITERATIONS; ++i) {
+        size_t size = (size_t)16 << (i % 9);
+        void *ptr = reallocate(NULL, 0, size);
+        ptr = reallocate(ptr, size, size * 2);
+        bench_do_not_optimize(ptr);
+        reallocate(ptr, size * 2, 0);
+    }
+}
+
+void bench_memory() {
+    bench_spec copy = {
+        .name = "copy_string",
+        .run = run_copy_string,
+        .reset = free_strings,
+        .ops = ITERATIONS,
+    };
+
+    bench_run(&copy);
+
+    bench_spec realloc = {
+        .name = "reallocate",
+        .run = run_reallocate,
+        .ops = ITERATIONS * 3,
+    };
+
+    bench_run(&realloc);
+}
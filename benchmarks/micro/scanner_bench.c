@@ -0,0 +1,113 @@
+#include "../../src/compiler/scan_simd.h"
+#include "../../src/compiler/scanner.h"
+#include "bench.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/** Approximate size of the generated source */
+#define SOURCE_BYTES (16u * 1024u * 1024u)
+
+/** Lines the generated source is built from, chosen to exercise every kernel */
+static const char *s_lines[] = {
+    "    // a comment that is long enough to span a couple of vector blocks\n",
+    "    some_identifier_name + another_rather_long_identifier * 12345.678\n",
+    "\t\"a string literal with a few words in it\" + \"and another one\"\n",
+    "        (first_value - second_value) / third_value_with_digits_123\n",
+    "\n\n    \"a string\nthat spans lines\" + x\r\n",
+    "a+b*c-d/e==f!=g<=h>=i\n",
+};
+
+/**
+ * Builds a large source file out of `s_lines`
+ * @param len Set to the length of the generated source
+ * @return The NUL-terminated source, owned by the caller
+ */
+static char *generate_source(size_t *len) {
+    char *source = malloc(SOURCE_BYTES + 256);
+    size_t n = 0;
+
+    for (size_t i = 0; n < SOURCE_BYTES; ++i) {
+        const char *line = s_lines[i % (sizeof(s_lines) / sizeof(s_lines[0]))];
+        size_t line_len = strlen(line);
+
+        memcpy(source + n, line, line_len);
+        n += line_len;
+    }
+
+    source[n] = '\0';
+    *len = n;
+
+    return source;
+}
+
+/** State shared by the scanner benchmarks */
+typedef struct scan_ctx {
+    const char *source;
+    size_t tokens;
+    int lines;
+} scan_ctx;
+
+/**
+ * Scans a source to the end
+ * @param source The source to scan
+ * @param lines Set to the line of the EOF token
+ * @return The number of tokens scanned
+ */
+static size_t scan_all(const char *source, int *lines) {
+    init_scanner(source);
+    size_t count = 0;
+
+    while (true) {
+        token tok = scan();
+        ++count;
+
+        if (tok.type == TOKEN_EOF) {
+            *lines = tok.line;
+            break;
+        }
+    }
+
+    return count;
+}
+
+static void run_scan(void *ctx) {
+    scan_ctx *sc = ctx;
+    int lines;
+    size_t tokens = scan_all(sc->source, &lines);
+
+    if (tokens != sc->tokens || lines != sc->lines) {
+        fprintf(stderr, "%s kernels disagree with the default kernels!\n",
+                scan_isa_name(active_scan_isa()));
+        exit(1);
+    }
+}
+
+void bench_scanner() {
+    static const char *names[] = {"scan/scalar", "scan/sse2", "scan/avx2"};
+
+    size_t len;
+    char *source = generate_source(&len);
+
+    // scanning once up front also lets `init_scanner` pick the default kernels
+    scan_ctx ctx = {.source = source};
+    ctx.tokens = scan_all(source, &ctx.lines);
+    scan_isa native = active_scan_isa();
+
+    for (int isa = SCAN_ISA_SCALAR; isa <= SCAN_ISA_AVX2; ++isa) {
+        if (!select_scan_isa((scan_isa)isa)) { continue; }
+
+        bench_spec spec = {
+            .name = names[isa],
+            .run = run_scan,
+            .ctx = &ctx,
+            .ops = ctx.tokens,
+            .bytes = len,
+        };
+
+        bench_run(&spec);
+    }
+
+    select_scan_isa(native);
+    free(source);
+}
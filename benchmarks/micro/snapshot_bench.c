@@ -0,0 +1,84 @@
+#include "../../src/common/memory.h"
+#include "../../src/vm/snapshot.h"
+#include "bench.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+/** Number of functions in the benchmarked library */
+#define FUNCTIONS 1000
+
+/** The body every function in the library has */
+static const char *s_body = "a * 3 + b - \"s\" + fun (x) { x.f * 2 }({f = a}) < b / 2 or a";
+
+/** State shared by the startup benchmarks */
+typedef struct startup_ctx {
+    const char *source;
+    char path[32];
+} startup_ctx;
+
+static void run_prepare(void *ctx) {
+    startup_ctx *sc = ctx;
+
+    prepared *prep = clox_prepare(sc->source);
+    if (prep == NULL) {
+        fprintf(stderr, "benchmark library failed to compile!\n");
+        exit(1);
+    }
+
+    clox_release(prep);
+}
+
+static void run_load(void *ctx) {
+    startup_ctx *sc = ctx;
+
+    snapshot *snap = load_snapshot(sc->path);
+    if (snap == NULL) {
+        fprintf(stderr, "benchmark snapshot failed to load!\n");
+        exit(1);
+    }
+
+    release_snapshot(snap);
+}
+
+void bench_snapshot() {
+    // a library of functions, every one of which a prepare has to compile
+    size_t capacity = FUNCTIONS * 128;
+    char *source = ALLOCATE(char, capacity);
+    size_t pos = 0;
+
+    for (int i = 0; i < FUNCTIONS; ++i) {
+        pos += (size_t)snprintf(source + pos, capacity - pos, "%sfun f%d(a, b) { %s }",
+                                i > 0 ? " == " : "", i, s_body);
+    }
+
+    startup_ctx sc = {.source = source, .path = "/tmp/clox_snapshotXXXXXX"};
+
+    int fd = mkstemp(sc.path);
+    prepared *prep = clox_prepare(source);
+
+    if (fd < 0 || prep == NULL || !save_snapshot(sc.path, &prep, 1)) {
+        fprintf(stderr, "benchmark snapshot couldn't be written!\n");
+        exit(1);
+    }
+
+    close(fd);
+    clox_release(prep);
+
+    bench_spec spec = {
+        .name = "startup/prepare",
+        .run = run_prepare,
+        .ctx = &sc,
+        .ops = FUNCTIONS,
+        .bytes = pos,
+    };
+
+    bench_run(&spec);
+
+    spec.name = "startup/snapshot";
+    spec.run = run_load;
+    bench_run(&spec);
+
+    unlink(sc.path);
+    FREE_ARRAY(source, char, capacity);
+}
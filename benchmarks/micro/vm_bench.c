@@ -0,0 +1,360 @@
+#include "../../src/common/memory.h"
+#include "../../src/compiler/compiler.h"
+#include "../../src/vm/vm.h"
+#include "bench.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+/** Number of times a benchmark body is repeated in its chunk */
+#define BODY_REPEAT 4096
+
+/** Number of chunks run by one repetition of the OP_RETURN benchmark */
+#define RETURN_RUNS 4096
+
+// pseudo-opcodes in a benchmark body that are replaced by a load of a constant
+#define K_ONE 0xF0  /* the number 1 */
+#define K_NUM 0xF1  /* the number 2.5 */
+#define K_STR 0xF2  /* a 16 character string */
+#define K_LONG 0xF3 /* the number 1, loaded with OP_LOAD_CONST_LONG */
+#define K_INT 0xF4  /* the integer 1 */
+#define K_IMM 0xF5  /* the integer 1, loaded with OP_LOAD_INT */
+
+/** Number of evaluations run by one repetition of the expression benchmarks */
+#define EXPRESSION_RUNS 4096
+
+/** Number of fields of the instance the property benchmarks read from */
+#define PROPERTY_FIELDS 8
+
+/** Number of calls fib(20) makes, 2 * fib(21) - 1 */
+#define FIB_CALLS 21891
+
+/** Strings in every chain of the concatenation benchmark */
+#define CHAIN_LENGTH 16
+
+/** Chains compared in the concatenation benchmark */
+#define CHAIN_RUNS 256
+
+/** Index of the constant K_LONG loads, big enough to need a long load */
+#define LONG_INDEX (UINT16_MAX + 1)
+
+/**
+ * A dispatch benchmark. `body` is repeated BODY_REPEAT times after `prologue` and
+ * must leave the stack the way it found it, so most bodies pair the opcode being
+ * measured with a load or an OP_EQUAL.
+ */
+typedef struct op_bench {
+    const char *name;
+    uint8_t prologue[2];
+    uint8_t body[4];
+} op_bench;
+
+static const op_bench s_op_benches[] = {
+    {"run/OP_LOAD_CONST", {OP_TRUE}, {K_ONE, OP_EQUAL}},
+    {"run/OP_LOAD_CONST_LONG", {OP_TRUE}, {K_LONG, OP_EQUAL}},
+    {"run/OP_LOAD_INT", {OP_TRUE}, {K_IMM, OP_EQUAL}},
+    {"run/OP_NIL", {OP_TRUE}, {OP_NIL, OP_EQUAL}},
+    {"run/OP_TRUE", {OP_TRUE}, {OP_TRUE, OP_EQUAL}},
+    {"run/OP_FALSE", {OP_TRUE}, {OP_FALSE, OP_EQUAL}},
+    {"run/OP_NOT", {OP_TRUE}, {OP_NOT}},
+    {"run/OP_EQUAL", {K_ONE}, {K_NUM, OP_EQUAL}},
+    {"run/OP_GREATER", {OP_TRUE}, {K_ONE, K_NUM, OP_GREATER, OP_EQUAL}},
+    {"run/OP_LESS", {OP_TRUE}, {K_ONE, K_NUM, OP_LESS, OP_EQUAL}},
+    {"run/OP_NEGATE", {K_ONE}, {OP_NEGATE}},
+    {"run/OP_ADD", {K_ONE}, {K_ONE, OP_ADD}},
+    {"run/OP_ADD/int", {K_INT}, {K_INT, OP_ADD}},
+    {"run/OP_SUBTRACT", {K_ONE}, {K_ONE, OP_SUBTRACT}},
+    {"run/OP_MULTIPLY", {K_ONE}, {K_ONE, OP_MULTIPLY}},
+    {"run/OP_MULTIPLY/int", {K_INT}, {K_INT, OP_MULTIPLY}},
+    {"run/OP_DIVIDE", {K_ONE}, {K_ONE, OP_DIVIDE}},
+    {"run/OP_ADD_NUM", {K_ONE}, {K_ONE, OP_ADD_NUM}},
+    {"run/OP_ADD_NUM/int", {K_INT}, {K_INT, OP_ADD_NUM}},
+    {"run/OP_MULTIPLY_NUM", {K_ONE}, {K_ONE, OP_MULTIPLY_NUM}},
+    {"run/OP_LESS_NUM", {OP_TRUE}, {K_ONE, K_NUM, OP_LESS_NUM, OP_EQUAL}},
+    {"concatenate", {OP_TRUE}, {K_STR, K_STR, OP_ADD, OP_EQUAL}},
+};
+
+/**
+ * Adds the constants every benchmark chunk shares
+ * @param c The chunk to add them to
+ */
+static void add_constants(chunk *c) {
+    add_constant(c, number_value(1));
+    add_constant(c, number_value(2.5));
+    add_constant(c, object_value((object *)copy_string("abcdefghijklmnop", 16)));
+    add_constant(c, int_value(1));
+
+    while (c->constant_pool.size <= LONG_INDEX) {
+        add_constant(c, number_value(1));
+    }
+}
+
+/**
+ * Writes a benchmark instruction, expanding the constant pseudo-opcodes
+ * @param c The chunk to write to
+ * @param op The opcode or pseudo-opcode
+ * @return The number of instructions written
+ */
+static size_t write_op(chunk *c, uint8_t op) {
+    switch (op) {
+        case K_ONE:
+        case K_NUM:
+        case K_STR:
+        case K_INT:
+            write_instruction(c, OP_LOAD_CONST, 0, 1);
+            write_word(c, op - K_ONE, 1);
+            return 1;
+        case K_LONG:
+            write_instruction(c, OP_LOAD_CONST_LONG, 0, 1);
+            write_word(c, (uint16_t)LONG_INDEX, 1);
+            write_word(c, (uint16_t)(LONG_INDEX >> 16), 1);
+            return 1;
+        case K_IMM:
+            write_instruction(c, OP_LOAD_INT, 0, 1);
+            write_word(c, 1, 1);
+            return 1;
+        default: write_instruction(c, op, 0, 1); return 1;
+    }
+}
+
+/**
+ * Builds the chunk for a dispatch benchmark
+ * @param c The chunk to build into
+ * @param bench The benchmark
+ * @return The number of instructions the chunk executes
+ */
+static size_t build_chunk(chunk *c, const op_bench *bench) {
+    init_chunk(c);
+    add_constants(c);
+
+    size_t ops = 0;
+
+    // OP_RETURN is 0, so it marks the end of the arrays
+    for (int i = 0; i < 2 && bench->prologue[i] != OP_RETURN; ++i) {
+        ops += write_op(c, bench->prologue[i]);
+    }
+
+    for (int n = 0; n < BODY_REPEAT; ++n) {
+        for (int i = 0; i < 4 && bench->body[i] != OP_RETURN; ++i) {
+            ops += write_op(c, bench->body[i]);
+        }
+    }
+
+    write_instruction(c, OP_RETURN, 0, 1);
+
+    return ops + 1;
+}
+
+static void discard_output(void *ctx, const struct iovec *iov, int count) {
+    (void)ctx;
+    (void)iov;
+    (void)count;
+}
+
+static void run_chunk_once(void *ctx) {
+    if (run_chunk(ctx) != INTERPRET_OK) {
+        fprintf(stderr, "benchmark chunk failed to run!\n");
+        exit(1);
+    }
+}
+
+static void run_return(void *ctx) {
+    for (int i = 0; i < RETURN_RUNS; ++i) {
+        run_chunk(ctx);
+    }
+}
+
+/** A short expression, to show what compiling it on every evaluation costs */
+static const char *s_expression = "(1 + 2 * 3 - 4) / 5 > 0.5 == !(6 < 7)";
+
+static void run_interpret(void *ctx) {
+    (void)ctx;
+
+    for (int i = 0; i < EXPRESSION_RUNS; ++i) {
+        interpret(s_expression);
+    }
+}
+
+static void run_prepared(void *ctx) {
+    for (int i = 0; i < EXPRESSION_RUNS; ++i) {
+        clox_execute(ctx);
+    }
+}
+
+/**
+ * Builds the source of the property benchmarks: a function reading the first of an
+ * instance's fields BODY_REPEAT times, called with an instance. The field is the one
+ * furthest from the instance's shape, the worst case for a lookup without a cache.
+ * @param len Set to the size of the buffer holding the source
+ * @return The source, free it with FREE_ARRAY
+ */
+static char *property_source(size_t *len) {
+    size_t capacity = BODY_REPEAT * 8 + PROPERTY_FIELDS * 8 + 64;
+    char *source = ALLOCATE(char, capacity);
+    size_t pos = (size_t)sprintf(source, "fun f(o) { o.a");
+
+    for (int i = 1; i < BODY_REPEAT; ++i) {
+        pos += (size_t)sprintf(source + pos, " == o.a");
+    }
+
+    pos += (size_t)sprintf(source + pos, " }({");
+
+    for (int i = 0; i < PROPERTY_FIELDS; ++i) {
+        pos += (size_t)sprintf(source + pos, "%s%c = %d", i > 0 ? ", " : "", 'a' + i, i);
+    }
+
+    sprintf(source + pos, "})");
+    *len = capacity;
+
+    return source;
+}
+
+/**
+ * Builds the source of the concatenation benchmark: CHAIN_RUNS chains of CHAIN_LENGTH
+ * 16 character strings, compared with each other
+ * @param len Set to the size of the buffer holding the source
+ * @return The source, free it with FREE_ARRAY
+ */
+static char *chain_source(size_t *len) {
+    size_t capacity = CHAIN_RUNS * (CHAIN_LENGTH * 21 + 8) + 1;
+    char *source = ALLOCATE(char, capacity);
+    size_t pos = 0;
+
+    for (int i = 0; i < CHAIN_RUNS; ++i) {
+        pos += (size_t)sprintf(source + pos, "%s(", i > 0 ? " == " : "");
+
+        for (int j = 0; j < CHAIN_LENGTH; ++j) {
+            pos += (size_t)sprintf(source + pos, "%s\"abcdefghijklmnop\"", j > 0 ? " + " : "");
+        }
+
+        pos += (size_t)sprintf(source + pos, ")");
+    }
+
+    *len = capacity;
+
+    return source;
+}
+
+static void run_prepared_once(void *ctx) {
+    if (clox_execute(ctx) != INTERPRET_OK) {
+        fprintf(stderr, "benchmark source failed to run!\n");
+        exit(1);
+    }
+}
+
+static void free_results(void *ctx) {
+    (void)ctx;
+
+    // frees the strings made by OP_ADD, the frozen constants aren't on the VM's list
+    free_vm();
+}
+
+void bench_vm() {
+    set_output_sink(&g_vm.out, discard_output, NULL, false);
+
+    for (size_t i = 0; i < sizeof(s_op_benches) / sizeof(s_op_benches[0]); ++i) {
+        chunk c;
+        size_t ops = build_chunk(&c, &s_op_benches[i]);
+
+        // keeps the constant string away from the reset
+        freeze_chunk(&c);
+
+        bench_spec spec = {
+            .name = s_op_benches[i].name,
+            .run = run_chunk_once,
+            .reset = free_results,
+            .ctx = &c,
+            .ops = ops,
+        };
+
+        bench_run(&spec);
+
+        free_vm();
+        free_chunk(&c);
+    }
+
+    chunk c;
+    init_chunk(&c);
+    write_instruction(&c, OP_TRUE, 0, 1);
+    write_instruction(&c, OP_RETURN, 0, 1);
+
+    bench_spec spec = {
+        .name = "run/OP_RETURN",
+        .run = run_return,
+        .ctx = &c,
+        .ops = RETURN_RUNS,
+    };
+
+    bench_run(&spec);
+    free_chunk(&c);
+
+    spec.name = "expression/interpret";
+    spec.run = run_interpret;
+    spec.ops = EXPRESSION_RUNS;
+    bench_run(&spec);
+
+    prepared *prep = clox_prepare(s_expression);
+
+    spec.name = "expression/prepared";
+    spec.run = run_prepared;
+    spec.ctx = prep;
+    bench_run(&spec);
+
+    clox_release(prep);
+
+    // nothing but calls, integer arithmetic and the `and` / `or` jumps
+    prep = clox_prepare("fun fib(n) { n < 2 and n or fib(n - 1) + fib(n - 2) }(20)");
+
+    spec.name = "call/fib";
+    spec.run = run_prepared_once;
+    spec.ctx = prep;
+    spec.ops = FIB_CALLS;
+    bench_run(&spec);
+
+    clox_release(prep);
+
+    size_t source_len;
+    char *source = chain_source(&source_len);
+    prep = clox_prepare(source);
+
+    spec.name = "concatenate/chain";
+    spec.reset = free_results;
+    spec.ctx = prep;
+    spec.ops = CHAIN_RUNS * CHAIN_LENGTH;
+    bench_run(&spec);
+    spec.reset = NULL;
+
+    clox_release(prep);
+    FREE_ARRAY(source, char, source_len);
+
+    source = property_source(&source_len);
+
+    // unfrozen, so the accesses cache the instance's shape. Its property names are on the
+    // VM's object list, so nothing is freed until the end
+    chunk property;
+    init_chunk(&property);
+    compile(source, &property);
+
+    spec.name = "property/cached";
+    spec.run = run_chunk_once;
+    spec.ctx = &property;
+    spec.ops = BODY_REPEAT;
+    bench_run(&spec);
+
+    free_vm();
+    free_chunk(&property);
+
+    // a frozen chunk is shared between threads, so every access looks the field up
+    init_chunk(&property);
+    compile(source, &property);
+    freeze_chunk(&property);
+
+    spec.name = "property/uncached";
+    spec.reset = free_results;
+    bench_run(&spec);
+
+    free_vm();
+    free_chunk(&property);
+    FREE_ARRAY(source, char, source_len);
+
+    init_output(&g_vm.out);
+}
@@ -0,0 +1,26 @@
+#include "cpu.h"
+
+#if CPU_HAS_X86
+#include <cpuid.h>
+#endif
+
+bool cpu_has_avx2() {
+#if CPU_HAS_X86
+    unsigned eax, ebx, ecx, edx;
+
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) { return false; }
+
+    // AVX needs both CPU support and the OS saving the YMM registers (OSXSAVE)
+    if ((ecx & bit_OSXSAVE) == 0 || (ecx & bit_AVX) == 0) { return false; }
+
+    unsigned xcr0_lo, xcr0_hi;
+    __asm__("xgetbv" : "=a"(xcr0_lo), "=d"(xcr0_hi) : "c"(0));
+    if ((xcr0_lo & 0x6u) != 0x6u) { return false; }
+
+    if (!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx)) { return false; }
+
+    return (ebx & bit_AVX2) != 0;
+#else
+    return false;
+#endif
+}
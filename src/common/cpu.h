@@ -0,0 +1,16 @@
+#pragma once
+
+#include "common.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && defined(__SSE2__)
+/** Whether the SSE2 and AVX2 kernels can be compiled, SSE2 is always there when they can */
+#define CPU_HAS_X86 1
+#else
+#define CPU_HAS_X86 0
+#endif
+
+/**
+ * Asks cpuid (and the OS, through xgetbv) whether AVX2 is usable
+ * @return Whether AVX2 instructions can be executed, always false off x86
+ */
+bool cpu_has_avx2();
@@ -1,12 +1,27 @@
 #include "memory.h"
 #include <stdlib.h>
 
+_Thread_local alloc_stats g_alloc_stats;
+
 void *reallocate(void *old, size_t old_size, size_t new_size) {
+    g_alloc_stats.live_bytes += new_size - old_size;
+
     if (new_size == 0) {
+        ++g_alloc_stats.frees;
         free(old);
         return NULL;
     }
 
+    if (old == NULL) {
+        ++g_alloc_stats.allocations;
+    } else {
+        ++g_alloc_stats.reallocations;
+    }
+
+    if (g_alloc_stats.live_bytes > g_alloc_stats.peak_bytes) {
+        g_alloc_stats.peak_bytes = g_alloc_stats.live_bytes;
+    }
+
     return realloc(old, new_size);
 }
 
@@ -18,5 +33,17 @@ void free_object(object *ptr) {
             FREE(string, str);
             break;
         }
+        case OBJ_FUNCTION: {
+            function *fn = (function *)ptr;
+            free_chunk(&fn->chunk);
+            FREE(function, fn);
+            break;
+        }
+        case OBJ_INSTANCE: {
+            instance *inst = (instance *)ptr;
+            FREE_ARRAY(inst->fields, value, inst->capacity);
+            FREE(instance, inst);
+            break;
+        }
     }
 }
\ No newline at end of file
@@ -3,6 +3,30 @@
 #include "../vm/object.h"
 #include "common.h"
 
+/** Counters kept by `reallocate`, for benchmarks and statistics */
+typedef struct alloc_stats {
+    /** Blocks allocated from nothing */
+    size_t allocations;
+
+    /** Blocks resized */
+    size_t reallocations;
+
+    /** Blocks freed */
+    size_t frees;
+
+    /** Bytes currently allocated */
+    size_t live_bytes;
+
+    /** Most bytes ever allocated at once */
+    size_t peak_bytes;
+
+    /** Lox objects allocated */
+    size_t objects;
+} alloc_stats;
+
+/** The calling thread's allocation counters */
+extern _Thread_local alloc_stats g_alloc_stats;
+
 /**
  * Returns the new capacity for an chunk
  * @param old_capacity The old capacity for the chunk
@@ -14,28 +38,6 @@ static inline size_t grow_capacity(size_t old_capacity) {
     return old_capacity * 2;
 }
 
-/**
- * Creates a size_t from three bytes
- * @param one The first byte
- * @param two The second byte
- * @param three The third byte
- * @return The bytes as a normal number
- */
-static inline size_t from_bytes(uint8_t one, uint8_t two, uint8_t three) {
-    return one + (two << 8u) + (three << 16u);
-}
-
-/**
- * Gets three bytes from a size_t
- * @param bytes A pre-allocated buffer with space for at least 3 bytes
- * @param n The number to turn into bytes
- */
-static inline void get_bytes(uint8_t *bytes, size_t n) {
-    bytes[0] = n & 0xFFu;
-    bytes[1] = (n & 0xFF00u) >> 8u;
-    bytes[2] = (n & 0xFF0000u) >> 16u;
-}
-
 /**
  * Expands an array
  * @param ptr The array to expand
@@ -0,0 +1,343 @@
+#include "number_format.h"
+#include "ryu_tables.h"
+#include <string.h>
+
+// This is Ryu (Ulf Adams, "Ryu: Fast Float-to-String Conversion", PLDI 2018). The
+// double is turned into the interval of decimals that round back to it, and digits
+// are removed from the bounds of that interval until removing another one would
+// leave it. What's left is the shortest representation, rounded correctly.
+
+#define DOUBLE_MANTISSA_BITS 52
+#define DOUBLE_EXPONENT_BITS 11
+#define DOUBLE_BIAS 1023
+
+/**
+ * Computes ceil(log2(5^e)), or 1 for e == 0
+ * @param e The exponent, in [0, 3528]
+ * @return The number of bits in 5^e
+ */
+static inline int32_t pow5_bits(int32_t e) {
+    return (int32_t)((((uint32_t)e * 1217359) >> 19) + 1);
+}
+
+/**
+ * Computes floor(log10(2^e))
+ * @param e The exponent, in [0, 1650]
+ * @return floor(log10(2^e))
+ */
+static inline uint32_t log10_pow2(int32_t e) {
+    return ((uint32_t)e * 78913) >> 18;
+}
+
+/**
+ * Computes floor(log10(5^e))
+ * @param e The exponent, in [0, 2620]
+ * @return floor(log10(5^e))
+ */
+static inline uint32_t log10_pow5(int32_t e) {
+    return ((uint32_t)e * 732923) >> 20;
+}
+
+/**
+ * Checks if `val` is divisible by 5^p
+ * @param val The value to check
+ * @param p The power of five
+ * @return Whether 5^p divides `val`
+ */
+static inline bool multiple_of_pow5(uint64_t val, uint32_t p) {
+    uint32_t count = 0;
+
+    for (; val % 5 == 0; val /= 5) {
+        ++count;
+    }
+
+    return count >= p;
+}
+
+/**
+ * Checks if `val` is divisible by 2^p
+ * @param val The value to check
+ * @param p The power of two, less than 64
+ * @return Whether 2^p divides `val`
+ */
+static inline bool multiple_of_pow2(uint64_t val, uint32_t p) {
+    return (val & ((UINT64_C(1) << p) - 1)) == 0;
+}
+
+/**
+ * Computes (m * mul) >> j, where `mul` is a 128-bit table entry
+ * @param m The value to multiply
+ * @param mul The { low, high } table entry
+ * @param j The shift, at least 64
+ * @return The shifted product
+ */
+static inline uint64_t mul_shift(uint64_t m, const uint64_t *mul, int32_t j) {
+    unsigned __int128 low = (unsigned __int128)m * mul[0];
+    unsigned __int128 high = (unsigned __int128)m * mul[1];
+
+    return (uint64_t)(((low >> 64) + high) >> (j - 64));
+}
+
+/** A double decomposed into `mantissa * 10^exponent` with the fewest digits */
+typedef struct decimal {
+    uint64_t mantissa;
+    int32_t exponent;
+} decimal;
+
+/**
+ * Finds the shortest decimal that rounds back to a finite, nonzero double
+ * @param ieee_mantissa The mantissa bits of the double
+ * @param ieee_exponent The exponent bits of the double
+ * @return The shortest decimal
+ */
+static decimal shortest_decimal(uint64_t ieee_mantissa, uint32_t ieee_exponent) {
+    int32_t e2;
+    uint64_t m2;
+
+    if (ieee_exponent == 0) {
+        e2 = 1 - DOUBLE_BIAS - DOUBLE_MANTISSA_BITS - 2;
+        m2 = ieee_mantissa;
+    } else {
+        e2 = (int32_t)ieee_exponent - DOUBLE_BIAS - DOUBLE_MANTISSA_BITS - 2;
+        m2 = (UINT64_C(1) << DOUBLE_MANTISSA_BITS) | ieee_mantissa;
+    }
+
+    // round-to-even means the bounds themselves round back to the double when m2 is even
+    bool accept_bounds = (m2 & 1) == 0;
+
+    // the interval is [4 * m2 - 1 - mm_shift, 4 * m2 + 2] (scaled by 2^e2), the lower
+    // bound is closer when the double is a power of two
+    uint64_t mv = 4 * m2;
+    uint32_t mm_shift = ieee_mantissa != 0 || ieee_exponent <= 1;
+
+    uint64_t vr, vp, vm;
+    int32_t e10;
+    bool vm_trailing_zeros = false;
+    bool vr_trailing_zeros = false;
+
+    if (e2 >= 0) {
+        uint32_t q = log10_pow2(e2) - (e2 > 3);
+        int32_t k = DOUBLE_POW5_INV_BITCOUNT + pow5_bits((int32_t)q) - 1;
+        int32_t i = -e2 + (int32_t)q + k;
+        const uint64_t *mul = g_double_pow5_inv_split[q];
+
+        e10 = (int32_t)q;
+        vr = mul_shift(mv, mul, i);
+        vp = mul_shift(mv + 2, mul, i);
+        vm = mul_shift(mv - 1 - mm_shift, mul, i);
+
+        if (q <= 21) {
+            // only one of mv, mv + 2 and mv - 1 - mm_shift can be a multiple of 5
+            if (mv % 5 == 0) {
+                vr_trailing_zeros = multiple_of_pow5(mv, q);
+            } else if (accept_bounds) {
+                vm_trailing_zeros = multiple_of_pow5(mv - 1 - mm_shift, q);
+            } else {
+                vp -= multiple_of_pow5(mv + 2, q);
+            }
+        }
+    } else {
+        uint32_t q = log10_pow5(-e2) - (-e2 > 1);
+        int32_t i = -e2 - (int32_t)q;
+        int32_t k = pow5_bits(i) - DOUBLE_POW5_BITCOUNT;
+        int32_t j = (int32_t)q - k;
+        const uint64_t *mul = g_double_pow5_split[i];
+
+        e10 = (int32_t)q + e2;
+        vr = mul_shift(mv, mul, j);
+        vp = mul_shift(mv + 2, mul, j);
+        vm = mul_shift(mv - 1 - mm_shift, mul, j);
+
+        if (q <= 1) {
+            // mv has at least q trailing zero bits, and so does mv - 1 - mm_shift when
+            // mm_shift is 1
+            vr_trailing_zeros = true;
+
+            if (accept_bounds) {
+                vm_trailing_zeros = mm_shift == 1;
+            } else {
+                --vp;
+            }
+        } else if (q < 63) {
+            vr_trailing_zeros = multiple_of_pow2(mv, q);
+        }
+    }
+
+    int32_t removed = 0;
+    uint32_t last_removed = 0;
+    uint64_t output;
+
+    if (vm_trailing_zeros || vr_trailing_zeros) {
+        // the general case, which is rare: keep track of whether everything removed
+        // was a zero to round exact halfway cases to even
+        while (vp / 10 > vm / 10) {
+            vm_trailing_zeros &= vm % 10 == 0;
+            vr_trailing_zeros &= last_removed == 0;
+            last_removed = (uint32_t)(vr % 10);
+            vr /= 10;
+            vp /= 10;
+            vm /= 10;
+            ++removed;
+        }
+
+        if (vm_trailing_zeros) {
+            while (vm % 10 == 0) {
+                vr_trailing_zeros &= last_removed == 0;
+                last_removed = (uint32_t)(vr % 10);
+                vr /= 10;
+                vp /= 10;
+                vm /= 10;
+                ++removed;
+            }
+        }
+
+        if (vr_trailing_zeros && last_removed == 5 && vr % 2 == 0) {
+            // exactly halfway, round to even
+            last_removed = 4;
+        }
+
+        output = vr + ((vr == vm && (!accept_bounds || !vm_trailing_zeros)) || last_removed >= 5);
+    } else {
+        // the common case
+        bool round_up = false;
+
+        if (vp / 100 > vm / 100) {
+            round_up = vr % 100 >= 50;
+            vr /= 100;
+            vp /= 100;
+            vm /= 100;
+            removed += 2;
+        }
+
+        while (vp / 10 > vm / 10) {
+            round_up = vr % 10 >= 5;
+            vr /= 10;
+            vp /= 10;
+            vm /= 10;
+            ++removed;
+        }
+
+        output = vr + (vr == vm || round_up);
+    }
+
+    decimal dec = {output, e10 + removed};
+    return dec;
+}
+
+/**
+ * Writes the digits of a number
+ * @param n The number
+ * @param buf Where to write the digits
+ * @return The number of digits written
+ */
+static inline size_t write_digits(uint64_t n, char *buf) {
+    char digits[20];
+    size_t len = 0;
+
+    do {
+        digits[len++] = (char)('0' + n % 10);
+        n /= 10;
+    } while (n != 0);
+
+    for (size_t i = 0; i < len; ++i) {
+        buf[i] = digits[len - 1 - i];
+    }
+
+    return len;
+}
+
+size_t format_number(double val, char *buf) {
+    uint64_t bits;
+    memcpy(&bits, &val, sizeof(bits));
+
+    bool negative = (bits >> 63) != 0;
+    uint64_t ieee_mantissa = bits & ((UINT64_C(1) << DOUBLE_MANTISSA_BITS) - 1);
+    uint32_t ieee_exponent =
+        (uint32_t)((bits >> DOUBLE_MANTISSA_BITS) & ((1u << DOUBLE_EXPONENT_BITS) - 1));
+
+    char *out = buf;
+
+    if (ieee_exponent == (1u << DOUBLE_EXPONENT_BITS) - 1 && ieee_mantissa != 0) {
+        memcpy(out, "nan", 4);
+        return 3;
+    }
+
+    if (negative) { *out++ = '-'; }
+
+    if (ieee_exponent == (1u << DOUBLE_EXPONENT_BITS) - 1) {
+        memcpy(out, "inf", 4);
+        return (size_t)(out - buf) + 3;
+    }
+
+    if (ieee_exponent == 0 && ieee_mantissa == 0) {
+        memcpy(out, "0", 2);
+        return (size_t)(out - buf) + 1;
+    }
+
+    decimal dec = shortest_decimal(ieee_mantissa, ieee_exponent);
+
+    char digits[20];
+    int32_t len = (int32_t)write_digits(dec.mantissa, digits);
+
+    // exponent of the first digit, as in `d.ddd * 10^sci`
+    int32_t sci = dec.exponent + len - 1;
+
+    if (sci > -7 && sci < 21) {
+        if (dec.exponent >= 0) {
+            // an integer, pad it with zeros
+            memcpy(out, digits, len);
+            memset(out + len, '0', dec.exponent);
+            out += len + dec.exponent;
+        } else if (sci >= 0) {
+            // the decimal point goes somewhere inside the digits
+            memcpy(out, digits, sci + 1);
+            out += sci + 1;
+            *out++ = '.';
+            memcpy(out, digits + sci + 1, len - sci - 1);
+            out += len - sci - 1;
+        } else {
+            // below 1, so it starts with "0.000..."
+            *out++ = '0';
+            *out++ = '.';
+            memset(out, '0', -sci - 1);
+            out += -sci - 1;
+            memcpy(out, digits, len);
+            out += len;
+        }
+    } else {
+        *out++ = digits[0];
+
+        if (len > 1) {
+            *out++ = '.';
+            memcpy(out, digits + 1, len - 1);
+            out += len - 1;
+        }
+
+        *out++ = 'e';
+        *out++ = sci < 0 ? '-' : '+';
+
+        // at least two exponent digits, like printf("%g")
+        uint32_t exp = (uint32_t)(sci < 0 ? -sci : sci);
+        if (exp < 10) { *out++ = '0'; }
+        out += write_digits(exp, out);
+    }
+
+    *out = '\0';
+    return (size_t)(out - buf);
+}
+
+size_t format_int(int64_t val, char *buf) {
+    char *out = buf;
+
+    // negating in unsigned arithmetic handles INT64_MIN
+    uint64_t magnitude = (uint64_t)val;
+    if (val < 0) {
+        *out++ = '-';
+        magnitude = 0 - magnitude;
+    }
+
+    out += write_digits(magnitude, out);
+    *out = '\0';
+
+    return (size_t)(out - buf);
+}
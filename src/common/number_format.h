@@ -0,0 +1,28 @@
+#pragma once
+
+#include "common.h"
+
+/** Size of a buffer that can hold any formatted number, including the NUL */
+#define NUMBER_FORMAT_MAX 32
+
+/**
+ * Formats a double as the shortest decimal string that parses back to exactly the
+ * same double. Doesn't depend on the locale.
+ *
+ * Numbers whose decimal exponent is between -7 and 21 (exclusive) are written in
+ * plain notation (`1024`, `0.1`, `0.000123`), anything else in scientific notation
+ * (`1e+21`, `1.5e-07`). NaN and the infinities are written as `nan`, `inf` and `-inf`.
+ *
+ * @param val The number to format
+ * @param buf A buffer of at least NUMBER_FORMAT_MAX characters
+ * @return The number of characters written, not counting the NUL terminator
+ */
+size_t format_number(double val, char *buf);
+
+/**
+ * Formats an integer in decimal
+ * @param val The integer to format
+ * @param buf A buffer of at least NUMBER_FORMAT_MAX characters
+ * @return The number of characters written, not counting the NUL terminator
+ */
+size_t format_int(int64_t val, char *buf);
@@ -0,0 +1,16 @@
+#pragma once
+
+#include <stdint.h>
+
+/** Number of bits every entry of the power-of-five tables is scaled to */
+#define DOUBLE_POW5_INV_BITCOUNT 125
+#define DOUBLE_POW5_BITCOUNT 125
+
+#define DOUBLE_POW5_INV_TABLE_SIZE 342
+#define DOUBLE_POW5_TABLE_SIZE 326
+
+/** 128-bit scaled reciprocals of 5^q, stored as { low 64 bits, high 64 bits } */
+extern const uint64_t g_double_pow5_inv_split[DOUBLE_POW5_INV_TABLE_SIZE][2];
+
+/** 128-bit scaled values of 5^i, stored as { low 64 bits, high 64 bits } */
+extern const uint64_t g_double_pow5_split[DOUBLE_POW5_TABLE_SIZE][2];
@@ -1,22 +1,45 @@
 #include "compiler.h"
 #include "../common/memory.h"
+#include "../util/probes.h"
+#include "../util/stats.h"
 #include "../vm/object.h"
+#include "../vm/verifier.h"
+#include "../vm/vm.h"
+#include "number_parse.h"
 #include "scanner.h"
+#include <assert.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #ifdef DEBUG_PRINT_CODE
 #include "../util/disassembler.h"
 #endif
 
+/** Most operands one OP_CONCAT_N takes, they all have to be on the stack at once */
+#define MAX_CONCAT_OPERANDS 16
+
+/**
+ * What the compiler knows about the value of an expression. Only literals and what
+ * operators are sure to produce are known, everything else has to be checked at runtime
+ */
+typedef enum static_type {
+    TYPE_UNKNOWN,
+    /** An integer or a double */
+    TYPE_NUMBER,
+    TYPE_BOOL,
+    TYPE_STRING,
+    TYPE_NIL,
+} static_type;
+
 /** The parser instance */
 static struct {
-    /** The current token being parsed */
-    token current;
+    /** Tokens scanned ahead of the parser */
+    token_batch tokens;
 
-    /** The previous token */
-    token previous;
+    /** Index of the current token in `tokens`, the previous token is right before it */
+    size_t current;
 
     /** Whether or not the parser had a compilation error */
     bool had_err;
@@ -26,6 +49,30 @@ static struct {
 
     /** Pointer to the chunk being written to */
     chunk *current_chunk;
+
+    /** Names of the inputs identifiers can refer to, see `compile_with_inputs` */
+    const char *const *inputs;
+
+    /** Number of names in `inputs` */
+    size_t input_count;
+
+    /**
+     * Names of the stack slots of the function being compiled: its own name, then its
+     * parameters. An empty slot's name never matches an identifier
+     */
+    struct {
+        const char *name;
+        int len;
+    } locals[MAX_PARAMS + 1];
+
+    /** Number of names in `locals`, 0 outside of a function body */
+    int local_count;
+
+    /** Whether the expression being parsed can be the target of an assignment */
+    bool can_assign;
+
+    /** The type of the expression compiled last */
+    static_type type;
 } s_parser;
 
 typedef enum {
@@ -54,68 +101,76 @@ static void binary();
 static void unary();
 static void grouping();
 static void number();
+static void identifier();
+static void call();
+static void function_literal();
+static void dot();
+static void and_();
+static void or_();
+static void instance_literal();
 static void literal();
 static void string_literal();
 
 parse_rule rules[] = {
-    {grouping, NULL, PREC_NONE},     // TOKEN_LEFT_PAREN
-    {NULL, NULL, PREC_NONE},         // TOKEN_RIGHT_PAREN
-    {NULL, NULL, PREC_NONE},         // TOKEN_LEFT_BRACE
-    {NULL, NULL, PREC_NONE},         // TOKEN_RIGHT_BRACE
-    {NULL, NULL, PREC_NONE},         // TOKEN_COMMA
-    {NULL, NULL, PREC_NONE},         // TOKEN_DOT
-    {unary, binary, PREC_TERM},      // TOKEN_MINUS
-    {NULL, binary, PREC_TERM},       // TOKEN_PLUS
-    {NULL, NULL, PREC_NONE},         // TOKEN_SEMICOLON
-    {NULL, binary, PREC_FACTOR},     // TOKEN_SLASH
-    {NULL, binary, PREC_FACTOR},     // TOKEN_STAR
-    {unary, NULL, PREC_NONE},        // TOKEN_BANG
-    {NULL, NULL, PREC_NONE},         // TOKEN_BANG_EQUAL
-    {NULL, NULL, PREC_NONE},         // TOKEN_EQUAL
-    {NULL, binary, PREC_EQUALITY},   // TOKEN_EQUAL_EQUAL
-    {NULL, binary, PREC_COMPARISON}, // TOKEN_GREATER
-    {NULL, binary, PREC_COMPARISON}, // TOKEN_GREATER_EQUAL
-    {NULL, binary, PREC_COMPARISON}, // TOKEN_LESS
-    {NULL, binary, PREC_COMPARISON}, // TOKEN_LESS_EQUAL
-    {NULL, NULL, PREC_NONE},         // TOKEN_IDENTIFIER
-    {string_literal, NULL, PREC_NONE},       // TOKEN_STRING
-    {number, NULL, PREC_NONE},       // TOKEN_NUMBER
-    {NULL, NULL, PREC_NONE},         // TOKEN_AND
-    {NULL, NULL, PREC_NONE},         // TOKEN_CLASS
-    {NULL, NULL, PREC_NONE},         // TOKEN_ELSE
-    {literal, NULL, PREC_NONE},      // TOKEN_FALSE
-    {NULL, NULL, PREC_NONE},         // TOKEN_FOR
-    {NULL, NULL, PREC_NONE},         // TOKEN_FUN
-    {NULL, NULL, PREC_NONE},         // TOKEN_IF
-    {literal, NULL, PREC_NONE},      // TOKEN_NIL
-    {NULL, NULL, PREC_NONE},         // TOKEN_OR
-    {NULL, NULL, PREC_NONE},         // TOKEN_PRINT
-    {NULL, NULL, PREC_NONE},         // TOKEN_RETURN
-    {NULL, NULL, PREC_NONE},         // TOKEN_SUPER
-    {NULL, NULL, PREC_NONE},         // TOKEN_THIS
-    {literal, NULL, PREC_NONE},      // TOKEN_TRUE
-    {NULL, NULL, PREC_NONE},         // TOKEN_VAR
-    {NULL, NULL, PREC_NONE},         // TOKEN_WHILE
-    {NULL, NULL, PREC_NONE},         // TOKEN_ERROR
-    {NULL, NULL, PREC_NONE},         // TOKEN_EOF
+    {grouping, call, PREC_CALL},         // TOKEN_LEFT_PAREN
+    {NULL, NULL, PREC_NONE},             // TOKEN_RIGHT_PAREN
+    {instance_literal, NULL, PREC_NONE}, // TOKEN_LEFT_BRACE
+    {NULL, NULL, PREC_NONE},             // TOKEN_RIGHT_BRACE
+    {NULL, NULL, PREC_NONE},             // TOKEN_COMMA
+    {NULL, dot, PREC_CALL},              // TOKEN_DOT
+    {unary, binary, PREC_TERM},          // TOKEN_MINUS
+    {NULL, binary, PREC_TERM},           // TOKEN_PLUS
+    {NULL, NULL, PREC_NONE},             // TOKEN_SEMICOLON
+    {NULL, binary, PREC_FACTOR},         // TOKEN_SLASH
+    {NULL, binary, PREC_FACTOR},         // TOKEN_STAR
+    {unary, NULL, PREC_NONE},            // TOKEN_BANG
+    {NULL, NULL, PREC_NONE},             // TOKEN_BANG_EQUAL
+    {NULL, NULL, PREC_NONE},             // TOKEN_EQUAL
+    {NULL, binary, PREC_EQUALITY},       // TOKEN_EQUAL_EQUAL
+    {NULL, binary, PREC_COMPARISON},     // TOKEN_GREATER
+    {NULL, binary, PREC_COMPARISON},     // TOKEN_GREATER_EQUAL
+    {NULL, binary, PREC_COMPARISON},     // TOKEN_LESS
+    {NULL, binary, PREC_COMPARISON},     // TOKEN_LESS_EQUAL
+    {identifier, NULL, PREC_NONE},       // TOKEN_IDENTIFIER
+    {string_literal, NULL, PREC_NONE},   // TOKEN_STRING
+    {number, NULL, PREC_NONE},           // TOKEN_NUMBER
+    {NULL, and_, PREC_AND},              // TOKEN_AND
+    {NULL, NULL, PREC_NONE},             // TOKEN_CLASS
+    {NULL, NULL, PREC_NONE},             // TOKEN_ELSE
+    {literal, NULL, PREC_NONE},          // TOKEN_FALSE
+    {NULL, NULL, PREC_NONE},             // TOKEN_FOR
+    {function_literal, NULL, PREC_NONE}, // TOKEN_FUN
+    {NULL, NULL, PREC_NONE},             // TOKEN_IF
+    {literal, NULL, PREC_NONE},          // TOKEN_NIL
+    {NULL, or_, PREC_OR},                // TOKEN_OR
+    {NULL, NULL, PREC_NONE},             // TOKEN_PRINT
+    {NULL, NULL, PREC_NONE},             // TOKEN_RETURN
+    {NULL, NULL, PREC_NONE},             // TOKEN_SUPER
+    {NULL, NULL, PREC_NONE},             // TOKEN_THIS
+    {literal, NULL, PREC_NONE},          // TOKEN_TRUE
+    {NULL, NULL, PREC_NONE},             // TOKEN_VAR
+    {NULL, NULL, PREC_NONE},             // TOKEN_WHILE
+    {NULL, NULL, PREC_NONE},             // TOKEN_ERROR
+    {NULL, NULL, PREC_NONE},             // TOKEN_EOF
 };
 
 /**
  * Reports an error at a specific token
- * @param tok Pointer to the offending token
+ * @param idx Index of the offending token in the token batch
  * @param message The error to report
  */
-static void error_at(token *tok, const char *message) {
+static void error_at(size_t idx, const char *message) {
     if (s_parser.panic) return;
     s_parser.panic = true;
-    fprintf(stderr, "[line %d] Error at ", tok->line);
+    token_batch *tokens = &s_parser.tokens;
+    fprintf(stderr, "[line %u] Error at ", tokens->line[idx]);
 
-    if (tok->type == TOKEN_EOF) {
+    if (tokens->type[idx] == TOKEN_EOF) {
         fprintf(stderr, "end");
-    } else if (tok->type == TOKEN_ERROR) {
+    } else if (tokens->type[idx] == TOKEN_ERROR) {
         //
     } else {
-        fprintf(stderr, "'%.*s'", tok->len, tok->tok_start);
+        fprintf(stderr, "'%.*s'", (int)tokens->len[idx], token_text(tokens, idx));
     }
 
     fprintf(stderr, ": %s\n", message);
@@ -128,7 +183,7 @@ static void error_at(token *tok, const char *message) {
  * @param message The error to report
  */
 static inline void error_at_current(const char *message) {
-    error_at(&s_parser.current, message);
+    error_at(s_parser.current, message);
 }
 
 /**
@@ -136,33 +191,88 @@ static inline void error_at_current(const char *message) {
  * @param message The error to report
  */
 static inline void error(const char *message) {
-    error_at(&s_parser.previous, message);
+    error_at(s_parser.current - 1, message);
 }
 
 /**
- * Writes a byte to the currently compiling chunk
- * @param byte The byte to emit
+ * Gets the type of the current token
+ * @return The current token's type
  */
-static inline void emit_byte(uint8_t byte) {
-    write_byte(s_parser.current_chunk, byte, s_parser.previous.line);
+static inline token_type current_type() {
+    return (token_type)s_parser.tokens.type[s_parser.current];
 }
 
 /**
- * Emits `count` bytes
- * @param count The number of bytes to emit
- * @param ... List of the bytes to emit
+ * Gets the type of the previous token
+ * @return The previous token's type
  */
-static inline void emit_bytes(size_t count, ...) {
-    va_list bytes;
-    va_start(bytes, count);
+static inline token_type previous_type() {
+    return (token_type)s_parser.tokens.type[s_parser.current - 1];
+}
 
-    for (; count != 0; --count) {
-        uint8_t byte = (uint8_t)va_arg(bytes, int);
+/**
+ * Gets the text of the previous token
+ * @return Pointer to the first character of the previous token
+ */
+static inline const char *previous_text() {
+    return token_text(&s_parser.tokens, s_parser.current - 1);
+}
+
+/**
+ * Gets the line of the previous token
+ * @return The line the previous token is on
+ */
+static inline size_t previous_line() {
+    return s_parser.tokens.line[s_parser.current - 1];
+}
+
+/**
+ * Gets the length of the previous token
+ * @return The previous token's length
+ */
+static inline int previous_len() {
+    return (int)s_parser.tokens.len[s_parser.current - 1];
+}
+
+/**
+ * Writes an instruction with a one byte operand to the currently compiling chunk
+ * @param op The opcode
+ * @param operand The operand
+ */
+static inline void emit_instruction(op_code op, uint8_t operand) {
+    write_instruction(s_parser.current_chunk, op, operand, previous_line());
+}
 
-        emit_byte(byte);
+/**
+ * Writes an operand word after the instruction just emitted
+ * @param word The operand
+ */
+static inline void emit_word(uint16_t word) {
+    write_word(s_parser.current_chunk, word, previous_line());
+}
+
+/**
+ * Writes an instruction that takes no operand to the currently compiling chunk
+ * @param op The opcode
+ */
+static inline void emit_op(op_code op) {
+    emit_instruction(op, 0);
+}
+
+/**
+ * Emits `count` instructions that take no operands
+ * @param count The number of instructions to emit
+ * @param ... List of the opcodes to emit
+ */
+static inline void emit_ops(size_t count, ...) {
+    va_list ops;
+    va_start(ops, count);
+
+    for (; count != 0; --count) {
+        emit_op((op_code)va_arg(ops, int));
     }
 
-    va_end(bytes);
+    va_end(ops);
 }
 
 /**
@@ -170,7 +280,33 @@ static inline void emit_bytes(size_t count, ...) {
  * @param constant The constant to write
  */
 static inline void emit_constant(value constant) {
-    write_constant(s_parser.current_chunk, constant, s_parser.previous.line);
+    write_constant(s_parser.current_chunk, constant, previous_line());
+}
+
+/**
+ * Emits a jump with a placeholder offset, for `patch_jump` to fill in
+ * @param op The jump instruction
+ * @return The offset of the jump's operand
+ */
+static inline size_t emit_jump(op_code op) {
+    emit_op(op);
+    emit_word(UINT16_MAX);
+
+    return s_parser.current_chunk->size - 2;
+}
+
+/**
+ * Points a jump at the next instruction to be emitted
+ * @param operand The offset of the jump's operand, from `emit_jump`
+ */
+static void patch_jump(size_t operand) {
+    chunk *c = s_parser.current_chunk;
+    size_t jump = c->size - operand - 2;
+
+    if (jump > UINT16_MAX) { error("Too much code to jump over."); }
+
+    uint16_t word = (uint16_t)jump;
+    memcpy(&c->code[operand], &word, sizeof(word));
 }
 
 /**
@@ -182,21 +318,63 @@ static inline parse_rule *get_rule(token_type type) {
     return &rules[type];
 }
 
+/**
+ * Moves the token at `from` to index `to` of the token batch
+ * @param from The index to move from
+ * @param to The index to move to
+ */
+static inline void move_token(size_t from, size_t to) {
+    token_batch *tokens = &s_parser.tokens;
+
+    tokens->type[to] = tokens->type[from];
+    tokens->offset[to] = tokens->offset[from];
+    tokens->len[to] = tokens->len[from];
+    tokens->line[to] = tokens->line[from];
+}
+
+/**
+ * Refills the token batch once the parser has reached its last token. The current
+ * token is kept at the front of the batch so it can become the previous token.
+ */
+static void refill_tokens() {
+    move_token(s_parser.current, 0);
+    s_parser.current = 0;
+
+    if (!g_vm.stats) {
+        scan_batch(&s_parser.tokens, 1);
+        return;
+    }
+
+    uint64_t start = now_ns();
+    scan_batch(&s_parser.tokens, 1);
+    g_stats.scan_ns += now_ns() - start;
+}
+
 /**
  * "Advances" the parser by consuming another token
  */
 static void advance() {
-    s_parser.previous = s_parser.current;
-
-    while (true) {
-        s_parser.current = scan();
+    if (s_parser.current + 1 >= s_parser.tokens.count) { refill_tokens(); }
 
-        if (s_parser.current.type == TOKEN_ERROR) error_at_current(s_parser.current.tok_start);
+    ++s_parser.current;
 
-        break;
+    if (current_type() == TOKEN_ERROR) {
+        error_at_current(token_text(&s_parser.tokens, s_parser.current));
     }
 }
 
+/**
+ * Consumes the current token if it's of `type`
+ * @param type The type to match against
+ * @return Whether the token was consumed
+ */
+static bool match(token_type type) {
+    if (current_type() != type) { return false; }
+
+    advance();
+    return true;
+}
+
 /**
  * Checks if the next token is of `type`, and if it isn't, returns
  * an error with `err` as the message.
@@ -204,7 +382,7 @@ static void advance() {
  * @param err The error to return if the next token is not of `type`
  */
 static void consume(token_type type, const char *err) {
-    if (s_parser.current.type != type) error_at_current(err);
+    if (current_type() != type) error_at_current(err);
 
     return advance();
 }
@@ -216,20 +394,26 @@ static void consume(token_type type, const char *err) {
 static void parse_with_precedence(precedence p) {
     advance();
 
-    parse_fn prefix_rule = get_rule(s_parser.previous.type)->prefix;
+    parse_fn prefix_rule = get_rule(previous_type())->prefix;
 
     if (prefix_rule == NULL) {
         error("Expected an expression.");
         return;
     }
 
+    // only a property access at the lowest precedence can be assigned to
+    bool can_assign = p <= PREC_ASSIGNMENT;
+    s_parser.can_assign = can_assign;
     prefix_rule();
 
-    while (p <= get_rule(s_parser.current.type)->precedence) {
+    while (p <= get_rule(current_type())->precedence) {
         advance();
 
-        get_rule(s_parser.previous.type)->infix();
+        s_parser.can_assign = can_assign;
+        get_rule(previous_type())->infix();
     }
+
+    if (can_assign && match(TOKEN_EQUAL)) { error("Invalid assignment target."); }
 }
 
 /**
@@ -243,8 +427,198 @@ static void expression() {
  * Reads a number and emits it as a constant
  */
 static void number() {
-    double val = strtod(s_parser.previous.tok_start, NULL);
+    int64_t integer;
+
+    // integer literals stay integers, unless they're too big for one
+    if (parse_int(previous_text(), (size_t)previous_len(), &integer)) {
+        // small ones are loaded straight from the instruction
+        if (integer >= INT16_MIN && integer <= INT16_MAX) {
+            emit_op(OP_LOAD_INT);
+            emit_word((uint16_t)integer);
+        } else {
+            emit_constant(int_value(integer));
+        }
+
+        s_parser.type = TYPE_NUMBER;
+        return;
+    }
+
+    double val = parse_number(previous_text(), (size_t)previous_len());
     emit_constant(number_value(val));
+    s_parser.type = TYPE_NUMBER;
+}
+
+/**
+ * Consumes an identifier, which names a slot of the function being compiled or, outside
+ * of a function, one of the inputs
+ */
+static void identifier() {
+    const char *name = previous_text();
+    int len = previous_len();
+    s_parser.type = TYPE_UNKNOWN;
+
+    // function bodies can't see the inputs, there's nothing to load them from
+    if (s_parser.local_count > 0) {
+        for (int i = s_parser.local_count - 1; i >= 0; --i) {
+            if (s_parser.locals[i].len == len && memcmp(s_parser.locals[i].name, name, len) == 0) {
+                emit_instruction(OP_GET_LOCAL, (uint8_t)i);
+                return;
+            }
+        }
+
+        error("Unknown variable.");
+        return;
+    }
+
+    for (size_t i = 0; i < s_parser.input_count; ++i) {
+        const char *input = s_parser.inputs[i];
+
+        if (strncmp(input, name, (size_t)len) == 0 && input[len] == '\0') {
+            emit_instruction(OP_LOAD_INPUT, (uint8_t)i);
+            return;
+        }
+    }
+
+    error("Unknown input.");
+}
+
+/**
+ * Parses a call's argument list, after the opening parenthesis
+ */
+static void call() {
+    int argc = 0;
+
+    if (current_type() != TOKEN_RIGHT_PAREN) {
+        do {
+            expression();
+
+            if (argc == MAX_PARAMS) { error("Can't have more than 255 arguments."); }
+            ++argc;
+        } while (match(TOKEN_COMMA));
+    }
+
+    consume(TOKEN_RIGHT_PAREN, "Expected ')' after arguments.");
+    emit_instruction(OP_CALL, (uint8_t)argc);
+    s_parser.type = TYPE_UNKNOWN;
+}
+
+/**
+ * Emits a property access, with a new inline cache for it
+ * @param op The opcode of the access
+ * @param name The name of the property
+ * @param len The length of the name
+ */
+static void emit_property(op_code op, const char *name, int len) {
+    chunk *c = s_parser.current_chunk;
+    int idx = add_constant(c, object_value((object *)copy_string(name, len)));
+    size_t cache = add_cache(c, (size_t)idx);
+
+    if (cache > UINT16_MAX) { error("Too many property accesses in one chunk."); }
+
+    emit_op(op);
+    emit_word((uint16_t)cache);
+}
+
+/**
+ * Parses a property access, after the dot, or an assignment to one
+ */
+static void dot() {
+    bool can_assign = s_parser.can_assign;
+
+    consume(TOKEN_IDENTIFIER, "Expected property name after '.'.");
+    const char *name = previous_text();
+    int len = previous_len();
+
+    // an assignment's value is the value assigned, so it keeps that one's type
+    if (can_assign && match(TOKEN_EQUAL)) {
+        expression();
+        emit_property(OP_SET_PROPERTY, name, len);
+    } else {
+        emit_property(OP_GET_PROPERTY, name, len);
+        s_parser.type = TYPE_UNKNOWN;
+    }
+}
+
+/**
+ * Parses an instance literal, like `{x = 1, y = 2}`. Instances made by the same literal
+ * get their fields in the same order, so they share a shape.
+ */
+static void instance_literal() {
+    emit_op(OP_INSTANCE);
+
+    if (current_type() != TOKEN_RIGHT_BRACE) {
+        do {
+            consume(TOKEN_IDENTIFIER, "Expected field name.");
+            const char *name = previous_text();
+            int len = previous_len();
+
+            consume(TOKEN_EQUAL, "Expected '=' after field name.");
+            expression();
+            emit_property(OP_DEFINE_PROPERTY, name, len);
+        } while (match(TOKEN_COMMA));
+    }
+
+    consume(TOKEN_RIGHT_BRACE, "Expected '}' after fields.");
+    s_parser.type = TYPE_UNKNOWN;
+}
+
+/**
+ * Parses a function's parameter list
+ * @param declare Whether to add the parameters to `locals`, for compiling the body
+ * @return The number of parameters
+ */
+static int parameters(bool declare) {
+    consume(TOKEN_LEFT_PAREN, "Expected '(' after function name.");
+    int arity = 0;
+
+    if (current_type() != TOKEN_RIGHT_PAREN) {
+        do {
+            consume(TOKEN_IDENTIFIER, "Expected parameter name.");
+
+            if (arity == MAX_PARAMS) {
+                error("Can't have more than 255 parameters.");
+            } else if (declare) {
+                s_parser.locals[arity + 1].name = previous_text();
+                s_parser.locals[arity + 1].len = previous_len();
+                ++s_parser.local_count;
+            }
+
+            ++arity;
+        } while (match(TOKEN_COMMA));
+    }
+
+    consume(TOKEN_RIGHT_PAREN, "Expected ')' after parameters.");
+
+    return arity;
+}
+
+/**
+ * Parses a function literal. Only the parameters are parsed, the body is skipped over
+ * and compiled by `compile_function` when the function is first called.
+ */
+static void function_literal() {
+    string *name = NULL;
+
+    if (match(TOKEN_IDENTIFIER)) { name = copy_string(previous_text(), previous_len()); }
+
+    const char *source = token_text(&s_parser.tokens, s_parser.current);
+    size_t line = s_parser.tokens.line[s_parser.current];
+    int arity = parameters(false);
+
+    consume(TOKEN_LEFT_BRACE, "Expected '{' before function body.");
+
+    // matching braces is all the parsing a body gets until it's called
+    for (int depth = 1; depth > 0; advance()) {
+        switch (current_type()) {
+            case TOKEN_LEFT_BRACE: ++depth; break;
+            case TOKEN_RIGHT_BRACE: --depth; break;
+            case TOKEN_EOF: error_at_current("Expected '}' after function body."); return;
+            default: break;
+        }
+    }
+
+    emit_constant(object_value((object *)new_function(name, arity, source, line)));
+    s_parser.type = TYPE_UNKNOWN;
 }
 
 /**
@@ -252,19 +626,29 @@ static void number() {
  */
 static void string_literal() {
     // copy the string, excluding the quotes
-    string *str = copy_string(s_parser.previous.tok_start + 1, s_parser.previous.len - 2);
+    string *str = copy_string(previous_text() + 1, previous_len() - 2);
 
-    emit_constant(object_value(str));
+    emit_constant(object_value((object *)str));
+    s_parser.type = TYPE_STRING;
 }
 
 /**
  * Consumes a boolean / nil literal
  */
 static void literal() {
-    switch (s_parser.previous.type) {
-        case TOKEN_NIL: emit_byte(OP_NIL); break;
-        case TOKEN_TRUE: emit_byte(OP_TRUE); break;
-        case TOKEN_FALSE: emit_byte(OP_FALSE); break;
+    switch (previous_type()) {
+        case TOKEN_NIL:
+            emit_op(OP_NIL);
+            s_parser.type = TYPE_NIL;
+            break;
+        case TOKEN_TRUE:
+            emit_op(OP_TRUE);
+            s_parser.type = TYPE_BOOL;
+            break;
+        case TOKEN_FALSE:
+            emit_op(OP_FALSE);
+            s_parser.type = TYPE_BOOL;
+            break;
         default: return;
     }
 }
@@ -273,39 +657,192 @@ static void literal() {
  * Parses a unary expression
  */
 static void unary() {
-    token_type prev_type = s_parser.previous.type;
+    token_type prev_type = previous_type();
 
     parse_with_precedence(PREC_UNARY);
 
+    // a negation that didn't fail has a number to show for it, whatever it was given
     switch (prev_type) {
-        case TOKEN_MINUS: emit_byte(OP_NEGATE); break;
-        case TOKEN_BANG: emit_byte(OP_NOT); break;
+        case TOKEN_MINUS:
+            emit_op(s_parser.type == TYPE_NUMBER ? OP_NEGATE_NUM : OP_NEGATE);
+            s_parser.type = TYPE_NUMBER;
+            break;
+        case TOKEN_BANG:
+            emit_op(OP_NOT);
+            s_parser.type = TYPE_BOOL;
+            break;
         default: return;
     }
 }
 
+/**
+ * Checks whether an expression could be a string
+ * @param type The expression's type
+ * @return Whether it could be
+ */
+static inline bool maybe_string(static_type type) {
+    return type == TYPE_STRING || type == TYPE_UNKNOWN;
+}
+
+/**
+ * Works out the type of a `+`. One that didn't fail added numbers, unless it was a
+ * concatenation
+ * @param left The type of the left operand
+ * @param right The type of the right operand
+ * @return The type of the sum
+ */
+static static_type sum_type(static_type left, static_type right) {
+    if (left == TYPE_NUMBER || right == TYPE_NUMBER) { return TYPE_NUMBER; }
+    if (left == TYPE_STRING || right == TYPE_STRING) { return TYPE_STRING; }
+
+    return TYPE_UNKNOWN;
+}
+
+/**
+ * Emits what adds up the operands of a chain of `+` at the top of the stack
+ * @param count The number of operands
+ * @param line The line the last operand ended on, which an OP_ADD after it would be on
+ */
+static void emit_sum(int count, size_t line) {
+    if (count == 2) {
+        write_instruction(s_parser.current_chunk, OP_ADD, 0, line);
+    } else if (count > 2) {
+        write_instruction(s_parser.current_chunk, OP_CONCAT_N, (uint8_t)count, line);
+    }
+}
+
+/**
+ * Checks whether the next operand of a `+` is a lone literal or identifier, which can be
+ * loaded without failing or changing anything. Only tokens already scanned are looked at.
+ * @return Whether it is
+ */
+static bool simple_operand() {
+    size_t next = s_parser.current + 1;
+    if (next >= s_parser.tokens.count) { return false; }
+
+    switch (current_type()) {
+        case TOKEN_NUMBER:
+        case TOKEN_STRING:
+        case TOKEN_IDENTIFIER:
+        case TOKEN_TRUE:
+        case TOKEN_FALSE:
+        case TOKEN_NIL: break;
+        default: return false;
+    }
+
+    // a token that binds tighter than `+` would make it part of a bigger operand
+    return get_rule(s_parser.tokens.type[next])->precedence <= PREC_TERM;
+}
+
+/**
+ * Parses a chain of `+` whose left operand could be a string. Its operands are added up
+ * by one OP_CONCAT_N rather than an OP_ADD each, so strings are copied once instead of
+ * once for every `+` after them, and anything else is added from the left like OP_ADD
+ * would. Every operand is on the stack before the first add runs, so from the third on
+ * only simple operands join the chain, on the line the adds would be reported on: they
+ * can't fail or change anything, and nothing can tell they were loaded early. The chain
+ * ends where the sum is known to be a number, and the rest of the `+` use OP_ADD_NUM.
+ * @param left The type of the left operand, which has been compiled
+ */
+static void concatenation(static_type left) {
+    static_type type = left;
+    int count = 1;
+    size_t line = 0;
+
+    do {
+        if (count > 1 && (!simple_operand() || s_parser.tokens.line[s_parser.current] != line)) {
+            emit_sum(count, line);
+            count = 1;
+        }
+
+        parse_with_precedence((precedence)(PREC_TERM + 1));
+        type = sum_type(type, s_parser.type);
+        line = previous_line();
+
+        if (++count == MAX_CONCAT_OPERANDS) {
+            emit_sum(count, line);
+            count = 1;
+        }
+    } while (maybe_string(type) && match(TOKEN_PLUS));
+
+    emit_sum(count, line);
+    s_parser.type = type;
+}
+
 /**
  * Parses a binary expression
  */
 static void binary() {
-    token_type op_type = s_parser.previous.type;
+    token_type op_type = previous_type();
+    static_type left = s_parser.type;
+
+    if (op_type == TOKEN_PLUS && maybe_string(left)) {
+        concatenation(left);
+        return;
+    }
 
     parse_rule *r = get_rule(op_type);
     parse_with_precedence((precedence)(r->precedence + 1));
 
+    static_type right = s_parser.type;
+    bool numbers = left == TYPE_NUMBER && right == TYPE_NUMBER;
+
     switch (op_type) {
-        case TOKEN_PLUS: emit_byte(OP_ADD); break;
-        case TOKEN_MINUS: emit_byte(OP_SUBTRACT); break;
-        case TOKEN_STAR: emit_byte(OP_MULTIPLY); break;
-        case TOKEN_SLASH: emit_byte(OP_DIVIDE); break;
-        case TOKEN_EQUAL_EQUAL: emit_byte(OP_EQUAL); break;
-        case TOKEN_BANG_EQUAL: emit_bytes(2, OP_EQUAL, OP_NOT); break;
-        case TOKEN_GREATER: emit_byte(OP_GREATER); break;
-        case TOKEN_GREATER_EQUAL: emit_bytes(2, OP_LESS, OP_NOT); break;
-        case TOKEN_LESS: emit_byte(OP_LESS); break;
-        case TOKEN_LESS_EQUAL: emit_bytes(2, OP_GREATER, OP_NOT); break;
+        case TOKEN_PLUS: emit_op(numbers ? OP_ADD_NUM : OP_ADD); break;
+        case TOKEN_MINUS: emit_op(numbers ? OP_SUBTRACT_NUM : OP_SUBTRACT); break;
+        case TOKEN_STAR: emit_op(numbers ? OP_MULTIPLY_NUM : OP_MULTIPLY); break;
+        case TOKEN_SLASH: emit_op(numbers ? OP_DIVIDE_NUM : OP_DIVIDE); break;
+        case TOKEN_EQUAL_EQUAL: emit_op(OP_EQUAL); break;
+        case TOKEN_BANG_EQUAL: emit_ops(2, OP_EQUAL, OP_NOT); break;
+        case TOKEN_GREATER: emit_op(numbers ? OP_GREATER_NUM : OP_GREATER); break;
+        case TOKEN_GREATER_EQUAL: emit_ops(2, numbers ? OP_LESS_NUM : OP_LESS, OP_NOT); break;
+        case TOKEN_LESS: emit_op(numbers ? OP_LESS_NUM : OP_LESS); break;
+        case TOKEN_LESS_EQUAL: emit_ops(2, numbers ? OP_GREATER_NUM : OP_GREATER, OP_NOT); break;
         default: break;
     }
+
+    // arithmetic that didn't fail was done on numbers
+    switch (op_type) {
+        case TOKEN_PLUS: s_parser.type = sum_type(left, right); break;
+        case TOKEN_MINUS:
+        case TOKEN_STAR:
+        case TOKEN_SLASH: s_parser.type = TYPE_NUMBER; break;
+        default: s_parser.type = TYPE_BOOL; break;
+    }
+}
+
+/**
+ * Parses the right operand of an `and`, which is skipped if the left one is falsey
+ */
+static void and_() {
+    static_type left = s_parser.type;
+    size_t end = emit_jump(OP_JUMP_IF_FALSE);
+
+    emit_op(OP_POP);
+    parse_with_precedence(PREC_AND);
+
+    patch_jump(end);
+
+    // the value is either operand
+    if (s_parser.type != left) { s_parser.type = TYPE_UNKNOWN; }
+}
+
+/**
+ * Parses the right operand of an `or`, which is skipped if the left one is truthy
+ */
+static void or_() {
+    static_type left = s_parser.type;
+    size_t right = emit_jump(OP_JUMP_IF_FALSE);
+    size_t end = emit_jump(OP_JUMP);
+
+    patch_jump(right);
+    emit_op(OP_POP);
+    parse_with_precedence(PREC_OR);
+
+    patch_jump(end);
+
+    // the value is either operand
+    if (s_parser.type != left) { s_parser.type = TYPE_UNKNOWN; }
 }
 
 /**
@@ -317,17 +854,59 @@ static void grouping() {
 }
 
 bool compile(const char *source, chunk *c) {
-    init_scanner(source);
+    return compile_with_inputs(source, c, NULL, 0);
+}
+
+/**
+ * Gets the parser ready to compile a source into a chunk
+ * @param source Where to start scanning
+ * @param line The line `source` is on
+ * @param c The chunk to write to
+ */
+static void begin_compile(const char *source, size_t line, chunk *c) {
+    init_scanner_at(source, line);
 
     s_parser.had_err = false;
     s_parser.panic = false;
     s_parser.current_chunk = c;
+    s_parser.inputs = NULL;
+    s_parser.input_count = 0;
+    s_parser.local_count = 0;
+    s_parser.type = TYPE_UNKNOWN;
+
+    // start with a lone placeholder token so the first `advance()` refills the batch
+    s_parser.tokens.count = 1;
+    s_parser.tokens.type[0] = TOKEN_EOF;
+    s_parser.tokens.line[0] = (uint32_t)line;
+    s_parser.current = 0;
 
     advance();
+}
+
+bool compile_with_inputs(const char *source, chunk *c, const char *const *inputs,
+                         size_t input_count) {
+    if (input_count > MAX_INPUTS) {
+        fprintf(stderr, "Too many inputs, the most an expression can have is %d.\n", MAX_INPUTS);
+        return false;
+    }
+
+    CLOX_PROBE1(compile__start, source);
+    begin_compile(source, 1, c);
+
+    s_parser.inputs = inputs;
+    s_parser.input_count = input_count;
+
     expression();
     consume(TOKEN_EOF, "Expected end of expression");
 
-    emit_byte(OP_RETURN);
+    emit_op(OP_RETURN);
+    c->input_count = input_count;
+
+    if (!s_parser.had_err) {
+        bool verified = verify_chunk(c, 0);
+        assert(verified && "The compiler should only write chunks that verify");
+        (void)verified;
+    }
 
 #ifdef DEBUG_PRINT_CODE
     if (!s_parser.had_err) {
@@ -335,5 +914,43 @@ bool compile(const char *source, chunk *c) {
     }
 #endif
 
+    CLOX_PROBE2(compile__done, (int)!s_parser.had_err, c->size);
+
     return !s_parser.had_err;
-}
\ No newline at end of file
+}
+
+bool compile_function(function *fn) {
+    begin_compile(fn->source, fn->line, &fn->chunk);
+
+    // slot 0 holds the function itself, so it can call itself by name
+    s_parser.locals[0].name = fn->name != NULL ? fn->name->chars : "";
+    s_parser.locals[0].len = fn->name != NULL ? fn->name->len : 0;
+    s_parser.local_count = 1;
+
+    parameters(true);
+    consume(TOKEN_LEFT_BRACE, "Expected '{' before function body.");
+    expression();
+    consume(TOKEN_RIGHT_BRACE, "Expected '}' after function body.");
+
+    emit_op(OP_RETURN);
+    s_parser.local_count = 0;
+
+    if (s_parser.had_err) {
+        free_chunk(&fn->chunk);
+        fn->source = NULL;
+        return false;
+    }
+
+    // sized once here, so calls only have to compare it against the space left
+    bool verified = verify_chunk(&fn->chunk, (size_t)fn->arity + 1);
+    assert(verified && "The compiler should only write chunks that verify");
+    (void)verified;
+
+#ifdef DEBUG_PRINT_CODE
+    disassemble_chunk(&fn->chunk, fn->name != NULL ? fn->name->chars : "<fn>");
+#endif
+
+    fn->compiled = true;
+
+    return true;
+}
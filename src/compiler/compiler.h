@@ -1,6 +1,13 @@
 #pragma once
 
 #include "../vm/chunk.h"
+#include "../vm/object.h"
+
+/** Most inputs an expression can refer to, OP_LOAD_INPUT's operand is one byte */
+#define MAX_INPUTS 256
+
+/** Most parameters a function can take, OP_CALL's operand is one byte */
+#define MAX_PARAMS 255
 
 /**
  * Compiles the source code into bytecode
@@ -8,4 +15,25 @@
  * @param chunk The chunk to write data to
  * @return Whether or not the compilation was successful
  */
-bool compile(const char *source, chunk *chunk);
\ No newline at end of file
+bool compile(const char *source, chunk *chunk);
+
+/**
+ * Compiles source code whose identifiers refer to inputs, which `OP_LOAD_INPUT`
+ * loads by index when the chunk runs
+ * @param source The Lox source code
+ * @param chunk The chunk to write data to
+ * @param inputs Names of the inputs, may be NULL if `input_count` is 0
+ * @param input_count Number of inputs, at most MAX_INPUTS
+ * @return Whether or not the compilation was successful
+ */
+bool compile_with_inputs(const char *source, chunk *chunk, const char *const *inputs,
+                         size_t input_count);
+
+/**
+ * Compiles the body of a function the compiler skipped over, so it can be called. The
+ * body can only refer to the function's parameters and its own name.
+ * @param fn The function, which must not be compiled yet
+ * @return Whether or not the compilation was successful. If not, the error has been
+ * reported and `fn->source` is set to NULL so it isn't compiled again
+ */
+bool compile_function(function *fn);
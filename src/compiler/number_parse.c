@@ -0,0 +1,199 @@
+#include "number_parse.h"
+#include "pow5_table.h"
+#include <stdlib.h>
+#include <string.h>
+
+/** Largest integer that every smaller integer can be exactly represented as a double */
+#define MAX_EXACT_INT (UINT64_C(1) << 53)
+
+/** Most significant digits that are guaranteed to fit in a uint64_t */
+#define MAX_DIGITS 19
+
+/** Powers of ten that are exactly representable as doubles */
+static const double s_exact_pow10[] = {
+    1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+};
+
+/**
+ * Reinterprets the bits of an IEEE-754 binary64 as a double
+ * @param bits The bits
+ * @return The double
+ */
+static inline double from_bits(uint64_t bits) {
+    double d;
+    memcpy(&d, &bits, sizeof(d));
+
+    return d;
+}
+
+/**
+ * Eisel-Lemire: computes the double closest to `w * 10^q` with a 128-bit
+ * approximation of 10^q, and detects the rare cases where that approximation isn't
+ * precise enough to decide the rounding.
+ * @param w The decimal significand, nonzero
+ * @param q The decimal exponent
+ * @param out Set to the result on success
+ * @return False if the result couldn't be decided and the slow path is needed
+ */
+static bool eisel_lemire(uint64_t w, int q, double *out) {
+    if (q < POW5_128_MIN) {
+        *out = 0.0;
+        return true;
+    }
+
+    if (q > POW5_128_MAX) {
+        *out = from_bits(UINT64_C(0x7FF0000000000000));
+        return true;
+    }
+
+    const uint64_t *pow5 = g_pow5_128[q - POW5_128_MIN];
+
+    // normalize so the top bit of `w` is set
+    int lz = __builtin_clzll(w);
+    w <<= lz;
+
+    unsigned __int128 first = (unsigned __int128)w * pow5[0];
+    uint64_t upper = (uint64_t)(first >> 64);
+    uint64_t lower = (uint64_t)first;
+
+    // the low 9 bits of `upper` are all ones, so the truncated part of 10^q could
+    // carry into the bits that decide the result. Bring in the low half of 10^q.
+    if ((upper & 0x1FF) == 0x1FF && lower + w < lower) {
+        unsigned __int128 second = (unsigned __int128)w * pow5[1];
+        uint64_t second_low = (uint64_t)second;
+        uint64_t middle = lower + (uint64_t)(second >> 64);
+
+        if (middle < lower) { ++upper; }
+
+        if (middle + 1 == 0 && (upper & 0x1FF) == 0x1FF && second_low + w < second_low) {
+            return false;
+        }
+
+        lower = middle;
+    }
+
+    uint64_t upper_bit = upper >> 63;
+    uint64_t mantissa = upper >> (upper_bit + 9);
+    lz += (int)(1 ^ upper_bit);
+
+    // possibly exactly halfway between two doubles, which can't be told apart from here
+    if (lower == 0 && (upper & 0x1FF) == 0 && (mantissa & 3) == 1) { return false; }
+
+    mantissa += mantissa & 1;
+    mantissa >>= 1;
+
+    if (mantissa >= (UINT64_C(1) << 53)) {
+        // rounding overflowed into the next binade
+        mantissa = UINT64_C(1) << 52;
+        --lz;
+    }
+
+    mantissa &= ~(UINT64_C(1) << 52);
+
+    // floor(log2(10^q)) + the exponent bias + the 63 bits `w` was shifted into
+    int64_t exponent = (((152170 + 65536) * (int64_t)q) >> 16) + 1024 + 63 - lz;
+
+    // subnormals and overflow are left to the slow path
+    if (exponent < 1 || exponent > 2046) { return false; }
+
+    *out = from_bits(mantissa | ((uint64_t)exponent << 52));
+    return true;
+}
+
+/**
+ * The slow path, for literals with too many significant digits and the rare
+ * cases Eisel-Lemire can't decide
+ * @param digits Pointer to the literal
+ * @param len Length of the literal
+ * @return The value of the literal
+ */
+static double parse_number_slow(const char *digits, size_t len) {
+    // the literal isn't NUL-terminated, and strtod would happily read past it
+    char small[64];
+    char *buf = len < sizeof(small) ? small : malloc(len + 1);
+
+    memcpy(buf, digits, len);
+    buf[len] = '\0';
+
+    double val = strtod(buf, NULL);
+
+    if (buf != small) { free(buf); }
+
+    return val;
+}
+
+double parse_number(const char *digits, size_t len) {
+    const char *end = digits + len;
+
+    // trailing zeros of a fraction don't change its value, so `1.50` is parsed as `1.5`
+    // and `2.0` takes the integer fast path
+    if (memchr(digits, '.', len) != NULL) {
+        while (end[-1] == '0') {
+            --end;
+        }
+
+        if (end[-1] == '.') { --end; }
+
+        len = (size_t)(end - digits);
+    }
+
+    const char *p = digits;
+    uint64_t w = 0;
+
+    // integer fast path, the common case for literals like `1` and `1024`
+    while (p != end && *p != '.') {
+        w = w * 10 + (uint64_t)(*p++ - '0');
+    }
+
+    if (p == end && len <= MAX_DIGITS && w <= MAX_EXACT_INT) { return (double)w; }
+
+    // leading zeros of the significand don't count towards its digits
+    size_t significant = 0;
+
+    for (const char *c = digits; c != end; ++c) {
+        if (*c == '.') { continue; }
+        if (significant != 0 || *c != '0') { ++significant; }
+    }
+
+    if (significant > MAX_DIGITS) { return parse_number_slow(digits, len); }
+
+    int q = 0;
+
+    if (p != end) {
+        for (++p; p != end; ++p) {
+            w = w * 10 + (uint64_t)(*p - '0');
+            --q;
+        }
+    }
+
+    if (w == 0) { return 0.0; }
+
+    // Clinger's fast path: both `w` and 10^q are exact doubles, so one correctly
+    // rounded multiply or divide gives the correctly rounded result
+    if (w <= MAX_EXACT_INT && q >= -22 && q <= 22) {
+        return q < 0 ? (double)w / s_exact_pow10[-q] : (double)w * s_exact_pow10[q];
+    }
+
+    double val;
+    if (eisel_lemire(w, q, &val)) { return val; }
+
+    return parse_number_slow(digits, len);
+}
+
+bool parse_int(const char *digits, size_t len, int64_t *out) {
+    uint64_t n = 0;
+
+    for (size_t i = 0; i < len; ++i) {
+        if (digits[i] == '.') { return false; }
+
+        unsigned digit = (unsigned)(digits[i] - '0');
+        if (n > (uint64_t)(INT64_MAX - digit) / 10) { return false; }
+
+        n = n * 10 + digit;
+    }
+
+    *out = (int64_t)n;
+
+    return true;
+}
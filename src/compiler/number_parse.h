@@ -0,0 +1,25 @@
+#pragma once
+
+#include "../common/common.h"
+
+/**
+ * Converts a number literal to the closest double, rounding ties to even exactly like
+ * a correctly-rounded `strtod` in the "C" locale.
+ *
+ * The literal must already have been validated by the scanner, meaning it matches
+ * [0-9]+(\.[0-9]+)?. It doesn't need to be NUL-terminated.
+ *
+ * @param digits Pointer to the first character of the literal
+ * @param len The number of characters in the literal
+ * @return The value of the literal
+ */
+double parse_number(const char *digits, size_t len);
+
+/**
+ * Converts an integer literal to an int64_t
+ * @param digits Pointer to the first character of a literal validated by the scanner
+ * @param len The number of characters in the literal
+ * @param out Set to the value of the literal on success
+ * @return False if the literal has a fraction or doesn't fit in an int64_t
+ */
+bool parse_int(const char *digits, size_t len, int64_t *out);
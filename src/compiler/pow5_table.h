@@ -0,0 +1,15 @@
+#pragma once
+
+#include <stdint.h>
+
+/** The smallest power of five in `g_pow5_128` */
+#define POW5_128_MIN (-342)
+
+/** The largest power of five in `g_pow5_128` */
+#define POW5_128_MAX 308
+
+/**
+ * Normalized 128-bit approximations of 5^q for q in [POW5_128_MIN, POW5_128_MAX],
+ * stored as { high 64 bits, low 64 bits }
+ */
+extern const uint64_t g_pow5_128[POW5_128_MAX - POW5_128_MIN + 1][2];
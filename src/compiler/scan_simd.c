@@ -0,0 +1,317 @@
+#include "scan_simd.h"
+#include "../common/cpu.h"
+#include <stdint.h>
+
+#if CPU_HAS_X86
+#include <immintrin.h>
+#endif
+
+// The vector kernels below only ever issue *aligned* loads. An aligned load can never
+// straddle a page boundary, so reading the rest of the block that holds the NUL
+// terminator can't fault even though those bytes are past the end of the source.
+// Bytes before the starting pointer are masked out of the first block. AddressSanitizer
+// can't know that, so the kernels opt out of its instrumentation.
+
+/**
+ * Checks if a character is whitespace the scanner skips
+ * @param c The char to check
+ * @return Whether the char is ' ', '\t', '\r' or '\n'
+ */
+static inline bool is_space(char c) {
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+/**
+ * Checks if a character can appear after the first character of an identifier
+ * @param c The char to check
+ * @return Whether it matches [a-zA-Z0-9_]
+ */
+static inline bool is_ident(char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') ||
+           c == '_';
+}
+
+static const char *skip_whitespace_scalar(const char *p, size_t *lines) {
+    for (; is_space(*p); ++p) {
+        if (*p == '\n') { ++*lines; }
+    }
+
+    return p;
+}
+
+static const char *skip_line_scalar(const char *p) {
+    while (*p != '\n' && *p != '\0') {
+        ++p;
+    }
+
+    return p;
+}
+
+static const char *skip_string_scalar(const char *p) {
+    while (*p != '"' && *p != '\n' && *p != '\0') {
+        ++p;
+    }
+
+    return p;
+}
+
+static const char *skip_identifier_scalar(const char *p) {
+    while (is_ident(*p)) {
+        ++p;
+    }
+
+    return p;
+}
+
+#if CPU_HAS_X86
+
+#define NO_ASAN __attribute__((no_sanitize_address))
+
+/**
+ * Generates a kernel that returns a pointer to the first byte whose bit is set in
+ * `classify(block)`. The first block is masked so bytes before `p` are ignored.
+ */
+#define DEFINE_FIND_KERNEL(name, attr, vec, width, load, classify)                                 \
+    attr static const char *name(const char *p) {                                                  \
+        size_t skew = (uintptr_t)p & ((width)-1);                                                  \
+        const vec *block = (const vec *)(p - skew);                                                \
+        uint32_t valid = UINT32_MAX << skew;                                                       \
+                                                                                                   \
+        while (true) {                                                                             \
+            uint32_t stop = classify(load(block)) & valid;                                         \
+            if (stop != 0) { return (const char *)block + __builtin_ctz(stop); }                   \
+                                                                                                   \
+            valid = UINT32_MAX;                                                                    \
+            ++block;                                                                               \
+        }                                                                                          \
+    }
+
+/**
+ * Generates a whitespace kernel, which has to count the newlines in every block it
+ * skips past so that the scanner's line counter stays correct
+ */
+#define DEFINE_WHITESPACE_KERNEL(name, attr, vec, width, load, space, newline)                     \
+    attr static const char *name(const char *p, size_t *lines) {                                   \
+        if (!is_space(*p)) { return p; }                                                           \
+                                                                                                   \
+        size_t skew = (uintptr_t)p & ((width)-1);                                                  \
+        const vec *block = (const vec *)(p - skew);                                                \
+        uint32_t valid = UINT32_MAX << skew;                                                       \
+                                                                                                   \
+        while (true) {                                                                             \
+            vec v = load(block);                                                                   \
+            uint32_t stop = ~space(v) & valid;                                                     \
+            uint32_t nl = newline(v) & valid;                                                      \
+                                                                                                   \
+            if (stop != 0) {                                                                       \
+                uint32_t idx = __builtin_ctz(stop);                                                \
+                *lines += __builtin_popcount(nl & ((1u << idx) - 1));                              \
+                return (const char *)block + idx;                                                  \
+            }                                                                                      \
+                                                                                                   \
+            *lines += __builtin_popcount(nl);                                                      \
+            valid = UINT32_MAX;                                                                    \
+            ++block;                                                                               \
+        }                                                                                          \
+    }
+
+// SSE2 is part of the x86-64 baseline, so these need no target attribute
+
+NO_ASAN static inline __m128i load_sse2(const __m128i *block) {
+    return _mm_load_si128(block);
+}
+
+static inline uint32_t newline_sse2(__m128i v) {
+    return (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8('\n')));
+}
+
+static inline uint32_t space_sse2(__m128i v) {
+    __m128i sp = _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')),
+                              _mm_cmpeq_epi8(v, _mm_set1_epi8('\t')));
+    __m128i lf = _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\r')),
+                              _mm_cmpeq_epi8(v, _mm_set1_epi8('\n')));
+
+    // only the low 16 bits are meaningful, the high bits are cleared so `~` works
+    return (uint32_t)_mm_movemask_epi8(_mm_or_si128(sp, lf)) | 0xFFFF0000u;
+}
+
+static inline uint32_t line_end_sse2(__m128i v) {
+    __m128i stop = _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\n')),
+                                _mm_cmpeq_epi8(v, _mm_setzero_si128()));
+
+    return (uint32_t)_mm_movemask_epi8(stop);
+}
+
+static inline uint32_t string_end_sse2(__m128i v) {
+    __m128i stop = _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('"')),
+                                _mm_cmpeq_epi8(v, _mm_set1_epi8('\n')));
+    stop = _mm_or_si128(stop, _mm_cmpeq_epi8(v, _mm_setzero_si128()));
+
+    return (uint32_t)_mm_movemask_epi8(stop);
+}
+
+static inline uint32_t not_ident_sse2(__m128i v) {
+    // comparisons are signed, so bytes >= 0x80 are negative and fall out of every range
+    __m128i lower = _mm_or_si128(v, _mm_set1_epi8(0x20));
+    __m128i alpha = _mm_and_si128(_mm_cmpgt_epi8(lower, _mm_set1_epi8('a' - 1)),
+                                  _mm_cmpgt_epi8(_mm_set1_epi8('z' + 1), lower));
+    __m128i digit = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('0' - 1)),
+                                  _mm_cmpgt_epi8(_mm_set1_epi8('9' + 1), v));
+    __m128i under = _mm_cmpeq_epi8(v, _mm_set1_epi8('_'));
+    __m128i ident = _mm_or_si128(_mm_or_si128(alpha, digit), under);
+
+    return (uint32_t)_mm_movemask_epi8(ident) ^ 0xFFFFu;
+}
+
+DEFINE_WHITESPACE_KERNEL(skip_whitespace_sse2, NO_ASAN, __m128i, 16, load_sse2, space_sse2,
+                         newline_sse2)
+DEFINE_FIND_KERNEL(skip_line_sse2, NO_ASAN, __m128i, 16, load_sse2, line_end_sse2)
+DEFINE_FIND_KERNEL(skip_string_sse2, NO_ASAN, __m128i, 16, load_sse2, string_end_sse2)
+DEFINE_FIND_KERNEL(skip_identifier_sse2, NO_ASAN, __m128i, 16, load_sse2, not_ident_sse2)
+
+#define AVX2 __attribute__((target("avx2")))
+
+NO_ASAN AVX2 static inline __m256i load_avx2(const __m256i *block) {
+    return _mm256_load_si256(block);
+}
+
+AVX2 static inline uint32_t newline_avx2(__m256i v) {
+    return (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n')));
+}
+
+AVX2 static inline uint32_t space_avx2(__m256i v) {
+    __m256i sp = _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')),
+                                 _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\t')));
+    __m256i lf = _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\r')),
+                                 _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n')));
+
+    return (uint32_t)_mm256_movemask_epi8(_mm256_or_si256(sp, lf));
+}
+
+AVX2 static inline uint32_t line_end_avx2(__m256i v) {
+    __m256i stop = _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n')),
+                                   _mm256_cmpeq_epi8(v, _mm256_setzero_si256()));
+
+    return (uint32_t)_mm256_movemask_epi8(stop);
+}
+
+AVX2 static inline uint32_t string_end_avx2(__m256i v) {
+    __m256i stop = _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('"')),
+                                   _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n')));
+    stop = _mm256_or_si256(stop, _mm256_cmpeq_epi8(v, _mm256_setzero_si256()));
+
+    return (uint32_t)_mm256_movemask_epi8(stop);
+}
+
+AVX2 static inline uint32_t not_ident_avx2(__m256i v) {
+    __m256i lower = _mm256_or_si256(v, _mm256_set1_epi8(0x20));
+    __m256i alpha = _mm256_and_si256(_mm256_cmpgt_epi8(lower, _mm256_set1_epi8('a' - 1)),
+                                     _mm256_cmpgt_epi8(_mm256_set1_epi8('z' + 1), lower));
+    __m256i digit = _mm256_and_si256(_mm256_cmpgt_epi8(v, _mm256_set1_epi8('0' - 1)),
+                                     _mm256_cmpgt_epi8(_mm256_set1_epi8('9' + 1), v));
+    __m256i under = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('_'));
+    __m256i ident = _mm256_or_si256(_mm256_or_si256(alpha, digit), under);
+
+    return ~(uint32_t)_mm256_movemask_epi8(ident);
+}
+
+DEFINE_WHITESPACE_KERNEL(skip_whitespace_avx2, NO_ASAN AVX2, __m256i, 32, load_avx2, space_avx2,
+                         newline_avx2)
+DEFINE_FIND_KERNEL(skip_line_avx2, NO_ASAN AVX2, __m256i, 32, load_avx2, line_end_avx2)
+DEFINE_FIND_KERNEL(skip_string_avx2, NO_ASAN AVX2, __m256i, 32, load_avx2, string_end_avx2)
+DEFINE_FIND_KERNEL(skip_identifier_avx2, NO_ASAN AVX2, __m256i, 32, load_avx2, not_ident_avx2)
+
+#undef AVX2
+#undef NO_ASAN
+
+#endif
+
+static const scan_kernels s_scalar_kernels = {
+    skip_whitespace_scalar,
+    skip_line_scalar,
+    skip_string_scalar,
+    skip_identifier_scalar,
+};
+
+scan_kernels g_scan_kernels = {
+    skip_whitespace_scalar,
+    skip_line_scalar,
+    skip_string_scalar,
+    skip_identifier_scalar,
+};
+
+static scan_isa s_active_isa = SCAN_ISA_SCALAR;
+
+/** The best instruction set the CPU supports, or -1 if the CPU hasn't been queried */
+static int s_best_isa = -1;
+
+/**
+ * Queries the CPU for the best instruction set it supports
+ * @return The best supported instruction set
+ */
+static scan_isa best_isa() {
+    if (s_best_isa < 0) {
+#if CPU_HAS_X86
+        s_best_isa = cpu_has_avx2() ? SCAN_ISA_AVX2 : SCAN_ISA_SSE2;
+#else
+        s_best_isa = SCAN_ISA_SCALAR;
+#endif
+    }
+
+    return (scan_isa)s_best_isa;
+}
+
+void init_scan_kernels() {
+    if (s_best_isa < 0) { select_scan_isa(best_isa()); }
+}
+
+bool select_scan_isa(scan_isa isa) {
+    if (isa > best_isa()) { return false; }
+
+    switch (isa) {
+        case SCAN_ISA_SCALAR: g_scan_kernels = s_scalar_kernels; break;
+#if CPU_HAS_X86
+        case SCAN_ISA_SSE2: {
+            scan_kernels sse2 = {
+                skip_whitespace_sse2,
+                skip_line_sse2,
+                skip_string_sse2,
+                skip_identifier_sse2,
+            };
+
+            g_scan_kernels = sse2;
+            break;
+        }
+        case SCAN_ISA_AVX2: {
+            scan_kernels avx2 = {
+                skip_whitespace_avx2,
+                skip_line_avx2,
+                skip_string_avx2,
+                skip_identifier_avx2,
+            };
+
+            g_scan_kernels = avx2;
+            break;
+        }
+#else
+        default: return false;
+#endif
+    }
+
+    s_active_isa = isa;
+    return true;
+}
+
+scan_isa active_scan_isa() {
+    return s_active_isa;
+}
+
+const char *scan_isa_name(scan_isa isa) {
+    switch (isa) {
+        case SCAN_ISA_SCALAR: return "scalar";
+        case SCAN_ISA_SSE2: return "sse2";
+        case SCAN_ISA_AVX2: return "avx2";
+    }
+
+    return "unknown";
+}
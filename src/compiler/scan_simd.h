@@ -0,0 +1,73 @@
+#pragma once
+
+#include "../common/common.h"
+
+/** The instruction set the scanner's bulk kernels are running on */
+typedef enum scan_isa { SCAN_ISA_SCALAR, SCAN_ISA_SSE2, SCAN_ISA_AVX2 } scan_isa;
+
+/**
+ * Table of the bulk-skipping kernels used by the scanner.
+ *
+ * Every kernel takes a pointer into a NUL-terminated source buffer and returns a
+ * pointer to the first character that stops the skip. The NUL terminator always
+ * stops a skip, so none of the kernels can run off the end of the source.
+ */
+typedef struct scan_kernels {
+    /**
+     * Skips a run of ' ', '\t', '\r' and '\n'
+     * @param p Where to start skipping
+     * @param lines Incremented once for every '\n' that was skipped
+     * @return Pointer to the first non-whitespace character
+     */
+    const char *(*skip_whitespace)(const char *p, size_t *lines);
+
+    /**
+     * Skips to the end of a line, used for `//` comments
+     * @param p Where to start skipping
+     * @return Pointer to the first '\n' or NUL
+     */
+    const char *(*skip_line)(const char *p);
+
+    /**
+     * Skips the body of a string literal
+     * @param p Where to start skipping
+     * @return Pointer to the first '"', '\n' or NUL
+     */
+    const char *(*skip_string)(const char *p);
+
+    /**
+     * Skips the characters of an identifier
+     * @param p Where to start skipping
+     * @return Pointer to the first character that doesn't match [a-zA-Z0-9_]
+     */
+    const char *(*skip_identifier)(const char *p);
+} scan_kernels;
+
+/** The kernels currently in use */
+extern scan_kernels g_scan_kernels;
+
+/**
+ * Picks the best kernels the running CPU supports. Safe to call more than once,
+ * the CPU is only queried the first time.
+ */
+void init_scan_kernels();
+
+/**
+ * Forces the scanner onto a specific instruction set
+ * @param isa The instruction set to use
+ * @return False (and no change) if the CPU doesn't support `isa`
+ */
+bool select_scan_isa(scan_isa isa);
+
+/**
+ * Gets the instruction set the scanner kernels are currently using
+ * @return The active instruction set
+ */
+scan_isa active_scan_isa();
+
+/**
+ * Gets a printable name for an instruction set
+ * @param isa The instruction set
+ * @return The name of the instruction set
+ */
+const char *scan_isa_name(scan_isa isa);
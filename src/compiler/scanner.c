@@ -1,5 +1,6 @@
 #include "scanner.h"
 #include "../common/common.h"
+#include "scan_simd.h"
 #include <stdio.h>
 #include <string.h>
 
@@ -12,11 +13,56 @@ typedef struct scanner {
 
     /** The current line the scanner is on */
     size_t line;
+
+    /** The start of the source being scanned, token offsets are relative to this */
+    const char *source;
+
+    /** Index into `s_error_messages` of the last error token made */
+    uint32_t error;
 } scanner;
 
-static const char *current;
 static scanner s_scanner;
 
+/** Every message an error token can carry */
+static const char *const s_error_messages[] = {
+    "Unterminated string.",
+    "Unexpected character.",
+    "Source is too large.",
+};
+
+/** An index into `s_error_messages` */
+typedef enum scan_error { ERR_UNTERMINATED_STRING, ERR_UNEXPECTED_CHAR, ERR_TOO_LARGE } scan_error;
+
+/** A keyword and the token type it scans as */
+typedef struct keyword {
+    const char *name;
+    uint32_t len;
+    token_type type;
+} keyword;
+
+/**
+ * Perfect hash table of the keywords, see `keyword_hash`. Every keyword lands in its
+ * own slot, so a lookup is one hash and at most one compare.
+ */
+static const keyword s_keywords[32] = {
+    [0] = {"false", 5, TOKEN_FALSE},
+    [8] = {"for", 3, TOKEN_FOR},
+    [10] = {"true", 4, TOKEN_TRUE},
+    [12] = {"this", 4, TOKEN_THIS},
+    [16] = {"super", 5, TOKEN_SUPER},
+    [17] = {"and", 3, TOKEN_AND},
+    [20] = {"or", 2, TOKEN_OR},
+    [21] = {"class", 5, TOKEN_CLASS},
+    [22] = {"nil", 3, TOKEN_NIL},
+    [24] = {"if", 2, TOKEN_IF},
+    [25] = {"while", 5, TOKEN_WHILE},
+    [26] = {"fun", 3, TOKEN_FUN},
+    [27] = {"print", 5, TOKEN_PRINT},
+    [28] = {"else", 4, TOKEN_ELSE},
+    [29] = {"return", 6, TOKEN_RETURN},
+    [30] = {"var", 3, TOKEN_VAR},
+};
+
 /**
  * Consumes and returns a character
  * @return The consumed character
@@ -99,10 +145,13 @@ static inline token make_tok(token_type type) {
 
 /**
  * Makes an "error" token using the message passed
- * @param message The error message
+ * @param err The error to report
  * @return A token object
  */
-static inline token error_token(const char *message) {
+static inline token error_token(scan_error err) {
+    const char *message = s_error_messages[err];
+    s_scanner.error = err;
+
     token tok = {
         .type = TOKEN_ERROR,
         .line = s_scanner.line,
@@ -114,18 +163,15 @@ static inline token error_token(const char *message) {
 }
 
 /**
- * Checks if the rest of an identifier is equal to a keyword
- * @param start Position of second character
- * @param len Length of the identifier
- * @param rest Pointer to the string to compare to
- * @param type Type to return if they are equal
- * @return type if the identifier IS the keyword, TOKEN_IDENTIFIER otherwise
+ * Hashes an identifier into `s_keywords`. The multipliers were searched for so that
+ * no two keywords collide.
+ * @param len Length of the identifier, at least 2
+ * @return The slot the identifier would be in if it were a keyword
  */
-static inline token_type check_keyword(int start, int len, const char *rest, token_type type) {
-    return s_scanner.current - s_scanner.start == start + len &&
-                   memcmp(s_scanner.start + start, rest, len) == 0
-               ? type
-               : TOKEN_IDENTIFIER;
+static inline uint32_t keyword_hash(uint32_t len) {
+    const unsigned char *s = (const unsigned char *)s_scanner.start;
+
+    return (s[0] * 4u + s[1] * 3u + len) & 31u;
 }
 
 /**
@@ -133,38 +179,14 @@ static inline token_type check_keyword(int start, int len, const char *rest, tok
  * @return The correct token type for an identifier
  */
 static inline token_type identifier_type() {
-    switch (s_scanner.start[0]) {
-        case 'a': return check_keyword(1, 2, "nd", TOKEN_AND);
-        case 'c': return check_keyword(1, 4, "lass", TOKEN_CLASS);
-        case 'e': return check_keyword(1, 3, "lse", TOKEN_ELSE);
-        case 'i': return check_keyword(1, 1, "f", TOKEN_IF);
-        case 'n': return check_keyword(1, 2, "il", TOKEN_NIL);
-        case 'o': return check_keyword(1, 1, "r", TOKEN_OR);
-        case 'p': return check_keyword(1, 4, "rint", TOKEN_PRINT);
-        case 'r': return check_keyword(1, 5, "eturn", TOKEN_RETURN);
-        case 's': return check_keyword(1, 4, "uper", TOKEN_SUPER);
-        case 'v': return check_keyword(1, 2, "ar", TOKEN_VAR);
-        case 'w': return check_keyword(1, 4, "hile", TOKEN_WHILE);
-        case 'f': {
-            if (s_scanner.current - s_scanner.start > 1) {
-                switch (s_scanner.start[1]) {
-                    case 'a': return check_keyword(2, 3, "lse", TOKEN_FALSE);
-                    case 'o': return check_keyword(2, 1, "r", TOKEN_FOR);
-                    case 'u': return check_keyword(2, 1, "n", TOKEN_FUN);
-                }
-            }
-            break;
-        }
-        case 't': {
-            if (s_scanner.current - s_scanner.start > 1) {
-                switch (s_scanner.start[1]) {
-                    case 'h': return check_keyword(2, 2, "is", TOKEN_THIS);
-                    case 'r': return check_keyword(2, 2, "ue", TOKEN_TRUE);
-                }
-            }
-            break;
-        }
-    }
+    uint32_t len = (uint32_t)(s_scanner.current - s_scanner.start);
+
+    // every keyword is between 2 and 6 characters long
+    if (len < 2 || len > 6) { return TOKEN_IDENTIFIER; }
+
+    const keyword *kw = &s_keywords[keyword_hash(len)];
+
+    if (kw->len == len && memcmp(s_scanner.start, kw->name, len) == 0) { return kw->type; }
 
     return TOKEN_IDENTIFIER;
 }
@@ -174,23 +196,11 @@ static inline token_type identifier_type() {
  */
 static void consume_whitespace() {
     while (true) {
-        switch (peek()) {
-            case ' ':
-            case '\t':
-            case '\r': advance(); break;
-            case '\n':
-                ++s_scanner.line;
-                advance();
-                break;
-            case '/': {
-                if (peek_next() != '/') { return; }
-                while (peek() != '\n' && !is_end()) {
-                    advance();
-                }
-                break;
-            }
-            default: return;
-        }
+        s_scanner.current = g_scan_kernels.skip_whitespace(s_scanner.current, &s_scanner.line);
+
+        if (peek() != '/' || peek_next() != '/') { return; }
+
+        s_scanner.current = g_scan_kernels.skip_line(s_scanner.current);
     }
 }
 
@@ -199,13 +209,17 @@ static void consume_whitespace() {
  * @return The string token
  */
 static token string() {
-    while (peek() != '"' && !is_end()) {
-        if (peek() == '\n') { ++s_scanner.line; }
+    while (true) {
+        s_scanner.current = g_scan_kernels.skip_string(s_scanner.current);
+
+        // the kernel stops at newlines so that the line counter stays correct
+        if (peek() != '\n') { break; }
 
+        ++s_scanner.line;
         advance();
     }
 
-    if (is_end()) { return error_token("Unterminated string."); }
+    if (is_end()) { return error_token(ERR_UNTERMINATED_STRING); }
 
     advance();
     return make_tok(TOKEN_STRING);
@@ -236,17 +250,22 @@ static token number() {
  * @return The identifier token
  */
 static token identifier() {
-    while (is_alpha(peek()) || is_digit(peek())) {
-        advance();
-    }
+    s_scanner.current = g_scan_kernels.skip_identifier(s_scanner.current);
 
     return make_tok(identifier_type());
 }
 
 void init_scanner(const char *source) {
+    init_scanner_at(source, 1);
+}
+
+void init_scanner_at(const char *source, size_t line) {
+    init_scan_kernels();
+
+    s_scanner.source = source;
     s_scanner.start = source;
     s_scanner.current = s_scanner.start;
-    s_scanner.line = 1;
+    s_scanner.line = line;
 }
 
 token scan() {
@@ -281,5 +300,33 @@ token scan() {
         default: break;
     }
 
-    return error_token("Unexpected character.");
-}
\ No newline at end of file
+    return error_token(ERR_UNEXPECTED_CHAR);
+}
+
+size_t scan_batch(token_batch *batch, size_t start) {
+    size_t i = start;
+
+    while (i < TOKEN_BATCH_SIZE) {
+        token tok = scan();
+        size_t offset = (size_t)(tok.tok_start - s_scanner.source);
+
+        if (tok.type != TOKEN_ERROR && offset > UINT32_MAX) { tok = error_token(ERR_TOO_LARGE); }
+
+        batch->type[i] = (uint8_t)tok.type;
+        batch->offset[i] = tok.type == TOKEN_ERROR ? s_scanner.error : (uint32_t)offset;
+        batch->len[i] = (uint32_t)tok.len;
+        batch->line[i] = (uint32_t)tok.line;
+        ++i;
+
+        if (tok.type == TOKEN_EOF) { break; }
+    }
+
+    batch->count = i;
+    return i;
+}
+
+const char *token_text(const token_batch *batch, size_t idx) {
+    if (batch->type[idx] == TOKEN_ERROR) { return s_error_messages[batch->offset[idx]]; }
+
+    return s_scanner.source + batch->offset[idx];
+}
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <stddef.h>
+#include <stdint.h>
 
 /** Represents the type of the token */
 typedef enum type {
@@ -62,14 +63,66 @@ typedef struct token {
     const char *tok_start;
 } token;
 
+/** Number of tokens the scanner runs ahead of the parser by */
+#define TOKEN_BATCH_SIZE 256
+
+/**
+ * A batch of tokens, stored as a struct of arrays so that the parser only touches
+ * the field it actually needs. Token text is stored as a 32-bit offset into the
+ * source instead of a pointer.
+ */
+typedef struct token_batch {
+    /** The token_type of each token */
+    uint8_t type[TOKEN_BATCH_SIZE];
+
+    /**
+     * Offset of each token's first character from the start of the source. For
+     * TOKEN_ERROR tokens this is an index into the scanner's error messages instead
+     */
+    uint32_t offset[TOKEN_BATCH_SIZE];
+
+    /** Length of each token */
+    uint32_t len[TOKEN_BATCH_SIZE];
+
+    /** Line each token is on */
+    uint32_t line[TOKEN_BATCH_SIZE];
+
+    /** The number of tokens in the batch */
+    size_t count;
+} token_batch;
+
 /**
  * Initializes the scanner
  * @param source The source code to be scanned
  */
 void init_scanner(const char *source);
 
+/**
+ * Initializes the scanner partway through a source, to scan it again from there
+ * @param source Where to start scanning
+ * @param line The line `source` is on
+ */
+void init_scanner_at(const char *source, size_t line);
+
 /**
  * Scans a single token
  * @return One token
  */
-token scan();
\ No newline at end of file
+token scan();
+
+/**
+ * Scans tokens into a batch, starting at index `start` and stopping once the batch
+ * is full or an EOF token has been written
+ * @param batch The batch to write to
+ * @param start The index to write the first token to
+ * @return The number of tokens now in the batch
+ */
+size_t scan_batch(token_batch *batch, size_t start);
+
+/**
+ * Gets the text of a token in a batch
+ * @param batch The batch holding the token
+ * @param idx The index of the token
+ * @return Pointer to the first character of the token (or the error message)
+ */
+const char *token_text(const token_batch *batch, size_t idx);
\ No newline at end of file
@@ -1,4 +1,7 @@
 #include "common/common.h"
+#include "util/profiler.h"
+#include "util/sampler.h"
+#include "vm/gc.h"
 #include "vm/vm.h"
 #include <stdio.h>
 #include <stdlib.h>
@@ -8,14 +11,15 @@ static void repl() {
     char line_buf[1024];
 
     while (true) {
-        printf("clox >> ");
+        output_write(&g_vm.out, "clox >> ", 8);
+        flush_output(&g_vm.out);
 
         if (!fgets(line_buf, sizeof(line_buf), stdin)) {
-            printf("\n");
+            output_char(&g_vm.out, '\n');
             break;
         }
 
-        if (line_buf[0] == 'c' && line_buf[1] == 'l') { exit(0); }
+        if (line_buf[0] == 'c' && line_buf[1] == 'l') { break; }
 
         interpret(line_buf);
     }
@@ -49,21 +53,84 @@ static void run_file(const char *path) {
     interpret_result res = interpret(buffer);
     free(buffer);
 
+    // exiting early skips the flush in free_vm()
+    if (res != INTERPRET_OK) { free_vm(); }
+
     if (res == INTERPRET_COMPILE_ERROR)
         exit(65);
     else if (res == INTERPRET_RUNTIME_ERROR)
         exit(70);
 }
 
+/** Where `--sample` writes the collapsed stacks, and the script they're for */
+static const char *s_sample_path = NULL;
+static const char *s_script = "repl";
+
+static void print_profile_at_exit() {
+    print_profile(stderr);
+}
+
+static void write_samples_at_exit() {
+    stop_sampler();
+
+    FILE *file = fopen(s_sample_path, "w");
+    if (file == NULL) {
+        fprintf(stderr, "Unable to write samples to '%s'.\n", s_sample_path);
+        return;
+    }
+
+    write_samples(file, s_script);
+    fclose(file);
+}
+
 int main(int argc, const char **argv) {
     init_vm();
 
+    while (argc > 1 && strncmp(argv[1], "--", 2) == 0) {
+        if (strcmp(argv[1], "--profile") == 0) {
+            g_vm.profile = true;
+            atexit(print_profile_at_exit);
+        } else if (strcmp(argv[1], "--stats") == 0) {
+            g_vm.stats = true;
+        } else if (strcmp(argv[1], "--gc") == 0 && argc > 2) {
+            if (!enable_gc(atoi(argv[2]))) {
+                fprintf(stderr, "Unable to start the collector's marking threads.\n");
+            }
+
+            --argc;
+            ++argv;
+        } else if (strcmp(argv[1], "--sample") == 0 && argc > 2) {
+            s_sample_path = argv[2];
+            --argc;
+            ++argv;
+        } else {
+            fprintf(stderr, "Unknown option '%s'.\n", argv[1]);
+            exit(64);
+        }
+
+        --argc;
+        ++argv;
+    }
+
+    if (s_sample_path != NULL) {
+        if (argc == 2) { s_script = argv[1]; }
+
+        g_vm.sample = start_sampler(DEFAULT_SAMPLE_HZ);
+
+        if (g_vm.sample) {
+            atexit(write_samples_at_exit);
+        } else {
+            fprintf(stderr, "Unable to start the sampling profiler.\n");
+        }
+    }
+
     if (argc == 1) {
         repl();
     } else if (argc == 2) {
         run_file(argv[1]);
     } else {
-        fprintf(stderr, "Path not specified! Usage: clox [path]");
+        fprintf(stderr, "Path not specified! Usage: clox [--profile] [--stats] [--gc THREADS] "
+                        "[--sample FILE] [path]");
     }
 
     free_vm();
@@ -0,0 +1,15 @@
+#pragma once
+
+#include <stdint.h>
+#include <time.h>
+
+/**
+ * Reads a monotonic clock
+ * @return The current time in nanoseconds
+ */
+static inline uint64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
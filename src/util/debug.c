@@ -1,18 +1,17 @@
 #include "debug.h"
 
 #include "disassembler.h"
-#include <stdio.h>
 
 void verbose_log(vm *vm) {
-    printf("Current stack contents: [  ");
+    output_printf(&g_vm.out, "Current stack contents: [  ");
 
     for (value *slot = vm->stack_top - 1; slot >= vm->stack; --slot) {
-        printf("  [ ");
+        output_printf(&g_vm.out, "  [ ");
         print_value(*slot);
-        printf(" ], ");
+        output_printf(&g_vm.out, " ], ");
     }
 
-    printf("  ]\n");
+    output_printf(&g_vm.out, "  ]\n");
 
     disassemble_instruction(vm->chunk, (int)(vm->pc - vm->chunk->code));
 }
\ No newline at end of file
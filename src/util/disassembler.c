@@ -1,28 +1,42 @@
 #include "disassembler.h"
-#include "../common/memory.h"
-#include <stdio.h>
+#include "../vm/vm.h"
 
-/**
- * Gets the line that an offset is on
- * @param lines Pointer to the line array
- * @param offset The offset to look for
- * @return The line the offset is on
- */
-static inline size_t get_line(size_t *lines, int offset) {
-    size_t idx = 0;
-
-    // array is lined up as: [ n of bytes with first line number, first line number, ... ]
-    // Read each "number of bytes" and subtract offset by it (and jump forward) until offset
-    // is smaller, at which point the current "number of bytes" is the offset's line number
-    //
-    // see: https://en.wikipedia.org/wiki/Run-length_encoding
-    while (lines[idx] < offset + 1) {
-        offset -= lines[idx];
-        idx += 2;
-    }
-
-    return lines[idx + 1];
-}
+static const char *s_op_names[OP_COUNT] = {
+    [OP_RETURN] = "OP_RETURN",
+    [OP_LOAD_CONST] = "OP_LOAD_CONST",
+    [OP_LOAD_CONST_LONG] = "OP_LOAD_CONST_LONG",
+    [OP_LOAD_INT] = "OP_LOAD_INT",
+    [OP_NIL] = "OP_NIL",
+    [OP_TRUE] = "OP_TRUE",
+    [OP_FALSE] = "OP_FALSE",
+    [OP_NOT] = "OP_NOT",
+    [OP_EQUAL] = "OP_EQUAL",
+    [OP_GREATER] = "OP_GREATER",
+    [OP_LESS] = "OP_LESS",
+    [OP_NEGATE] = "OP_NEGATE",
+    [OP_ADD] = "OP_ADD",
+    [OP_SUBTRACT] = "OP_SUBTRACT",
+    [OP_MULTIPLY] = "OP_MULTIPLY",
+    [OP_DIVIDE] = "OP_DIVIDE",
+    [OP_LOAD_INPUT] = "OP_LOAD_INPUT",
+    [OP_GET_LOCAL] = "OP_GET_LOCAL",
+    [OP_CALL] = "OP_CALL",
+    [OP_INSTANCE] = "OP_INSTANCE",
+    [OP_GET_PROPERTY] = "OP_GET_PROPERTY",
+    [OP_SET_PROPERTY] = "OP_SET_PROPERTY",
+    [OP_DEFINE_PROPERTY] = "OP_DEFINE_PROPERTY",
+    [OP_JUMP] = "OP_JUMP",
+    [OP_JUMP_IF_FALSE] = "OP_JUMP_IF_FALSE",
+    [OP_POP] = "OP_POP",
+    [OP_CONCAT_N] = "OP_CONCAT_N",
+    [OP_ADD_NUM] = "OP_ADD_NUM",
+    [OP_SUBTRACT_NUM] = "OP_SUBTRACT_NUM",
+    [OP_MULTIPLY_NUM] = "OP_MULTIPLY_NUM",
+    [OP_DIVIDE_NUM] = "OP_DIVIDE_NUM",
+    [OP_GREATER_NUM] = "OP_GREATER_NUM",
+    [OP_LESS_NUM] = "OP_LESS_NUM",
+    [OP_NEGATE_NUM] = "OP_NEGATE_NUM",
+};
 
 /**
  * Prints a "simple instruction"
@@ -31,9 +45,9 @@ static inline size_t get_line(size_t *lines, int offset) {
  * @return The offset for the next instruction
  */
 static inline int simple_instruction(const char *name, int offset) {
-    printf("%-20s\n", name);
+    output_printf(&g_vm.out, "%-20s\n", name);
 
-    return offset + 1;
+    return offset + INSTRUCTION_SIZE;
 }
 
 /**
@@ -44,11 +58,42 @@ static inline int simple_instruction(const char *name, int offset) {
  * @return The offset of the next instruction
  */
 static inline int const_instruction(const char *name, chunk *c, int offset) {
-    printf("%-20s %4s %d ", name, "idx:", c->code[offset + 1]);
-    print_value(c->constant_pool.values[c->code[offset + 1]]);
-    printf("\n");
+    uint16_t idx = read_word(&c->code[offset + INSTRUCTION_SIZE]);
+
+    output_printf(&g_vm.out, "%-20s %4s %d ", name, "idx:", idx);
+    print_value(c->constant_pool.values[idx]);
+    output_printf(&g_vm.out, "\n");
+
+    return offset + INSTRUCTION_SIZE + 2;
+}
+
+/**
+ * Prints an instruction with a one byte operand
+ * @param name The name of the instruction
+ * @param label What the operand is
+ * @param c Pointer to the chunk
+ * @param offset The offset of the instruction
+ * @return The offset of the next instruction
+ */
+static inline int byte_instruction(const char *name, const char *label, chunk *c, int offset) {
+    output_printf(&g_vm.out, "%-20s %4s %d\n", name, label, c->code[offset + 1]);
+
+    return offset + INSTRUCTION_SIZE;
+}
+
+/**
+ * Prints a LOAD_INT instruction
+ * @param name The name of the instruction
+ * @param c Pointer to the chunk
+ * @param offset The offset of the instruction
+ * @return The offset of the next instruction
+ */
+static inline int int_instruction(const char *name, chunk *c, int offset) {
+    int16_t num = (int16_t)read_word(&c->code[offset + INSTRUCTION_SIZE]);
+
+    output_printf(&g_vm.out, "%-20s %4s %d\n", name, "int:", num);
 
-    return offset + 2;
+    return offset + INSTRUCTION_SIZE + 2;
 }
 
 /**
@@ -59,19 +104,52 @@ static inline int const_instruction(const char *name, chunk *c, int offset) {
  * @return The offset of the next instruction
  */
 static inline int const_long_instruction(const char *n, chunk *c, int offset) {
-    // get the bytes of the 3 byte const_pool offset, turn into a size_t
-    // to use as the index
-    size_t num = from_bytes(c->code[offset + 1], c->code[offset + 2], c->code[offset + 3]);
+    // the index is split over two words, low half first
+    const uint8_t *operand = &c->code[offset + INSTRUCTION_SIZE];
+    size_t num = read_word(operand) | (size_t)read_word(operand + 2) << 16u;
 
-    printf("%-20s %4s %zu", n, "idx:", num);
+    output_printf(&g_vm.out, "%-20s %4s %zu ", n, "idx:", num);
     print_value(c->constant_pool.values[num]);
-    printf("\n");
+    output_printf(&g_vm.out, "\n");
 
-    return offset + 4;
+    return offset + INSTRUCTION_SIZE + 4;
+}
+
+/**
+ * Prints a property access
+ * @param name The name of the instruction
+ * @param c Pointer to the chunk
+ * @param offset The offset of the instruction
+ * @return The offset of the next instruction
+ */
+static inline int property_instruction(const char *name, chunk *c, int offset) {
+    uint16_t idx = read_word(&c->code[offset + INSTRUCTION_SIZE]);
+
+    output_printf(&g_vm.out, "%-20s %4s %d ", name, "ic:", idx);
+    print_value(c->constant_pool.values[c->caches[idx].name]);
+    output_printf(&g_vm.out, "\n");
+
+    return offset + INSTRUCTION_SIZE + 2;
+}
+
+/**
+ * Prints a jump instruction
+ * @param name The name of the instruction
+ * @param c Pointer to the chunk
+ * @param offset The offset of the instruction
+ * @return The offset of the next instruction
+ */
+static inline int jump_instruction(const char *name, chunk *c, int offset) {
+    int next = offset + INSTRUCTION_SIZE + 2;
+    int jump = read_word(&c->code[offset + INSTRUCTION_SIZE]);
+
+    output_printf(&g_vm.out, "%-20s %4s %d\n", name, "to:", next + jump);
+
+    return next;
 }
 
 void disassemble_chunk(chunk *c, const char *name) {
-    printf("=== %s ===\n", name);
+    output_printf(&g_vm.out, "=== %s ===\n", name);
     int offset = 0;
 
     while (offset < c->size) {
@@ -80,33 +158,40 @@ void disassemble_chunk(chunk *c, const char *name) {
 }
 
 int disassemble_instruction(chunk *c, int offset) {
-    printf("%04d ", offset);
+    output_printf(&g_vm.out, "%04d ", offset);
 
-    size_t line = get_line(c->lines, offset);
+    size_t line = get_line(c, offset);
     // since the AND is short-circuited, get_line(offset - 1) won't get called
     // if offset is 0
-    if (offset > 0 && line == get_line(c->lines, offset - 1)) {
-        printf("   | ");
+    if (offset > 0 && line == get_line(c, offset - 1)) {
+        output_printf(&g_vm.out, "   | ");
     } else {
-        printf("%4zu ", line);
+        output_printf(&g_vm.out, "%4zu ", line);
     }
 
-    switch (c->code[offset]) {
-        case OP_RETURN: return simple_instruction("OP_RETURN", offset);
-        case OP_LOAD_CONST: return const_instruction("OP_LOAD_CONST", c, offset);
-        case OP_LOAD_CONST_LONG: return const_long_instruction("OP_LOAD_CONST_LONG", c, offset);
-        case OP_NEGATE: return simple_instruction("OP_NEGATE", offset);
-        case OP_ADD: return simple_instruction("OP_ADD", offset);
-        // case OP_SUBTRACT: return simple_instruction("OP_SUBTRACT", offset);
-        case OP_MULTIPLY: return simple_instruction("OP_MULTIPLY", offset);
-        case OP_DIVIDE: return simple_instruction("OP_DIVIDE", offset);
-        case OP_NIL: return simple_instruction("OP_NIL", offset);
-        case OP_TRUE: return simple_instruction("OP_TRUE", offset);
-        case OP_FALSE: return simple_instruction("OP_FALSE", offset);
-        case OP_NOT: return simple_instruction("OP_NOT", offset);
-        case OP_EQUAL: return simple_instruction("OP_EQUAL", offset);
-        case OP_GREATER: return simple_instruction("OP_GREATER", offset);
-        case OP_LESS: return simple_instruction("OP_LESS", offset);
-        default: printf("Unknown opcode: %d\n", c->code[offset]); return offset + 1;
+    uint8_t op = c->code[offset];
+
+    switch (op) {
+        case OP_LOAD_CONST: return const_instruction(op_code_name(op), c, offset);
+        case OP_LOAD_CONST_LONG: return const_long_instruction(op_code_name(op), c, offset);
+        case OP_LOAD_INT: return int_instruction(op_code_name(op), c, offset);
+        case OP_LOAD_INPUT: return byte_instruction(op_code_name(op), "idx:", c, offset);
+        case OP_GET_LOCAL: return byte_instruction(op_code_name(op), "slot:", c, offset);
+        case OP_CALL: return byte_instruction(op_code_name(op), "args:", c, offset);
+        case OP_CONCAT_N: return byte_instruction(op_code_name(op), "operands:", c, offset);
+        case OP_GET_PROPERTY:
+        case OP_SET_PROPERTY:
+        case OP_DEFINE_PROPERTY: return property_instruction(op_code_name(op), c, offset);
+        case OP_JUMP:
+        case OP_JUMP_IF_FALSE: return jump_instruction(op_code_name(op), c, offset);
+        default:
+            if (op < OP_COUNT) { return simple_instruction(op_code_name(op), offset); }
+
+            output_printf(&g_vm.out, "Unknown opcode: %d\n", op);
+            return offset + INSTRUCTION_SIZE;
     }
+}
+
+const char *op_code_name(uint8_t op) {
+    return op < OP_COUNT ? s_op_names[op] : "OP_UNKNOWN";
 }
\ No newline at end of file
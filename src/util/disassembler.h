@@ -17,3 +17,10 @@ void disassemble_chunk(chunk *chunk, const char *name);
  * @returns The number of bytes consumed by the instruction
  */
 int disassemble_instruction(chunk *chunk, int offset);
+
+/**
+ * Gets the name of an opcode, like "OP_ADD"
+ * @param op The opcode
+ * @return The name, or "OP_UNKNOWN" if `op` isn't an opcode
+ */
+const char *op_code_name(uint8_t op);
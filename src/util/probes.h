@@ -0,0 +1,41 @@
+#pragma once
+
+/**
+ * USDT (SystemTap/DTrace style) static probes, for bpftrace and perf. Built with the
+ * CLOX_USDT CMake option, otherwise every probe compiles to nothing. A disabled probe
+ * is a single nop in the binary, so they're safe to leave in production builds.
+ *
+ * Probes, listed by `bpftrace -l 'usdt:./clox:*'`:
+ *   clox:interpret__start(const char *source)
+ *   clox:interpret__done(int result)
+ *   clox:compile__start(const char *source)
+ *   clox:compile__done(int success, size_t bytecode_bytes)
+ *   clox:object__alloc(int type, size_t size)
+ *   clox:runtime__error(const char *format, size_t line)
+ *   clox:dispatch(int opcode, size_t offset), every DISPATCH_PROBE_INTERVAL instructions
+ */
+
+/** The dispatch probe fires once per this many instructions */
+#define DISPATCH_PROBE_INTERVAL 1024
+
+#ifdef CLOX_USDT
+
+// semaphores let the VM see when a tracer is attached to the dispatch probe
+#define _SDT_HAS_SEMAPHORES 1
+#include <sys/sdt.h>
+
+extern unsigned short clox_dispatch_semaphore;
+
+#define CLOX_PROBE1(name, a) STAP_PROBE1(clox, name, a)
+#define CLOX_PROBE2(name, a, b) STAP_PROBE2(clox, name, a, b)
+
+/** Whether a tracer is attached to the dispatch probe */
+#define CLOX_DISPATCH_PROBE_ENABLED() __builtin_expect(clox_dispatch_semaphore != 0, 0)
+
+#else
+
+#define CLOX_PROBE1(name, a) ((void)0)
+#define CLOX_PROBE2(name, a, b) ((void)0)
+#define CLOX_DISPATCH_PROBE_ENABLED() false
+
+#endif
@@ -0,0 +1,46 @@
+#include "profiler.h"
+#include "disassembler.h"
+#include <stdlib.h>
+
+op_profile g_op_profile;
+
+static int compare_cycles(const void *lhs, const void *rhs) {
+    uint64_t a = g_op_profile.cycles[*(const uint8_t *)lhs];
+    uint64_t b = g_op_profile.cycles[*(const uint8_t *)rhs];
+
+    return (a < b) - (a > b);
+}
+
+void print_profile(FILE *file) {
+    uint8_t ops[OP_COUNT];
+    uint64_t total_count = 0;
+    uint64_t total_cycles = 0;
+
+    for (int op = 0; op < OP_COUNT; ++op) {
+        ops[op] = (uint8_t)op;
+        total_count += g_op_profile.count[op];
+        total_cycles += g_op_profile.cycles[op];
+    }
+
+    qsort(ops, OP_COUNT, sizeof(uint8_t), compare_cycles);
+
+    fprintf(file, "=== opcode profile ===\n");
+    fprintf(file, "%-20s %14s %7s %16s %7s %10s\n", "opcode", "count", "%", "cycles", "%",
+            "cycles/op");
+
+    for (int i = 0; i < OP_COUNT; ++i) {
+        uint8_t op = ops[i];
+        uint64_t count = g_op_profile.count[op];
+        uint64_t cycles = g_op_profile.cycles[op];
+
+        if (count == 0) { continue; }
+
+        fprintf(file, "%-20s %14llu %6.2f%% %16llu %6.2f%% %10.1f\n", op_code_name(op),
+                (unsigned long long)count, 100.0 * count / total_count,
+                (unsigned long long)cycles, 100.0 * cycles / total_cycles,
+                (double)cycles / count);
+    }
+
+    fprintf(file, "%-20s %14llu %7s %16llu\n", "total", (unsigned long long)total_count, "",
+            (unsigned long long)total_cycles);
+}
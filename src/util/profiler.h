@@ -0,0 +1,77 @@
+#pragma once
+
+#include "../vm/chunk.h"
+#include <stdio.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#else
+#include "clock.h"
+#endif
+
+/**
+ * Per-opcode execution counts and cycle totals, collected by `run()` when the VM is
+ * profiling. An instruction is charged the cycles from its dispatch to the next one.
+ */
+typedef struct op_profile {
+    /** Times each opcode was executed */
+    uint64_t count[OP_COUNT];
+
+    /** Cycles spent in each opcode */
+    uint64_t cycles[OP_COUNT];
+
+    /** The opcode being executed */
+    uint8_t last_op;
+
+    /** Cycle counter at the dispatch of `last_op` */
+    uint64_t last_start;
+} op_profile;
+
+extern op_profile g_op_profile;
+
+/**
+ * Reads the CPU's cycle counter, or a nanosecond clock where there isn't one
+ * @return The current count
+ */
+static inline uint64_t read_cycles() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return now_ns();
+#endif
+}
+
+/**
+ * Starts charging cycles, called before the first instruction of a chunk
+ * @param first_op The chunk's first opcode
+ */
+static inline void profile_begin(uint8_t first_op) {
+    g_op_profile.last_op = first_op;
+    g_op_profile.last_start = read_cycles();
+}
+
+/**
+ * Records the dispatch of an instruction, charging the previous one
+ * @param op The opcode being dispatched
+ */
+static inline void profile_dispatch(uint8_t op) {
+    uint64_t now = read_cycles();
+
+    g_op_profile.cycles[g_op_profile.last_op] += now - g_op_profile.last_start;
+    ++g_op_profile.count[op];
+    g_op_profile.last_op = op;
+    g_op_profile.last_start = now;
+}
+
+/**
+ * Charges the last instruction of a chunk, called once `run()` returns
+ */
+static inline void profile_end() {
+    g_op_profile.cycles[g_op_profile.last_op] += read_cycles() - g_op_profile.last_start;
+}
+
+/**
+ * Prints every executed opcode, sorted by the cycles spent in it
+ * @param file The file to print to
+ */
+void print_profile(FILE *file);
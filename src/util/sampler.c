@@ -0,0 +1,172 @@
+#include "sampler.h"
+#include "../common/memory.h"
+#include "../vm/vm.h"
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+/** A sample: where in which chunk the VM was */
+typedef struct sample {
+    /** The chunk being run, NULL if the VM wasn't running one */
+    const chunk *chunk;
+
+    /** Offset of the opcode being executed */
+    uint32_t offset;
+} sample;
+
+// the signal handler is the only producer and the main thread the only consumer
+static sample s_ring[SAMPLE_RING_SIZE];
+static atomic_size_t s_head;
+static atomic_size_t s_tail;
+static atomic_size_t s_dropped;
+
+/** Samples per source line, indexed by line */
+static uint64_t *s_line_counts = NULL;
+static size_t s_line_capacity = 0;
+
+/** Samples taken outside the VM, like while compiling */
+static uint64_t s_outside = 0;
+
+static void on_sigprof(int sig) {
+    (void)sig;
+
+    size_t head = atomic_load_explicit(&s_head, memory_order_relaxed);
+    if (head - atomic_load_explicit(&s_tail, memory_order_relaxed) >= SAMPLE_RING_SIZE) {
+        atomic_fetch_add_explicit(&s_dropped, 1, memory_order_relaxed);
+        return;
+    }
+
+    const chunk *c = g_vm.chunk;
+    const uint8_t *pc = g_vm.pc;
+    sample *entry = &s_ring[head & (SAMPLE_RING_SIZE - 1)];
+
+    // pc is past the opcode being executed by now, and is briefly out of step with the
+    // chunk when a call switches between them
+    if (c != NULL && pc > c->code && pc <= c->code + c->size) {
+        entry->chunk = c;
+        entry->offset = (uint32_t)(pc - c->code - 1);
+    } else {
+        entry->chunk = NULL;
+    }
+
+    atomic_store_explicit(&s_head, head + 1, memory_order_release);
+}
+
+bool start_sampler(int hz) {
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = on_sigprof;
+    action.sa_flags = SA_RESTART;
+    sigemptyset(&action.sa_mask);
+
+    if (sigaction(SIGPROF, &action, NULL) != 0) { return false; }
+
+    long usec = 1000000 / (hz > 0 ? hz : DEFAULT_SAMPLE_HZ);
+    struct itimerval timer = {{0, usec}, {0, usec}};
+
+    return setitimer(ITIMER_PROF, &timer, NULL) == 0;
+}
+
+static int compare_samples(const void *lhs, const void *rhs) {
+    const sample *a = lhs;
+    const sample *b = rhs;
+
+    if (a->chunk != b->chunk) { return (a->chunk > b->chunk) - (a->chunk < b->chunk); }
+
+    return (a->offset > b->offset) - (a->offset < b->offset);
+}
+
+/**
+ * Adds samples to a line
+ * @param line The line
+ * @param count The number of samples
+ */
+static void count_line(size_t line, uint64_t count) {
+    if (line >= s_line_capacity) {
+        size_t new_capacity = grow_capacity(s_line_capacity);
+        while (new_capacity <= line) {
+            new_capacity = grow_capacity(new_capacity);
+        }
+
+        s_line_counts = GROW_ARRAY(s_line_counts, uint64_t, s_line_capacity, new_capacity);
+        memset(s_line_counts + s_line_capacity, 0,
+               sizeof(uint64_t) * (new_capacity - s_line_capacity));
+        s_line_capacity = new_capacity;
+    }
+
+    s_line_counts[line] += count;
+}
+
+void drain_samples() {
+    size_t head = atomic_load_explicit(&s_head, memory_order_acquire);
+    size_t tail = atomic_load_explicit(&s_tail, memory_order_relaxed);
+    if (head == tail) { return; }
+
+    sample *samples = ALLOCATE(sample, head - tail);
+    size_t count = 0;
+
+    for (size_t i = tail; i != head; ++i) {
+        sample entry = s_ring[i & (SAMPLE_RING_SIZE - 1)];
+
+        if (entry.chunk == NULL) {
+            ++s_outside;
+        } else {
+            samples[count++] = entry;
+        }
+    }
+
+    atomic_store_explicit(&s_tail, head, memory_order_relaxed);
+
+    // sorted by chunk then offset, each chunk's samples resolve in one pass over its
+    // run-length encoded line table
+    qsort(samples, count, sizeof(sample), compare_samples);
+
+    const chunk *c = NULL;
+    size_t pair = 0;
+    size_t pair_end = 0;
+
+    for (size_t i = 0; i < count; ++i) {
+        if (samples[i].chunk != c) {
+            c = samples[i].chunk;
+            pair = 0;
+            pair_end = c->lines[0];
+        }
+
+        while (samples[i].offset >= pair_end) {
+            pair += 2;
+            pair_end += c->lines[pair];
+        }
+
+        count_line(c->lines[pair + 1], 1);
+    }
+
+    FREE_ARRAY(samples, sample, head - tail);
+}
+
+void stop_sampler() {
+    struct itimerval timer = {{0, 0}, {0, 0}};
+    setitimer(ITIMER_PROF, &timer, NULL);
+
+    drain_samples();
+}
+
+void write_samples(FILE *file, const char *script) {
+    for (size_t line = 0; line < s_line_capacity; ++line) {
+        if (s_line_counts[line] == 0) { continue; }
+
+        fprintf(file, "clox;%s:%zu %llu\n", script, line, (unsigned long long)s_line_counts[line]);
+    }
+
+    if (s_outside > 0) { fprintf(file, "clox;[outside vm] %llu\n", (unsigned long long)s_outside); }
+
+    size_t dropped = atomic_load_explicit(&s_dropped, memory_order_relaxed);
+    if (dropped > 0) {
+        fprintf(stderr, "sampler: %zu samples dropped, the ring was full\n", dropped);
+    }
+
+    FREE_ARRAY(s_line_counts, uint64_t, s_line_capacity);
+    s_line_counts = NULL;
+    s_line_capacity = 0;
+}
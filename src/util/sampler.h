@@ -0,0 +1,39 @@
+#pragma once
+
+#include "../vm/chunk.h"
+#include <stdio.h>
+
+/** Samples the ring holds between two drains, a power of two */
+#define SAMPLE_RING_SIZE (1u << 16)
+
+/** Sampling rate used when none is given, prime so it doesn't beat against anything */
+#define DEFAULT_SAMPLE_HZ 997
+
+/**
+ * Starts sampling `g_vm.pc` on every SIGPROF. The samples go into a lock-free ring that
+ * `run_chunk` drains when the chunk finishes, since its line table is gone afterwards.
+ * @param hz Samples per second of CPU time
+ * @return Whether the signal handler and timer could be set up
+ */
+bool start_sampler(int hz);
+
+/**
+ * Resolves the samples taken so far to source lines. Every sample is resolved against the
+ * chunk it was taken in, a function body or the chunk that called it, so those all have
+ * to still be alive. Samples taken while `g_vm.chunk` was NULL are counted as outside
+ * the VM.
+ */
+void drain_samples();
+
+/**
+ * Stops the timer and drains whatever is left in the ring
+ */
+void stop_sampler();
+
+/**
+ * Writes the samples in collapsed-stack format, one "clox;<script>:<line> <count>" line per
+ * source line, which flamegraph.pl and speedscope can read
+ * @param file The file to write to
+ * @param script Name to show for the script, like its path
+ */
+void write_samples(FILE *file, const char *script);
@@ -0,0 +1,69 @@
+#include "stats.h"
+#include "../common/memory.h"
+#include "profiler.h"
+#include <string.h>
+
+interpret_stats g_stats;
+
+/** Opcode counts when the measured `interpret()` started */
+static uint64_t s_start_counts[OP_COUNT];
+
+/** Objects allocated before the measured `interpret()` started */
+static size_t s_start_objects;
+
+/** When the current phase started */
+static uint64_t s_phase_start;
+
+void stats_start() {
+    memset(&g_stats, 0, sizeof(interpret_stats));
+    memcpy(s_start_counts, g_op_profile.count, sizeof(s_start_counts));
+    s_start_objects = g_alloc_stats.objects;
+    s_phase_start = now_ns();
+}
+
+void stats_compiled(const chunk *c) {
+    uint64_t end = now_ns();
+
+    // the scanner's time was measured batch by batch while compiling
+    g_stats.compile_ns = end - s_phase_start - g_stats.scan_ns;
+    g_stats.bytecode_bytes = c->size;
+    g_stats.constants = c->constant_pool.size;
+    s_phase_start = end;
+}
+
+void stats_finished(bool executed) {
+    if (executed) { g_stats.execute_ns = now_ns() - s_phase_start; }
+
+    for (int op = 0; op < OP_COUNT; ++op) {
+        g_stats.op_counts[op] = g_op_profile.count[op] - s_start_counts[op];
+    }
+
+    g_stats.objects = g_alloc_stats.objects - s_start_objects;
+}
+
+void print_stats(FILE *file) {
+    uint64_t instructions = 0;
+
+    for (int op = 0; op < OP_COUNT; ++op) {
+        instructions += g_stats.op_counts[op];
+    }
+
+    uint64_t total_ns = g_stats.scan_ns + g_stats.compile_ns + g_stats.execute_ns;
+    double total = total_ns == 0 ? 1.0 : (double)total_ns;
+
+    fprintf(file, "=== interpret stats ===\n");
+    fprintf(file, "%-16s %12.3f ms %6.2f%%\n", "scan", g_stats.scan_ns / 1e6,
+            100.0 * g_stats.scan_ns / total);
+    fprintf(file, "%-16s %12.3f ms %6.2f%%\n", "compile", g_stats.compile_ns / 1e6,
+            100.0 * g_stats.compile_ns / total);
+    fprintf(file, "%-16s %12.3f ms %6.2f%%\n", "execute", g_stats.execute_ns / 1e6,
+            100.0 * g_stats.execute_ns / total);
+    fprintf(file, "%-16s %12zu bytes\n", "bytecode", g_stats.bytecode_bytes);
+    fprintf(file, "%-16s %12zu\n", "constants", g_stats.constants);
+    fprintf(file, "%-16s %12llu short, %llu long, %llu immediate\n", "constant loads",
+            (unsigned long long)g_stats.op_counts[OP_LOAD_CONST],
+            (unsigned long long)g_stats.op_counts[OP_LOAD_CONST_LONG],
+            (unsigned long long)g_stats.op_counts[OP_LOAD_INT]);
+    fprintf(file, "%-16s %12llu\n", "instructions", (unsigned long long)instructions);
+    fprintf(file, "%-16s %12zu\n", "objects", g_stats.objects);
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include "../vm/chunk.h"
+#include "clock.h"
+#include <stdio.h>
+
+/**
+ * Where the time of one `interpret()` went, collected when the VM runs with `--stats`
+ */
+typedef struct interpret_stats {
+    /** Time spent in the scanner, which runs interleaved with the compiler */
+    uint64_t scan_ns;
+
+    /** Time spent compiling, not counting the scanner */
+    uint64_t compile_ns;
+
+    /** Time spent running the chunk */
+    uint64_t execute_ns;
+
+    /** Size of the chunk's code */
+    size_t bytecode_bytes;
+
+    /** Size of the chunk's constant pool */
+    size_t constants;
+
+    /** Instructions executed, by opcode */
+    uint64_t op_counts[OP_COUNT];
+
+    /** Objects allocated while compiling and running */
+    size_t objects;
+} interpret_stats;
+
+extern interpret_stats g_stats;
+
+/**
+ * Starts measuring an `interpret()`, clearing `g_stats`
+ */
+void stats_start();
+
+/**
+ * Records the end of compilation
+ * @param c The chunk that was compiled, successfully or not
+ */
+void stats_compiled(const chunk *c);
+
+/**
+ * Records the end of an `interpret()`, counting the instructions and objects since
+ * `stats_start`
+ * @param executed Whether the chunk was run, if not there's no execution time
+ */
+void stats_finished(bool executed);
+
+/**
+ * Prints the statistics of the last `interpret()`
+ * @param file The file to print to
+ */
+void print_stats(FILE *file);
@@ -0,0 +1,101 @@
+#pragma once
+
+#include "value.h"
+
+// Integer arithmetic shared by the VM and the batch evaluator. Results that don't fit
+// in an int64_t are promoted to doubles, so Lox code never sees an overflow.
+
+/**
+ * Adds two integers, promoting to a double if the result doesn't fit
+ * @param a The left operand
+ * @param b The right operand
+ * @return The sum
+ */
+static inline value add_ints(int64_t a, int64_t b) {
+    int64_t res;
+    if (__builtin_add_overflow(a, b, &res)) { return number_value((double)a + (double)b); }
+
+    return int_value(res);
+}
+
+/**
+ * Subtracts two integers, promoting to a double if the result doesn't fit
+ * @param a The left operand
+ * @param b The right operand
+ * @return The difference
+ */
+static inline value subtract_ints(int64_t a, int64_t b) {
+    int64_t res;
+    if (__builtin_sub_overflow(a, b, &res)) { return number_value((double)a - (double)b); }
+
+    return int_value(res);
+}
+
+/**
+ * Multiplies two integers, promoting to a double if the result doesn't fit
+ * @param a The left operand
+ * @param b The right operand
+ * @return The product
+ */
+static inline value multiply_ints(int64_t a, int64_t b) {
+    int64_t res;
+    if (__builtin_mul_overflow(a, b, &res)) { return number_value((double)a * (double)b); }
+
+    // as doubles, zero times a negative number is -0, which prints differently
+    if (res == 0 && (a < 0 || b < 0)) { return number_value(-0.0); }
+
+    return int_value(res);
+}
+
+/**
+ * Negates an integer, promoting to a double if the result doesn't fit
+ * @param a The operand
+ * @return The negation
+ */
+static inline value negate_int(int64_t a) {
+    if (a == 0 || a == INT64_MIN) { return number_value(-(double)a); }
+
+    return int_value(-a);
+}
+
+/**
+ * Compares an integer with a double exactly. Converting the integer to a double could
+ * round it, and an integer past 2^53 would then be neither less nor greater than a
+ * double it isn't equal to.
+ * @param i The integer
+ * @param d The double
+ * @return -1, 0 or 1 as `i` is less than, equal to or greater than `d`, NaN if `d` is
+ */
+static inline double compare_int_double(int64_t i, double d) {
+    if (d != d) { return d; }
+
+    // 2^63 is the first double past INT64_MAX, converting anything at or above it is UB
+    if (d >= 9223372036854775808.0) { return -1.0; }
+    if (d < -9223372036854775808.0) { return 1.0; }
+
+    // the integral part of `d` fits, and taking it away leaves the fraction exactly
+    int64_t whole = (int64_t)d;
+    if (i != whole) { return i < whole ? -1.0 : 1.0; }
+
+    double fraction = d - (double)whole;
+
+    return fraction > 0.0 ? -1.0 : fraction < 0.0 ? 1.0 : 0.0;
+}
+
+/**
+ * Compares two numbers of either kind exactly, the same way `are_equal` does
+ * @param a The left operand, a number
+ * @param b The right operand, a number
+ * @return Less than or greater than 0 as `a` is less than or greater than `b`, 0 or NaN
+ * when it's neither
+ */
+static inline double compare_numbers(value a, value b) {
+    if (is_int(a) && is_int(b)) {
+        return as_int(a) < as_int(b) ? -1.0 : as_int(a) > as_int(b) ? 1.0 : 0.0;
+    }
+
+    if (is_int(a)) { return compare_int_double(as_int(a), b.as.number); }
+    if (is_int(b)) { return -compare_int_double(as_int(b), a.as.number); }
+
+    return a.as.number - b.as.number;
+}
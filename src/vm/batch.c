@@ -0,0 +1,728 @@
+#include "batch.h"
+#include "../common/memory.h"
+#include "../compiler/compiler.h"
+#include "arithmetic.h"
+#include "batch_simd.h"
+#include "object.h"
+#include <string.h>
+
+/** How the lanes of a block are stored */
+typedef enum block_kind {
+    /** Every lane is an integer */
+    BLOCK_INT,
+
+    /** Every lane is a double */
+    BLOCK_DOUBLE,
+
+    /** Every lane is a bool */
+    BLOCK_BOOL,
+
+    /** Lanes are arbitrary values, only the per-lane fallback works on these */
+    BLOCK_VALUE,
+} block_kind;
+
+/**
+ * One value on the batch evaluator's stack, for every lane of a block. Lanes that have
+ * failed hold a placeholder of the block's kind.
+ */
+struct batch_block {
+    /** Tag for the variant */
+    block_kind kind;
+
+    /** The lanes */
+    union {
+        int64_t ints[BATCH_BLOCK];
+        double doubles[BATCH_BLOCK];
+        bool bools[BATCH_BLOCK];
+        value values[BATCH_BLOCK];
+    } as;
+};
+
+/**
+ * Checks if a value is falsey, the same way the VM does
+ * @param val The value to check
+ * @return Whether the value is nil or false
+ */
+static inline bool is_falsey(value val) {
+    return is_nil(val) || (is_bool(val) && !as_bool(val));
+}
+
+/**
+ * Runs an opcode on one lane, with the same semantics as the VM
+ * @param op The opcode
+ * @param a The left (or only) operand
+ * @param b The right operand, ignored by unary opcodes
+ * @param failed Set if the opcode hit a runtime error
+ * @return The result, nil if the opcode failed
+ */
+static value apply_lane(uint8_t op, value a, value b, bool *failed) {
+    switch (op) {
+        case OP_ADD:
+            if (is_int(a) && is_int(b)) { return add_ints(as_int(a), as_int(b)); }
+            if (is_string(a) && is_string(b)) {
+                return object_value((object *)concatenate_strings(as_string(a), as_string(b)));
+            }
+            if (is_number(a) && is_number(b)) { return number_value(as_number(a) + as_number(b)); }
+            break;
+        case OP_SUBTRACT:
+            if (is_int(a) && is_int(b)) { return subtract_ints(as_int(a), as_int(b)); }
+            if (is_number(a) && is_number(b)) { return number_value(as_number(a) - as_number(b)); }
+            break;
+        case OP_MULTIPLY:
+            if (is_int(a) && is_int(b)) { return multiply_ints(as_int(a), as_int(b)); }
+            if (is_number(a) && is_number(b)) { return number_value(as_number(a) * as_number(b)); }
+            break;
+        case OP_DIVIDE:
+            if (is_number(a) && is_number(b)) { return number_value(as_number(a) / as_number(b)); }
+            break;
+        case OP_GREATER:
+            if (is_number(a) && is_number(b)) { return bool_value(compare_numbers(a, b) > 0); }
+            break;
+        case OP_LESS:
+            if (is_number(a) && is_number(b)) { return bool_value(compare_numbers(a, b) < 0); }
+            break;
+        case OP_EQUAL: return bool_value(are_equal(a, b));
+        case OP_NOT: return bool_value(is_falsey(a));
+        case OP_NEGATE:
+            if (is_int(a)) { return negate_int(as_int(a)); }
+            if (is_number(a)) { return number_value(-as_number(a)); }
+            break;
+    }
+
+    *failed = true;
+    return nil_value();
+}
+
+/**
+ * Fills every lane of a block with the same value
+ * @param blk The block to fill
+ * @param val The value
+ * @param n Number of lanes
+ */
+static void broadcast(batch_block *blk, value val, size_t n) {
+    switch (val.type) {
+        case VAL_INT:
+            blk->kind = BLOCK_INT;
+            for (size_t i = 0; i < n; ++i) {
+                blk->as.ints[i] = as_int(val);
+            }
+            break;
+        case VAL_NUMBER:
+            blk->kind = BLOCK_DOUBLE;
+            for (size_t i = 0; i < n; ++i) {
+                blk->as.doubles[i] = as_number(val);
+            }
+            break;
+        case VAL_BOOL:
+            blk->kind = BLOCK_BOOL;
+            memset(blk->as.bools, as_bool(val), n);
+            break;
+        default:
+            blk->kind = BLOCK_VALUE;
+            for (size_t i = 0; i < n; ++i) {
+                blk->as.values[i] = val;
+            }
+            break;
+    }
+}
+
+/**
+ * Converts a block to BLOCK_VALUE
+ * @param blk The block to convert
+ * @param n Number of lanes
+ */
+static void widen(batch_block *blk, size_t n) {
+    // values are wider than every other kind of lane, so go backwards to convert in place
+    switch (blk->kind) {
+        case BLOCK_INT:
+            for (size_t i = n; i-- > 0;) {
+                value val = int_value(blk->as.ints[i]);
+                blk->as.values[i] = val;
+            }
+            break;
+        case BLOCK_DOUBLE:
+            for (size_t i = n; i-- > 0;) {
+                value val = number_value(blk->as.doubles[i]);
+                blk->as.values[i] = val;
+            }
+            break;
+        case BLOCK_BOOL:
+            for (size_t i = n; i-- > 0;) {
+                value val = bool_value(blk->as.bools[i]);
+                blk->as.values[i] = val;
+            }
+            break;
+        case BLOCK_VALUE: break;
+    }
+
+    blk->kind = BLOCK_VALUE;
+}
+
+/**
+ * Converts a BLOCK_VALUE block back to a narrower kind, if every lane that hasn't
+ * failed has the same type, so the opcodes after it can use the kernels again
+ * @param blk The block to convert
+ * @param n Number of lanes
+ * @param failed Which lanes have failed
+ */
+static void narrow(batch_block *blk, size_t n, const bool *failed) {
+    size_t first = 0;
+    while (first < n && failed[first]) {
+        ++first;
+    }
+
+    if (first == n) { return; }
+
+    value_type type = blk->as.values[first].type;
+
+    for (size_t i = first + 1; i < n; ++i) {
+        if (!failed[i] && blk->as.values[i].type != type) { return; }
+    }
+
+    // every other kind is narrower than a value, so going forwards converts in place
+    switch (type) {
+        case VAL_INT:
+            for (size_t i = 0; i < n; ++i) {
+                value val = blk->as.values[i];
+                blk->as.ints[i] = failed[i] ? 0 : as_int(val);
+            }
+            blk->kind = BLOCK_INT;
+            break;
+        case VAL_NUMBER:
+            for (size_t i = 0; i < n; ++i) {
+                value val = blk->as.values[i];
+                blk->as.doubles[i] = failed[i] ? 0 : as_number(val);
+            }
+            blk->kind = BLOCK_DOUBLE;
+            break;
+        case VAL_BOOL:
+            for (size_t i = 0; i < n; ++i) {
+                value val = blk->as.values[i];
+                blk->as.bools[i] = !failed[i] && as_bool(val);
+            }
+            blk->kind = BLOCK_BOOL;
+            break;
+        default: break;
+    }
+}
+
+/**
+ * Converts a BLOCK_INT block to BLOCK_DOUBLE, leaving other kinds alone
+ * @param blk The block to convert
+ * @param n Number of lanes
+ */
+static void to_doubles(batch_block *blk, size_t n) {
+    if (blk->kind != BLOCK_INT) { return; }
+
+    for (size_t i = 0; i < n; ++i) {
+        blk->as.doubles[i] = (double)blk->as.ints[i];
+    }
+
+    blk->kind = BLOCK_DOUBLE;
+}
+
+/**
+ * Checks if a block holds numbers
+ * @param blk The block to check
+ * @return Whether the block is BLOCK_INT or BLOCK_DOUBLE
+ */
+static inline bool is_numeric(const batch_block *blk) {
+    return blk->kind == BLOCK_INT || blk->kind == BLOCK_DOUBLE;
+}
+
+/**
+ * Loads the rows of a block from an input column
+ * @param blk The block to load into
+ * @param col The column
+ * @param start The first row of the block
+ * @param n Number of lanes
+ * @param failed Which lanes have failed
+ */
+static void load_column(batch_block *blk, const column *col, size_t start, size_t n,
+                        const bool *failed) {
+    switch (col->type) {
+        case COLUMN_INT:
+            blk->kind = BLOCK_INT;
+            memcpy(blk->as.ints, col->as.ints + start, sizeof(int64_t) * n);
+            break;
+        case COLUMN_DOUBLE:
+            blk->kind = BLOCK_DOUBLE;
+            memcpy(blk->as.doubles, col->as.doubles + start, sizeof(double) * n);
+            break;
+        case COLUMN_VALUE:
+            blk->kind = BLOCK_VALUE;
+            memcpy(blk->as.values, col->as.values + start, sizeof(value) * n);
+            narrow(blk, n, failed);
+            break;
+    }
+}
+
+/**
+ * Runs an opcode one lane at a time, for everything the kernels can't do
+ * @param op The opcode
+ * @param a The left (or only) operand, which the result replaces
+ * @param b The right operand, NULL for unary opcodes
+ * @param n Number of lanes
+ * @param failed Which lanes have failed, updated with the lanes that fail now
+ */
+static void run_lanes(uint8_t op, batch_block *a, batch_block *b, size_t n, bool *failed) {
+    widen(a, n);
+    if (b != NULL) { widen(b, n); }
+
+    for (size_t i = 0; i < n; ++i) {
+        if (failed[i]) { continue; }
+
+        value rhs = b == NULL ? nil_value() : b->as.values[i];
+        a->as.values[i] = apply_lane(op, a->as.values[i], rhs, &failed[i]);
+    }
+
+    narrow(a, n, failed);
+}
+
+/**
+ * Runs OP_CONCAT_N one lane at a time. A lane whose operands are all strings copies each
+ * of them once, any other is added up from the left like a chain of OP_ADD.
+ * @param operands The operands' blocks, in order, the first is replaced by the result
+ * @param count The number of operands
+ * @param n Number of lanes
+ * @param failed Which lanes have failed, updated with the lanes that fail now
+ */
+static void concat_lanes(batch_block **operands, uint8_t count, size_t n, bool *failed) {
+    for (uint8_t j = 0; j < count; ++j) {
+        widen(operands[j], n);
+    }
+
+    value *out = operands[0]->as.values;
+    value lane[UINT8_MAX];
+
+    for (size_t i = 0; i < n; ++i) {
+        if (failed[i]) { continue; }
+
+        bool strings = true;
+        for (uint8_t j = 0; j < count; ++j) {
+            lane[j] = operands[j]->as.values[i];
+            strings &= is_string(lane[j]);
+        }
+
+        if (strings) {
+            out[i] = object_value((object *)concatenate_values(lane, count));
+            continue;
+        }
+
+        for (uint8_t j = 1; j < count && !failed[i]; ++j) {
+            out[i] = apply_lane(OP_ADD, out[i], lane[j], &failed[i]);
+        }
+    }
+
+    narrow(operands[0], n, failed);
+}
+
+/**
+ * Multiplies integer lanes
+ * @param out Where the products go, may be the same array as `a` or `b`
+ * @param a The left operands
+ * @param b The right operands
+ * @param n Number of lanes
+ * @return False if any lane overflowed or should be -0, which only a double can hold
+ */
+static bool multiply_int_lanes(int64_t *out, const int64_t *a, const int64_t *b, size_t n) {
+    bool exact = true;
+
+    for (size_t i = 0; i < n; ++i) {
+        int64_t res;
+        exact &= !__builtin_mul_overflow(a[i], b[i], &res);
+        exact &= res != 0 || (a[i] >= 0 && b[i] >= 0);
+        out[i] = res;
+    }
+
+    return exact;
+}
+
+/**
+ * Compares integer lanes exactly
+ * @param op OP_GREATER, OP_LESS or OP_EQUAL
+ * @param out Where the results go
+ * @param a The left operands
+ * @param b The right operands
+ * @param n Number of lanes
+ */
+static void compare_int_lanes(uint8_t op, bool *out, const int64_t *a, const int64_t *b,
+                              size_t n) {
+    switch (op) {
+        case OP_GREATER:
+            for (size_t i = 0; i < n; ++i) {
+                out[i] = a[i] > b[i];
+            }
+            break;
+        case OP_LESS:
+            for (size_t i = 0; i < n; ++i) {
+                out[i] = a[i] < b[i];
+            }
+            break;
+        default:
+            for (size_t i = 0; i < n; ++i) {
+                out[i] = a[i] == b[i];
+            }
+            break;
+    }
+}
+
+/**
+ * Runs OP_ADD, OP_SUBTRACT or OP_MULTIPLY across a block with the kernels
+ * @param op The opcode
+ * @param a Slot of the left operand, which the result replaces
+ * @param b The right operand
+ * @param spare Slot of a block the integer kernels write into, so the operands survive
+ * an overflow. Swapped with `a` if it's used
+ * @param n Number of lanes
+ * @return False if the lanes have to be run one at a time instead
+ */
+static bool arithmetic_block(uint8_t op, batch_block **a, batch_block *b, batch_block **spare,
+                             size_t n) {
+    batch_block *lhs = *a;
+
+    if (lhs->kind == BLOCK_INT && b->kind == BLOCK_INT) {
+        int64_t *out = (*spare)->as.ints;
+        bool exact;
+
+        switch (op) {
+            case OP_ADD: exact = g_batch_kernels.add_ints(out, lhs->as.ints, b->as.ints, n); break;
+            case OP_SUBTRACT:
+                exact = g_batch_kernels.subtract_ints(out, lhs->as.ints, b->as.ints, n);
+                break;
+            default: exact = multiply_int_lanes(out, lhs->as.ints, b->as.ints, n); break;
+        }
+
+        if (!exact) { return false; }
+
+        (*spare)->kind = BLOCK_INT;
+        *a = *spare;
+        *spare = lhs;
+        return true;
+    }
+
+    if (!is_numeric(lhs) || !is_numeric(b)) { return false; }
+
+    to_doubles(lhs, n);
+    to_doubles(b, n);
+
+    double *out = lhs->as.doubles;
+
+    switch (op) {
+        case OP_ADD: g_batch_kernels.add(out, out, b->as.doubles, n); break;
+        case OP_SUBTRACT: g_batch_kernels.subtract(out, out, b->as.doubles, n); break;
+        default: g_batch_kernels.multiply(out, out, b->as.doubles, n); break;
+    }
+
+    return true;
+}
+
+/**
+ * Runs OP_CONCAT_N over blocks of numbers, adding them up from the left like a chain of
+ * OP_ADD
+ * @param operands Slots of the operands, in order, the first is replaced by the sum
+ * @param count The number of operands
+ * @param spare Slot of a block the integer kernels write into, see `arithmetic_block`
+ * @param n Number of lanes
+ * @param failed Which lanes have failed, updated with the lanes that fail now
+ * @return False if any operand isn't a block of numbers, which leaves them all untouched
+ */
+static bool add_blocks(batch_block **operands, uint8_t count, batch_block **spare, size_t n,
+                       bool *failed) {
+    for (uint8_t j = 0; j < count; ++j) {
+        if (!is_numeric(operands[j])) { return false; }
+    }
+
+    for (uint8_t j = 1; j < count; ++j) {
+        if (!arithmetic_block(OP_ADD, &operands[0], operands[j], spare, n)) {
+            run_lanes(OP_ADD, operands[0], operands[j], n, failed);
+        }
+    }
+
+    return true;
+}
+
+/**
+ * Runs OP_GREATER, OP_LESS or OP_EQUAL across a block with the kernels
+ * @param op The opcode
+ * @param a The left operand, which the result replaces
+ * @param b The right operand
+ * @param scratch Space for BATCH_BLOCK results
+ * @param n Number of lanes
+ * @return False if the lanes have to be run one at a time instead
+ */
+static bool compare_block(uint8_t op, batch_block *a, batch_block *b, bool *scratch, size_t n) {
+    if (a->kind == BLOCK_INT && b->kind == BLOCK_INT) {
+        compare_int_lanes(op, scratch, a->as.ints, b->as.ints, n);
+    } else if (op == OP_EQUAL) {
+        if (a->kind == BLOCK_VALUE || b->kind == BLOCK_VALUE) { return false; }
+
+        if (a->kind == BLOCK_DOUBLE && b->kind == BLOCK_DOUBLE) {
+            g_batch_kernels.equal(scratch, a->as.doubles, b->as.doubles, n);
+        } else if (a->kind == BLOCK_BOOL && b->kind == BLOCK_BOOL) {
+            for (size_t i = 0; i < n; ++i) {
+                scratch[i] = a->as.bools[i] == b->as.bools[i];
+            }
+        } else if (is_numeric(a) && is_numeric(b)) {
+            // integers and doubles compare exactly, which the lanes know how to do
+            return false;
+        } else {
+            // Lox doesn't implicitly convert types for comparisons
+            memset(scratch, false, n);
+        }
+    } else {
+        // integers compare exactly against doubles, which the lanes know how to do
+        if (a->kind != BLOCK_DOUBLE || b->kind != BLOCK_DOUBLE) { return false; }
+
+        if (op == OP_GREATER) {
+            g_batch_kernels.greater(scratch, a->as.doubles, b->as.doubles, n);
+        } else {
+            g_batch_kernels.less(scratch, a->as.doubles, b->as.doubles, n);
+        }
+    }
+
+    a->kind = BLOCK_BOOL;
+    memcpy(a->as.bools, scratch, n);
+    return true;
+}
+
+/**
+ * Runs OP_NOT or OP_NEGATE across a block
+ * @param op The opcode
+ * @param a The operand, which the result replaces
+ * @param n Number of lanes
+ * @return False if the lanes have to be run one at a time instead
+ */
+static bool unary_block(uint8_t op, batch_block *a, size_t n) {
+    if (op == OP_NOT) {
+        switch (a->kind) {
+            case BLOCK_BOOL:
+                for (size_t i = 0; i < n; ++i) {
+                    a->as.bools[i] = !a->as.bools[i];
+                }
+                return true;
+            case BLOCK_INT:
+            case BLOCK_DOUBLE:
+                // numbers are never falsey
+                a->kind = BLOCK_BOOL;
+                memset(a->as.bools, false, n);
+                return true;
+            default: return false;
+        }
+    }
+
+    switch (a->kind) {
+        case BLOCK_INT: {
+            // 0 and INT64_MIN have no integer negation, -0 has to be a double
+            bool exact = true;
+            for (size_t i = 0; i < n; ++i) {
+                exact &= a->as.ints[i] != 0 && a->as.ints[i] != INT64_MIN;
+            }
+
+            if (!exact) { return false; }
+
+            for (size_t i = 0; i < n; ++i) {
+                a->as.ints[i] = -a->as.ints[i];
+            }
+            return true;
+        }
+        case BLOCK_DOUBLE:
+            for (size_t i = 0; i < n; ++i) {
+                a->as.doubles[i] = -a->as.doubles[i];
+            }
+            return true;
+        default: return false;
+    }
+}
+
+/**
+ * Writes the result of every lane of a block
+ * @param blk The block holding the result
+ * @param out Where the results go
+ * @param n Number of lanes
+ * @param failed Which lanes have failed, their result is nil
+ */
+static void store_results(const batch_block *blk, value *out, size_t n, const bool *failed) {
+    for (size_t i = 0; i < n; ++i) {
+        switch (blk->kind) {
+            case BLOCK_INT: out[i] = int_value(blk->as.ints[i]); break;
+            case BLOCK_DOUBLE: out[i] = number_value(blk->as.doubles[i]); break;
+            case BLOCK_BOOL: out[i] = bool_value(blk->as.bools[i]); break;
+            case BLOCK_VALUE: out[i] = blk->as.values[i]; break;
+        }
+
+        if (failed[i]) { out[i] = nil_value(); }
+    }
+}
+
+/**
+ * Evaluates a program over one block of rows
+ * @param prog The program
+ * @param columns The input columns
+ * @param start The first row of the block
+ * @param n Number of rows in the block
+ * @param out Where the results of the block's rows go
+ */
+static void run_block(batch_program *prog, const column *columns, size_t start, size_t n,
+                      value *out) {
+    const value *constants = prog->chunk.constant_pool.values;
+    const uint8_t *pc = prog->chunk.code;
+    batch_block **top = prog->stack;
+    batch_block **spare = &prog->stack[prog->chunk.max_depth];
+    bool *failed = prog->failed;
+
+    memset(failed, false, n);
+
+    while (true) {
+        // the kernels check types once per block, so the unchecked opcodes gain nothing here
+        uint8_t op = checked_op(pc[0]);
+        uint8_t operand = pc[1];
+        pc += INSTRUCTION_SIZE;
+
+        switch (op) {
+            case OP_LOAD_CONST:
+                broadcast(*top++, constants[read_word(pc)], n);
+                pc += 2;
+                break;
+            case OP_LOAD_CONST_LONG:
+                broadcast(*top++, constants[read_word(pc) | (size_t)read_word(pc + 2) << 16u], n);
+                pc += 4;
+                break;
+            case OP_LOAD_INT:
+                broadcast(*top++, int_value((int16_t)read_word(pc)), n);
+                pc += 2;
+                break;
+            case OP_LOAD_INPUT: load_column(*top++, &columns[operand], start, n, failed); break;
+            case OP_NIL: broadcast(*top++, nil_value(), n); break;
+            case OP_TRUE: broadcast(*top++, bool_value(true), n); break;
+            case OP_FALSE: broadcast(*top++, bool_value(false), n); break;
+            case OP_NOT:
+            case OP_NEGATE:
+                if (!unary_block(op, top[-1], n)) { run_lanes(op, top[-1], NULL, n, failed); }
+                break;
+            case OP_ADD:
+            case OP_SUBTRACT:
+            case OP_MULTIPLY:
+                --top;
+                if (!arithmetic_block(op, &top[-1], top[0], spare, n)) {
+                    run_lanes(op, top[-1], top[0], n, failed);
+                }
+                break;
+            case OP_DIVIDE:
+                --top;
+                if (is_numeric(top[-1]) && is_numeric(top[0])) {
+                    to_doubles(top[-1], n);
+                    to_doubles(top[0], n);
+                    g_batch_kernels.divide(top[-1]->as.doubles, top[-1]->as.doubles,
+                                           top[0]->as.doubles, n);
+                } else {
+                    run_lanes(op, top[-1], top[0], n, failed);
+                }
+                break;
+            case OP_EQUAL:
+            case OP_GREATER:
+            case OP_LESS:
+                --top;
+                if (!compare_block(op, top[-1], top[0], prog->scratch, n)) {
+                    run_lanes(op, top[-1], top[0], n, failed);
+                }
+                break;
+            case OP_CONCAT_N:
+                top -= operand - 1;
+                if (!add_blocks(&top[-1], operand, spare, n, failed)) {
+                    concat_lanes(&top[-1], operand, n, failed);
+                }
+                break;
+            case OP_RETURN: store_results(top[-1], out, n, failed); return;
+        }
+    }
+}
+
+/**
+ * Checks that a chunk only does what `run_block` can run across a whole block: no calls,
+ * branches, locals or instances
+ * @param c The chunk, verified
+ * @return Whether every instruction is one `run_block` handles
+ */
+static bool is_straight_line(const chunk *c) {
+    for (size_t i = 0; i < c->size; i += instruction_size(c->code[i])) {
+        switch (c->code[i]) {
+            case OP_GET_LOCAL:
+            case OP_CALL:
+            case OP_INSTANCE:
+            case OP_GET_PROPERTY:
+            case OP_SET_PROPERTY:
+            case OP_DEFINE_PROPERTY:
+            case OP_JUMP:
+            case OP_JUMP_IF_FALSE:
+            case OP_POP: return false;
+            default: break;
+        }
+    }
+
+    return true;
+}
+
+batch_compile_result compile_batch(batch_program *prog, const char *source,
+                                   const char *const *inputs, size_t input_count) {
+    init_chunk(&prog->chunk);
+    prog->input_count = input_count;
+    prog->blocks = NULL;
+    prog->stack = NULL;
+    prog->failed = NULL;
+    prog->scratch = NULL;
+
+    init_batch_kernels();
+
+    if (!compile_with_inputs(source, &prog->chunk, inputs, input_count)) {
+        return BATCH_COMPILE_ERROR;
+    }
+
+    if (!is_straight_line(&prog->chunk)) { return BATCH_UNSUPPORTED; }
+
+    // one more block than the stack needs, for the spare `arithmetic_block` writes into
+    size_t blocks = prog->chunk.max_depth + 1;
+    prog->blocks = ALLOCATE(batch_block, blocks);
+    prog->stack = ALLOCATE(batch_block *, blocks);
+
+    for (size_t i = 0; i < blocks; ++i) {
+        prog->stack[i] = &prog->blocks[i];
+    }
+
+    prog->failed = ALLOCATE(bool, 2 * BATCH_BLOCK);
+    prog->scratch = prog->failed + BATCH_BLOCK;
+
+    return BATCH_COMPILED;
+}
+
+size_t run_batch(batch_program *prog, const column *columns, size_t rows, value *out,
+                 bool *failed) {
+    size_t failures = 0;
+
+    for (size_t start = 0; start < rows; start += BATCH_BLOCK) {
+        size_t n = rows - start < BATCH_BLOCK ? rows - start : BATCH_BLOCK;
+        run_block(prog, columns, start, n, out + start);
+
+        for (size_t i = 0; i < n; ++i) {
+            failures += prog->failed[i];
+        }
+
+        if (failed != NULL) { memcpy(failed + start, prog->failed, n); }
+    }
+
+    return failures;
+}
+
+void free_batch(batch_program *prog) {
+    size_t blocks = prog->blocks == NULL ? 0 : prog->chunk.max_depth + 1;
+
+    FREE_ARRAY(prog->blocks, batch_block, blocks);
+    FREE_ARRAY(prog->stack, batch_block *, blocks);
+    FREE_ARRAY(prog->failed, bool, prog->failed == NULL ? 0 : 2 * BATCH_BLOCK);
+    free_chunk(&prog->chunk);
+
+    prog->blocks = NULL;
+    prog->stack = NULL;
+    prog->failed = NULL;
+    prog->scratch = NULL;
+}
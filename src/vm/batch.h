@@ -0,0 +1,107 @@
+#pragma once
+
+#include "chunk.h"
+
+/** Rows evaluated together, every opcode runs across a block of this many lanes */
+#define BATCH_BLOCK 1024
+
+/** How the values of an input column are stored */
+typedef enum column_type {
+    /** Every row is an integer, as if it were a VAL_INT */
+    COLUMN_INT,
+
+    /** Every row is a double, as if it were a VAL_NUMBER */
+    COLUMN_DOUBLE,
+
+    /** Rows are arbitrary values */
+    COLUMN_VALUE,
+} column_type;
+
+/**
+ * The values of one input for every row, the n-th input of an expression is read
+ * from the n-th column
+ */
+typedef struct column {
+    /** Tag for the variant */
+    column_type type;
+
+    /** The rows, not owned by the column */
+    union {
+        const int64_t *ints;
+        const double *doubles;
+        const value *values;
+    } as;
+} column;
+
+/** A block of lanes on the batch evaluator's stack, private to batch.c */
+typedef struct batch_block batch_block;
+
+/**
+ * An expression compiled once and evaluated over many rows of inputs. Opcodes run
+ * across whole blocks of rows through the kernels in batch_simd.h, falling back to
+ * one lane at a time for mixed types, integer overflow and runtime errors.
+ */
+typedef struct batch_program {
+    /** The compiled expression */
+    chunk chunk;
+
+    /** Number of inputs, and so of columns `run_batch` expects */
+    size_t input_count;
+
+    /** Storage for the evaluation stack, one more block than `chunk.max_depth` */
+    batch_block *blocks;
+
+    /**
+     * The evaluation stack, pointers into `blocks`. Some opcodes write their result
+     * into their right operand's block and swap the two pointers.
+     */
+    batch_block **stack;
+
+    /** Which lanes of the current block have hit a runtime error */
+    bool *failed;
+
+    /** Space for comparison results, BATCH_BLOCK lanes */
+    bool *scratch;
+} batch_program;
+
+/** The outcome of `compile_batch` */
+typedef enum batch_compile_result {
+    /** The program is ready to run */
+    BATCH_COMPILED,
+
+    /** The expression doesn't compile, the compiler has reported why */
+    BATCH_COMPILE_ERROR,
+
+    /** The expression compiles, but calls, 'and', 'or' and instances can't run in batches */
+    BATCH_UNSUPPORTED,
+} batch_compile_result;
+
+/**
+ * Compiles an expression for batch evaluation
+ * @param prog The program to compile into, free it with `free_batch` even on failure
+ * @param source The Lox expression
+ * @param inputs Names of the inputs the expression can refer to
+ * @param input_count Number of inputs, at most MAX_INPUTS
+ * @return Whether the compilation was successful, and if not why
+ */
+batch_compile_result compile_batch(batch_program *prog, const char *source,
+                                   const char *const *inputs, size_t input_count);
+
+/**
+ * Evaluates a program over every row of its inputs. Strings the expression creates are
+ * put on the VM's object list, like they would be by `run_chunk`.
+ * @param prog The compiled program
+ * @param columns One column per input, each with at least `rows` rows
+ * @param rows Number of rows to evaluate
+ * @param out Where the result of each row is written
+ * @param failed Set for each row that hit a runtime error, whose result is nil. May be NULL
+ * @return The number of rows that hit a runtime error
+ */
+size_t run_batch(batch_program *prog, const column *columns, size_t rows, value *out,
+                 bool *failed);
+
+/**
+ * Frees a batch program
+ * @param prog The program to free
+ */
+void free_batch(batch_program *prog);
@@ -0,0 +1,338 @@
+#include "batch_simd.h"
+#include "../common/cpu.h"
+
+#if CPU_HAS_X86
+#include <immintrin.h>
+#endif
+
+/** Generates a scalar kernel for an arithmetic operator */
+#define DEFINE_ARITHMETIC_SCALAR(name, op)                                                         \
+    static void name(double *out, const double *a, const double *b, size_t n) {                    \
+        for (size_t i = 0; i < n; ++i) {                                                           \
+            out[i] = a[i] op b[i];                                                                 \
+        }                                                                                          \
+    }
+
+/** Generates a scalar kernel for a comparison operator */
+#define DEFINE_COMPARISON_SCALAR(name, op)                                                         \
+    static void name(bool *out, const double *a, const double *b, size_t n) {                      \
+        for (size_t i = 0; i < n; ++i) {                                                           \
+            out[i] = a[i] op b[i];                                                                 \
+        }                                                                                          \
+    }
+
+/** Generates a scalar kernel for checked integer arithmetic */
+#define DEFINE_CHECKED_SCALAR(name, builtin)                                                       \
+    static bool name(int64_t *out, const int64_t *a, const int64_t *b, size_t n) {                 \
+        bool overflow = false;                                                                     \
+                                                                                                   \
+        for (size_t i = 0; i < n; ++i) {                                                           \
+            overflow |= builtin(a[i], b[i], &out[i]);                                              \
+        }                                                                                          \
+                                                                                                   \
+        return !overflow;                                                                          \
+    }
+
+DEFINE_ARITHMETIC_SCALAR(add_scalar, +)
+DEFINE_ARITHMETIC_SCALAR(subtract_scalar, -)
+DEFINE_ARITHMETIC_SCALAR(multiply_scalar, *)
+DEFINE_ARITHMETIC_SCALAR(divide_scalar, /)
+DEFINE_COMPARISON_SCALAR(greater_scalar, >)
+DEFINE_COMPARISON_SCALAR(less_scalar, <)
+DEFINE_COMPARISON_SCALAR(equal_scalar, ==)
+DEFINE_CHECKED_SCALAR(add_ints_scalar, __builtin_add_overflow)
+DEFINE_CHECKED_SCALAR(subtract_ints_scalar, __builtin_sub_overflow)
+
+#if CPU_HAS_X86
+
+/**
+ * Generates a vector kernel for an arithmetic operator. The lanes left over after the
+ * last whole vector go through the scalar operator.
+ */
+#define DEFINE_ARITHMETIC_KERNEL(name, attr, width, load, store, vec_op, op)                       \
+    attr static void name(double *out, const double *a, const double *b, size_t n) {               \
+        size_t i = 0;                                                                              \
+                                                                                                   \
+        for (; i + (width) <= n; i += (width)) {                                                   \
+            store(out + i, vec_op(load(a + i), load(b + i)));                                      \
+        }                                                                                          \
+                                                                                                   \
+        for (; i < n; ++i) {                                                                       \
+            out[i] = a[i] op b[i];                                                                 \
+        }                                                                                          \
+    }
+
+/** Generates a vector kernel for a comparison, `compare` returns one bit per lane */
+#define DEFINE_COMPARISON_KERNEL(name, attr, width, compare, op)                                   \
+    attr static void name(bool *out, const double *a, const double *b, size_t n) {                 \
+        size_t i = 0;                                                                              \
+                                                                                                   \
+        for (; i + (width) <= n; i += (width)) {                                                   \
+            unsigned mask = compare(a + i, b + i);                                                 \
+                                                                                                   \
+            for (size_t lane = 0; lane < (width); ++lane) {                                        \
+                out[i + lane] = (mask >> lane) & 1u;                                               \
+            }                                                                                      \
+        }                                                                                          \
+                                                                                                   \
+        for (; i < n; ++i) {                                                                       \
+            out[i] = a[i] op b[i];                                                                 \
+        }                                                                                          \
+    }
+
+/**
+ * Generates a vector kernel for wrapping integer arithmetic. `step` does one vector
+ * of lanes and returns a vector whose sign bits mark the lanes that overflowed, which
+ * are OR-ed together and only tested once at the end.
+ */
+#define DEFINE_CHECKED_KERNEL(name, attr, vec, width, zero, step, any, signs, builtin)             \
+    attr static bool name(int64_t *out, const int64_t *a, const int64_t *b, size_t n) {            \
+        size_t i = 0;                                                                              \
+        vec overflow = zero();                                                                     \
+        bool tail_overflow = false;                                                                \
+                                                                                                   \
+        for (; i + (width) <= n; i += (width)) {                                                   \
+            overflow = any(overflow, step(out + i, a + i, b + i));                                 \
+        }                                                                                          \
+                                                                                                   \
+        for (; i < n; ++i) {                                                                       \
+            tail_overflow |= builtin(a[i], b[i], &out[i]);                                         \
+        }                                                                                          \
+                                                                                                   \
+        return !tail_overflow && signs(overflow) == 0;                                             \
+    }
+
+// SSE2 is part of the x86-64 baseline, so these need no target attribute
+
+static inline unsigned greater_sse2(const double *a, const double *b) {
+    return (unsigned)_mm_movemask_pd(_mm_cmpgt_pd(_mm_loadu_pd(a), _mm_loadu_pd(b)));
+}
+
+static inline unsigned less_sse2(const double *a, const double *b) {
+    return (unsigned)_mm_movemask_pd(_mm_cmplt_pd(_mm_loadu_pd(a), _mm_loadu_pd(b)));
+}
+
+static inline unsigned equal_sse2(const double *a, const double *b) {
+    return (unsigned)_mm_movemask_pd(_mm_cmpeq_pd(_mm_loadu_pd(a), _mm_loadu_pd(b)));
+}
+
+static inline __m128i add_ints_sse2(int64_t *out, const int64_t *a, const int64_t *b) {
+    __m128i va = _mm_loadu_si128((const __m128i *)a);
+    __m128i vb = _mm_loadu_si128((const __m128i *)b);
+    __m128i sum = _mm_add_epi64(va, vb);
+    _mm_storeu_si128((__m128i *)out, sum);
+
+    // overflowed if both operands have the same sign and the sum doesn't
+    return _mm_and_si128(_mm_xor_si128(va, sum), _mm_xor_si128(vb, sum));
+}
+
+static inline __m128i subtract_ints_sse2(int64_t *out, const int64_t *a, const int64_t *b) {
+    __m128i va = _mm_loadu_si128((const __m128i *)a);
+    __m128i vb = _mm_loadu_si128((const __m128i *)b);
+    __m128i diff = _mm_sub_epi64(va, vb);
+    _mm_storeu_si128((__m128i *)out, diff);
+
+    // overflowed if the operands have different signs and the difference has b's sign
+    return _mm_and_si128(_mm_xor_si128(va, vb), _mm_xor_si128(va, diff));
+}
+
+static inline int signs_sse2(__m128i v) {
+    return _mm_movemask_pd(_mm_castsi128_pd(v));
+}
+
+DEFINE_ARITHMETIC_KERNEL(add_block_sse2, , 2, _mm_loadu_pd, _mm_storeu_pd, _mm_add_pd, +)
+DEFINE_ARITHMETIC_KERNEL(subtract_block_sse2, , 2, _mm_loadu_pd, _mm_storeu_pd, _mm_sub_pd, -)
+DEFINE_ARITHMETIC_KERNEL(multiply_block_sse2, , 2, _mm_loadu_pd, _mm_storeu_pd, _mm_mul_pd, *)
+DEFINE_ARITHMETIC_KERNEL(divide_block_sse2, , 2, _mm_loadu_pd, _mm_storeu_pd, _mm_div_pd, /)
+DEFINE_COMPARISON_KERNEL(greater_block_sse2, , 2, greater_sse2, >)
+DEFINE_COMPARISON_KERNEL(less_block_sse2, , 2, less_sse2, <)
+DEFINE_COMPARISON_KERNEL(equal_block_sse2, , 2, equal_sse2, ==)
+DEFINE_CHECKED_KERNEL(add_ints_block_sse2, , __m128i, 2, _mm_setzero_si128, add_ints_sse2,
+                      _mm_or_si128, signs_sse2, __builtin_add_overflow)
+DEFINE_CHECKED_KERNEL(subtract_ints_block_sse2, , __m128i, 2, _mm_setzero_si128,
+                      subtract_ints_sse2, _mm_or_si128, signs_sse2, __builtin_sub_overflow)
+
+#define AVX2 __attribute__((target("avx2")))
+
+AVX2 static inline __m256d load_avx2(const double *p) {
+    return _mm256_loadu_pd(p);
+}
+
+AVX2 static inline void store_avx2(double *p, __m256d v) {
+    _mm256_storeu_pd(p, v);
+}
+
+AVX2 static inline __m256d add_avx2(__m256d a, __m256d b) {
+    return _mm256_add_pd(a, b);
+}
+
+AVX2 static inline __m256d subtract_avx2(__m256d a, __m256d b) {
+    return _mm256_sub_pd(a, b);
+}
+
+AVX2 static inline __m256d multiply_avx2(__m256d a, __m256d b) {
+    return _mm256_mul_pd(a, b);
+}
+
+AVX2 static inline __m256d divide_avx2(__m256d a, __m256d b) {
+    return _mm256_div_pd(a, b);
+}
+
+// the ordered predicates are false for NaN, matching the C operators
+AVX2 static inline unsigned greater_avx2(const double *a, const double *b) {
+    return (unsigned)_mm256_movemask_pd(_mm256_cmp_pd(load_avx2(a), load_avx2(b), _CMP_GT_OQ));
+}
+
+AVX2 static inline unsigned less_avx2(const double *a, const double *b) {
+    return (unsigned)_mm256_movemask_pd(_mm256_cmp_pd(load_avx2(a), load_avx2(b), _CMP_LT_OQ));
+}
+
+AVX2 static inline unsigned equal_avx2(const double *a, const double *b) {
+    return (unsigned)_mm256_movemask_pd(_mm256_cmp_pd(load_avx2(a), load_avx2(b), _CMP_EQ_OQ));
+}
+
+AVX2 static inline __m256i add_ints_avx2(int64_t *out, const int64_t *a, const int64_t *b) {
+    __m256i va = _mm256_loadu_si256((const __m256i *)a);
+    __m256i vb = _mm256_loadu_si256((const __m256i *)b);
+    __m256i sum = _mm256_add_epi64(va, vb);
+    _mm256_storeu_si256((__m256i *)out, sum);
+
+    return _mm256_and_si256(_mm256_xor_si256(va, sum), _mm256_xor_si256(vb, sum));
+}
+
+AVX2 static inline __m256i subtract_ints_avx2(int64_t *out, const int64_t *a, const int64_t *b) {
+    __m256i va = _mm256_loadu_si256((const __m256i *)a);
+    __m256i vb = _mm256_loadu_si256((const __m256i *)b);
+    __m256i diff = _mm256_sub_epi64(va, vb);
+    _mm256_storeu_si256((__m256i *)out, diff);
+
+    return _mm256_and_si256(_mm256_xor_si256(va, vb), _mm256_xor_si256(va, diff));
+}
+
+AVX2 static inline __m256i zero_avx2() {
+    return _mm256_setzero_si256();
+}
+
+AVX2 static inline __m256i or_avx2(__m256i a, __m256i b) {
+    return _mm256_or_si256(a, b);
+}
+
+AVX2 static inline int signs_avx2(__m256i v) {
+    return _mm256_movemask_pd(_mm256_castsi256_pd(v));
+}
+
+DEFINE_ARITHMETIC_KERNEL(add_block_avx2, AVX2, 4, load_avx2, store_avx2, add_avx2, +)
+DEFINE_ARITHMETIC_KERNEL(subtract_block_avx2, AVX2, 4, load_avx2, store_avx2, subtract_avx2, -)
+DEFINE_ARITHMETIC_KERNEL(multiply_block_avx2, AVX2, 4, load_avx2, store_avx2, multiply_avx2, *)
+DEFINE_ARITHMETIC_KERNEL(divide_block_avx2, AVX2, 4, load_avx2, store_avx2, divide_avx2, /)
+DEFINE_COMPARISON_KERNEL(greater_block_avx2, AVX2, 4, greater_avx2, >)
+DEFINE_COMPARISON_KERNEL(less_block_avx2, AVX2, 4, less_avx2, <)
+DEFINE_COMPARISON_KERNEL(equal_block_avx2, AVX2, 4, equal_avx2, ==)
+DEFINE_CHECKED_KERNEL(add_ints_block_avx2, AVX2, __m256i, 4, zero_avx2, add_ints_avx2, or_avx2,
+                      signs_avx2, __builtin_add_overflow)
+DEFINE_CHECKED_KERNEL(subtract_ints_block_avx2, AVX2, __m256i, 4, zero_avx2, subtract_ints_avx2,
+                      or_avx2, signs_avx2, __builtin_sub_overflow)
+
+#undef AVX2
+
+#endif
+
+static const batch_kernels s_scalar_kernels = {
+    add_scalar,
+    subtract_scalar,
+    multiply_scalar,
+    divide_scalar,
+    greater_scalar,
+    less_scalar,
+    equal_scalar,
+    add_ints_scalar,
+    subtract_ints_scalar,
+};
+
+batch_kernels g_batch_kernels = {
+    add_scalar,
+    subtract_scalar,
+    multiply_scalar,
+    divide_scalar,
+    greater_scalar,
+    less_scalar,
+    equal_scalar,
+    add_ints_scalar,
+    subtract_ints_scalar,
+};
+
+static batch_isa s_active_isa = BATCH_ISA_SCALAR;
+
+/** The best instruction set the CPU supports, or -1 if the CPU hasn't been queried */
+static int s_best_isa = -1;
+
+/**
+ * Queries the CPU for the best instruction set it supports
+ * @return The best supported instruction set
+ */
+static batch_isa best_isa() {
+    if (s_best_isa < 0) {
+#if CPU_HAS_X86
+        s_best_isa = cpu_has_avx2() ? BATCH_ISA_AVX2 : BATCH_ISA_SSE2;
+#else
+        s_best_isa = BATCH_ISA_SCALAR;
+#endif
+    }
+
+    return (batch_isa)s_best_isa;
+}
+
+void init_batch_kernels() {
+    if (s_best_isa < 0) { select_batch_isa(best_isa()); }
+}
+
+bool select_batch_isa(batch_isa isa) {
+    if (isa > best_isa()) { return false; }
+
+    switch (isa) {
+        case BATCH_ISA_SCALAR: g_batch_kernels = s_scalar_kernels; break;
+#if CPU_HAS_X86
+        case BATCH_ISA_SSE2: {
+            batch_kernels sse2 = {
+                add_block_sse2,
+                subtract_block_sse2,
+                multiply_block_sse2,
+                divide_block_sse2,
+                greater_block_sse2,
+                less_block_sse2,
+                equal_block_sse2,
+                add_ints_block_sse2,
+                subtract_ints_block_sse2,
+            };
+
+            g_batch_kernels = sse2;
+            break;
+        }
+        case BATCH_ISA_AVX2: {
+            batch_kernels avx2 = {
+                add_block_avx2,
+                subtract_block_avx2,
+                multiply_block_avx2,
+                divide_block_avx2,
+                greater_block_avx2,
+                less_block_avx2,
+                equal_block_avx2,
+                add_ints_block_avx2,
+                subtract_ints_block_avx2,
+            };
+
+            g_batch_kernels = avx2;
+            break;
+        }
+#else
+        default: return false;
+#endif
+    }
+
+    s_active_isa = isa;
+    return true;
+}
+
+batch_isa active_batch_isa() {
+    return s_active_isa;
+}
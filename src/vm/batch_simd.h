@@ -0,0 +1,69 @@
+#pragma once
+
+#include "../common/common.h"
+
+/** The instruction set the batch kernels are running on */
+typedef enum batch_isa { BATCH_ISA_SCALAR, BATCH_ISA_SSE2, BATCH_ISA_AVX2 } batch_isa;
+
+/**
+ * Table of the kernels the batch evaluator runs whole blocks of lanes through.
+ *
+ * Every kernel works on `n` lanes, which don't have to be a multiple of the vector
+ * width, and `out` may be the same array as `a`. The inputs don't need any alignment.
+ */
+typedef struct batch_kernels {
+    /** out[i] = a[i] + b[i] */
+    void (*add)(double *out, const double *a, const double *b, size_t n);
+
+    /** out[i] = a[i] - b[i] */
+    void (*subtract)(double *out, const double *a, const double *b, size_t n);
+
+    /** out[i] = a[i] * b[i] */
+    void (*multiply)(double *out, const double *a, const double *b, size_t n);
+
+    /** out[i] = a[i] / b[i] */
+    void (*divide)(double *out, const double *a, const double *b, size_t n);
+
+    /** out[i] = a[i] > b[i] */
+    void (*greater)(bool *out, const double *a, const double *b, size_t n);
+
+    /** out[i] = a[i] < b[i] */
+    void (*less)(bool *out, const double *a, const double *b, size_t n);
+
+    /** out[i] = a[i] == b[i] */
+    void (*equal)(bool *out, const double *a, const double *b, size_t n);
+
+    /**
+     * out[i] = a[i] + b[i], wrapping
+     * @return False if any lane overflowed, in which case `out` is garbage
+     */
+    bool (*add_ints)(int64_t *out, const int64_t *a, const int64_t *b, size_t n);
+
+    /**
+     * out[i] = a[i] - b[i], wrapping
+     * @return False if any lane overflowed, in which case `out` is garbage
+     */
+    bool (*subtract_ints)(int64_t *out, const int64_t *a, const int64_t *b, size_t n);
+} batch_kernels;
+
+/** The kernels currently in use */
+extern batch_kernels g_batch_kernels;
+
+/**
+ * Picks the best kernels the running CPU supports. Safe to call more than once,
+ * the CPU is only queried the first time.
+ */
+void init_batch_kernels();
+
+/**
+ * Forces the batch evaluator onto a specific instruction set
+ * @param isa The instruction set to use
+ * @return False (and no change) if the CPU doesn't support `isa`
+ */
+bool select_batch_isa(batch_isa isa);
+
+/**
+ * Gets the instruction set the batch kernels are currently using
+ * @return The active instruction set
+ */
+batch_isa active_batch_isa();
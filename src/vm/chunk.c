@@ -16,12 +16,11 @@ static inline void write_line(chunk *c, size_t line) {
     if (c->lines_size + 2 > c->lines_capacity) {
         int new_cap = grow_capacity(c->lines_capacity);
         c->lines = GROW_ARRAY(c->lines, size_t, c->lines_capacity, new_cap);
-        c->lines[c->lines_size] = 0;
         c->lines_capacity = new_cap;
     }
 
     c->lines_size += 2;
-    c->lines[c->lines_size - 2] += 1;
+    c->lines[c->lines_size - 2] = 1;
     c->lines[c->lines_size - 1] = line;
 }
 
@@ -32,6 +31,15 @@ void init_chunk_with_size(chunk *c, size_t capacity) {
     c->lines = NULL;
     c->lines_capacity = 0;
     c->lines_size = 0;
+    c->frozen = false;
+    c->owned = NULL;
+    c->caches = NULL;
+    c->cache_count = 0;
+    c->cache_capacity = 0;
+    c->cache_generation = 0;
+    c->input_count = 0;
+    c->verified = false;
+    c->max_depth = 0;
 
     init_value_array(&c->constant_pool);
 }
@@ -43,15 +51,31 @@ void init_chunk(chunk *c) {
     c->lines = NULL;
     c->lines_capacity = 0;
     c->lines_size = 0;
+    c->frozen = false;
+    c->owned = NULL;
+    c->caches = NULL;
+    c->cache_count = 0;
+    c->cache_capacity = 0;
+    c->cache_generation = 0;
+    c->input_count = 0;
+    c->verified = false;
+    c->max_depth = 0;
 
     init_value_array(&c->constant_pool);
 }
 
-void write_byte(chunk *c, uint8_t byte, size_t line) {
+/**
+ * Writes a byte to the chunk's code segment
+ * @param c The chunk to write to
+ * @param byte The byte to append
+ * @param line The line that this byte should be associated with
+ */
+static void write_byte(chunk *c, uint8_t byte, size_t line) {
+    assert(!c->frozen && "A frozen chunk can't be written to");
+
     if (c->size + 1 > c->capacity) {
         int new_capacity = grow_capacity(c->capacity);
         c->code = GROW_ARRAY(c->code, uint8_t, c->capacity, new_capacity);
-        c->lines = GROW_ARRAY(c->lines, size_t, c->capacity, new_capacity);
         c->capacity = new_capacity;
     }
 
@@ -60,32 +84,94 @@ void write_byte(chunk *c, uint8_t byte, size_t line) {
     write_line(c, line);
 }
 
+void write_instruction(chunk *c, op_code op, uint8_t operand, size_t line) {
+    write_byte(c, op, line);
+    write_byte(c, operand, line);
+}
+
+void write_word(chunk *c, uint16_t word, size_t line) {
+    uint8_t bytes[sizeof(word)];
+    memcpy(bytes, &word, sizeof(word));
+
+    write_byte(c, bytes[0], line);
+    write_byte(c, bytes[1], line);
+}
+
 void write_constant(chunk *c, value constant, size_t line) {
     size_t offset = add_constant(c, constant);
 
-    if (offset <= UINT8_MAX) {
-        write_byte(c, OP_LOAD_CONST, line);
-        write_byte(c, offset, line);
+    if (offset <= UINT16_MAX) {
+        write_instruction(c, OP_LOAD_CONST, 0, line);
+        write_word(c, (uint16_t)offset, line);
     } else {
-        uint8_t bytes[3];
-        get_bytes(bytes, offset);
-
-        write_byte(c, OP_LOAD_CONST_LONG, line);
-        write_byte(c, bytes[0], line);
-        write_byte(c, bytes[1], line);
-        write_byte(c, bytes[2], line);
+        write_instruction(c, OP_LOAD_CONST_LONG, 0, line);
+        write_word(c, (uint16_t)offset, line);
+        write_word(c, (uint16_t)(offset >> 16u), line);
     }
 }
 
 int add_constant(chunk *c, value constant) {
+    assert(!c->frozen && "A frozen chunk can't be written to");
+
     write_value_array(&c->constant_pool, constant);
 
     return c->constant_pool.size - 1;
 }
 
+void clear_caches(chunk *c) {
+    for (size_t i = 0; i < c->cache_count; ++i) {
+        c->caches[i].count = 0;
+
+        // no instance has a NULL shape, so the newest entry can be checked without the count
+        c->caches[i].entries[0].shape = NULL;
+    }
+}
+
+size_t add_cache(chunk *c, size_t name) {
+    assert(!c->frozen && "A frozen chunk can't be written to");
+
+    if (c->cache_count == c->cache_capacity) {
+        size_t capacity = grow_capacity(c->cache_capacity);
+        c->caches = GROW_ARRAY(c->caches, property_cache, c->cache_capacity, capacity);
+        c->cache_capacity = capacity;
+    }
+
+    property_cache *cache = &c->caches[c->cache_count];
+    cache->name = (uint32_t)name;
+    cache->count = 0;
+    cache->entries[0].shape = NULL;
+
+    return c->cache_count++;
+}
+
+size_t get_line(const chunk *c, size_t offset) {
+    size_t idx = 0;
+
+    // array is lined up as: [ n of bytes with first line number, first line number, ... ]
+    // Read each "number of bytes" and subtract offset by it (and jump forward) until offset
+    // is smaller, at which point the current "number of bytes" is the offset's line number
+    //
+    // see: https://en.wikipedia.org/wiki/Run-length_encoding
+    while (c->lines[idx] < offset + 1) {
+        offset -= c->lines[idx];
+        idx += 2;
+    }
+
+    return c->lines[idx + 1];
+}
+
 void free_chunk(chunk *c) {
+    object *obj = c->owned;
+
+    while (obj != NULL) {
+        object *next = obj->next;
+        free_object(obj);
+        obj = next;
+    }
+
     FREE_ARRAY(c->code, uint8_t, c->capacity);
-    FREE_ARRAY(c->lines, size_t, c->capacity);
+    FREE_ARRAY(c->lines, size_t, c->lines_capacity);
+    FREE_ARRAY(c->caches, property_cache, c->cache_capacity);
     free_value_array(&c->constant_pool);
     init_chunk(c);
 }
\ No newline at end of file
@@ -1,17 +1,28 @@
 #pragma once
 
 #include "../common/common.h"
+#include "shape.h"
 #include "value.h"
 #include <assert.h>
+#include <string.h>
+
+/** Size of an instruction's opcode and one byte operand, every instruction starts with them */
+#define INSTRUCTION_SIZE 2
 
 /**
  * @brief Represents an chunk's "operation code"
- * @details An enum that represents which opcode the current chunk is
+ * @details An enum that represents which opcode the current chunk is. Every instruction
+ * starts at an even offset with its opcode and a one byte operand, which is 0 if it
+ * doesn't take one. Wider operands follow in 16-bit words, which are always aligned.
  */
 typedef enum op_code {
     OP_RETURN,
+    /** Word: index of the constant */
     OP_LOAD_CONST,
+    /** Two words: index of the constant, low half first */
     OP_LOAD_CONST_LONG,
+    /** Word: the integer, signed, loaded without going through the constant pool */
+    OP_LOAD_INT,
     OP_NIL,
     OP_TRUE,
     OP_FALSE,
@@ -24,10 +35,61 @@ typedef enum op_code {
     OP_SUBTRACT,
     OP_MULTIPLY,
     OP_DIVIDE,
+    /** Byte: index of the input */
+    OP_LOAD_INPUT,
+    /** Byte: the slot in the frame */
+    OP_GET_LOCAL,
+    /** Byte: the number of arguments */
+    OP_CALL,
+    OP_INSTANCE,
+    /** Word: index of the access's inline cache */
+    OP_GET_PROPERTY,
+    /** Word: index of the access's inline cache */
+    OP_SET_PROPERTY,
+    /** Word: index of the access's inline cache */
+    OP_DEFINE_PROPERTY,
+    /** Word: how far to jump forward, from the end of the instruction */
+    OP_JUMP,
+    /** Word: how far to jump forward, from the end of the instruction */
+    OP_JUMP_IF_FALSE,
+    OP_POP,
+    /** Byte: the number of operands, at least 2, concatenated at once if they're all strings */
+    OP_CONCAT_N,
+
+    // the compiler only emits these where it has proven every operand is a number, so
+    // they skip the type checks of the opcodes they stand in for
+    OP_ADD_NUM,
+    OP_SUBTRACT_NUM,
+    OP_MULTIPLY_NUM,
+    OP_DIVIDE_NUM,
+    OP_GREATER_NUM,
+    OP_LESS_NUM,
+    OP_NEGATE_NUM,
+
+    /** Number of opcodes, not an instruction */
+    OP_COUNT,
 } __attribute__((__packed__)) op_code;
 
 _Static_assert(sizeof(op_code) == sizeof(uint8_t), "op_code should be same size as byte");
 
+/**
+ * Gets the checked opcode an unchecked OP_*_NUM opcode stands in for
+ * @param op The opcode
+ * @return The checked opcode, or `op` if it isn't an OP_*_NUM opcode
+ */
+static inline uint8_t checked_op(uint8_t op) {
+    switch (op) {
+        case OP_ADD_NUM: return OP_ADD;
+        case OP_SUBTRACT_NUM: return OP_SUBTRACT;
+        case OP_MULTIPLY_NUM: return OP_MULTIPLY;
+        case OP_DIVIDE_NUM: return OP_DIVIDE;
+        case OP_GREATER_NUM: return OP_GREATER;
+        case OP_LESS_NUM: return OP_LESS;
+        case OP_NEGATE_NUM: return OP_NEGATE;
+        default: return op;
+    }
+}
+
 /**
  * @brief Represents a single VM chunk
  * @details Holds the bytes for the chunk and some other information
@@ -56,6 +118,42 @@ typedef struct chunk {
 
     /** The total capacity of the line array */
     size_t lines_capacity;
+
+    /**
+     * Whether the chunk has been frozen by `freeze_chunk`. A frozen chunk is never written
+     * to again, so any number of threads can run it at once
+     */
+    bool frozen;
+
+    /** The objects a frozen chunk's constants took from the VM, linked through `next` */
+    object *owned;
+
+    /** One inline cache per property access, indexed by the access's operand */
+    property_cache *caches;
+
+    /** The number of caches */
+    size_t cache_count;
+
+    /** The capacity of `caches` */
+    size_t cache_capacity;
+
+    /**
+     * The `generation` of the VM that filled the caches. Its shapes are freed with it, and
+     * the caches are emptied before the chunk runs in another VM that may reuse their memory
+     */
+    uint64_t cache_generation;
+
+    /** The number of inputs OP_LOAD_INPUT can load, see `compile_with_inputs` */
+    size_t input_count;
+
+    /**
+     * Whether the chunk has passed `verify_chunk`. Only verified chunks are run, so the VM
+     * never has to check an operand or the room left on the stack while running one
+     */
+    bool verified;
+
+    /** Most values the chunk ever has on the stack, above its frame, once verified */
+    size_t max_depth;
 } chunk;
 
 /**
@@ -72,12 +170,21 @@ void init_chunk(chunk *chunk);
 void init_chunk_with_size(chunk *chunk, size_t capacity);
 
 /**
- * Writes a byte to the chunk's code segment
+ * Writes an instruction's opcode and one byte operand to the chunk's code segment
  * @param chunk The chunk to write to
- * @param byte The byte to append
- * @param line The line that this byte should be associated with
+ * @param op The opcode
+ * @param operand The operand, 0 for instructions that don't take one
+ * @param line The line that the instruction should be associated with
  */
-void write_byte(chunk *chunk, uint8_t byte, size_t line);
+void write_instruction(chunk *chunk, op_code op, uint8_t operand, size_t line);
+
+/**
+ * Writes an operand word after an instruction
+ * @param chunk The chunk to write to
+ * @param word The operand
+ * @param line The line of the instruction the operand belongs to
+ */
+void write_word(chunk *chunk, uint16_t word, size_t line);
 
 /**
  * Writes a CONST_LOAD instruction
@@ -87,6 +194,38 @@ void write_byte(chunk *chunk, uint8_t byte, size_t line);
  */
 void write_constant(chunk *chunk, value constant, size_t line);
 
+/**
+ * Reads an operand word. Operand words always start at an even offset, so this is a
+ * single aligned load
+ * @param code Pointer to the word
+ * @return The operand
+ */
+static inline uint16_t read_word(const uint8_t *code) {
+    uint16_t word;
+    memcpy(&word, __builtin_assume_aligned(code, 2), sizeof(word));
+
+    return word;
+}
+
+/**
+ * Gets the size of an instruction, with its operand words
+ * @param op The instruction's opcode
+ * @return The number of bytes from the opcode to the next instruction
+ */
+static inline size_t instruction_size(uint8_t op) {
+    switch (op) {
+        case OP_LOAD_CONST:
+        case OP_LOAD_INT:
+        case OP_GET_PROPERTY:
+        case OP_SET_PROPERTY:
+        case OP_DEFINE_PROPERTY:
+        case OP_JUMP:
+        case OP_JUMP_IF_FALSE: return INSTRUCTION_SIZE + 2;
+        case OP_LOAD_CONST_LONG: return INSTRUCTION_SIZE + 4;
+        default: return INSTRUCTION_SIZE;
+    }
+}
+
 /**
  * Adds a constant to the chunk's value_array
  * @param chunk The chunk to add the constant to
@@ -96,7 +235,29 @@ void write_constant(chunk *chunk, value constant, size_t line);
 int add_constant(chunk *chunk, value constant);
 
 /**
- * Frees an chunk
+ * Empties every inline cache of a chunk
+ * @param chunk The chunk
+ */
+void clear_caches(chunk *chunk);
+
+/**
+ * Adds an empty inline cache for a property access
+ * @param chunk The chunk the access is in
+ * @param name Index of the property's name in the chunk's constant pool
+ * @return The index of the new cache
+ */
+size_t add_cache(chunk *chunk, size_t name);
+
+/**
+ * Gets the source line that a byte of the chunk was written for
+ * @param chunk The chunk
+ * @param offset The offset of the byte, which must be in the chunk
+ * @return The line the byte is on
+ */
+size_t get_line(const chunk *chunk, size_t offset);
+
+/**
+ * Frees an chunk, and the objects it owns if it's frozen
  * @param chunk The chunk to delete
  */
 void free_chunk(chunk *chunk);
\ No newline at end of file
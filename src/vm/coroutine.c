@@ -0,0 +1,398 @@
+#include "coroutine.h"
+#include "../common/memory.h"
+#include "verifier.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+/** Most readiness events handled by one `epoll_wait` */
+#define MAX_EVENTS 64
+
+/** Size of the guard page below every coroutine's C stack */
+#define GUARD_SIZE 4096u
+
+/** The scheduler running on this thread, for the coroutine entry point */
+static _Thread_local scheduler *s_running = NULL;
+
+/**
+ * Adds a coroutine to the back of the run queue
+ * @param sched The scheduler
+ * @param co The coroutine
+ */
+static void make_ready(scheduler *sched, coroutine *co) {
+    co->next = NULL;
+
+    if (sched->ready_tail == NULL) {
+        sched->ready_head = co;
+    } else {
+        sched->ready_tail->next = co;
+    }
+
+    sched->ready_tail = co;
+}
+
+/**
+ * Takes the coroutine at the front of the run queue
+ * @param sched The scheduler
+ * @return The coroutine, or NULL if none are ready
+ */
+static coroutine *next_ready(scheduler *sched) {
+    coroutine *co = sched->ready_head;
+    if (co == NULL) { return NULL; }
+
+    sched->ready_head = co->next;
+    if (sched->ready_head == NULL) { sched->ready_tail = NULL; }
+
+    return co;
+}
+
+/**
+ * Looks up the coroutines writing to a descriptor, making room for it if needed
+ * @param sched The scheduler
+ * @param fd The descriptor
+ * @return Its entry in `waiters`
+ */
+static fd_waiters *waiters_for(scheduler *sched, size_t fd) {
+    if (fd >= sched->waiters_size) {
+        size_t size = sched->waiters_size;
+        size_t new_size = grow_capacity(size);
+        while (new_size <= fd) {
+            new_size = grow_capacity(new_size);
+        }
+
+        sched->waiters = GROW_ARRAY(sched->waiters, fd_waiters, size, new_size);
+        memset(sched->waiters + size, 0, sizeof(fd_waiters) * (new_size - size));
+        sched->waiters_size = new_size;
+    }
+
+    return &sched->waiters[fd];
+}
+
+/**
+ * Lets go of a coroutine's descriptor, putting its flags back if no other unfinished
+ * coroutine writes to it
+ * @param co The coroutine, finished or about to be freed
+ */
+static void release_fd(coroutine *co) {
+    fd_waiters *waiters = &co->sched->waiters[co->fd];
+
+    if (--waiters->users == 0) { fcntl(co->fd, F_SETFL, waiters->flags); }
+}
+
+/**
+ * Parks the running coroutine until its descriptor is writable, and switches back to
+ * the scheduler
+ * @param co The running coroutine
+ */
+static void wait_writable(coroutine *co) {
+    scheduler *sched = co->sched;
+    fd_waiters *waiters = waiters_for(sched, (size_t)co->fd);
+
+    co->next = waiters->head;
+    waiters->head = co;
+    ++sched->blocked;
+
+    // coroutines writing to the same descriptor share its registration
+    if (!waiters->armed) {
+        struct epoll_event event = {.events = EPOLLOUT | EPOLLONESHOT, .data.fd = co->fd};
+        int op = waiters->registered ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+
+        epoll_ctl(sched->epoll_fd, op, co->fd, &event);
+        waiters->registered = true;
+        waiters->armed = true;
+    }
+
+    swapcontext(&co->context, &sched->context);
+}
+
+/**
+ * The output sink of every coroutine. Writes like `fd_output_sink`, but yields to the
+ * scheduler instead of blocking.
+ * @param ctx The coroutine
+ * @param iov The segments to write
+ * @param count The number of segments
+ */
+static void coroutine_sink(void *ctx, const struct iovec *iov, int count) {
+    coroutine *co = ctx;
+    struct iovec pending[2];
+    char *parked = NULL;
+    size_t parked_len = 0;
+
+    memcpy(pending, iov, sizeof(struct iovec) * count);
+    struct iovec *cur = pending;
+
+    while (count > 0) {
+        ssize_t written = writev(co->fd, cur, count);
+
+        if (written < 0) {
+            if (errno == EINTR) { continue; }
+            if (errno != EAGAIN && errno != EWOULDBLOCK) { break; }
+
+            // the segments can point into `g_vm.out`, which the other coroutines use while
+            // this one waits, so the unwritten bytes are moved aside first
+            if (parked == NULL) {
+                for (int i = 0; i < count; ++i) {
+                    parked_len += cur[i].iov_len;
+                }
+
+                parked = ALLOCATE(char, parked_len);
+                size_t offset = 0;
+
+                for (int i = 0; i < count; ++i) {
+                    memcpy(parked + offset, cur[i].iov_base, cur[i].iov_len);
+                    offset += cur[i].iov_len;
+                }
+
+                cur = pending;
+                cur->iov_base = parked;
+                cur->iov_len = parked_len;
+                count = 1;
+                g_vm.out.len = 0;
+            }
+
+            wait_writable(co);
+            continue;
+        }
+
+        while (count > 0 && (size_t)written >= cur->iov_len) {
+            written -= (ssize_t)cur->iov_len;
+            ++cur;
+            --count;
+        }
+
+        if (count > 0) {
+            cur->iov_base = (char *)cur->iov_base + written;
+            cur->iov_len -= (size_t)written;
+        }
+    }
+
+    if (parked != NULL) { FREE_ARRAY(parked, char, parked_len); }
+}
+
+/**
+ * Checks whether a chunk has any functions it could call
+ * @param c The chunk
+ * @return Whether any of its constants is a function
+ */
+static bool has_functions(const chunk *c) {
+    for (int i = 0; i < c->constant_pool.size; ++i) {
+        if (is_function(c->constant_pool.values[i])) { return true; }
+    }
+
+    return false;
+}
+
+/**
+ * Where every coroutine starts, returning to the scheduler through `uc_link` once the
+ * chunk has run and its output has been written
+ */
+static void coroutine_main() {
+    coroutine *co = s_running->current;
+
+    co->result = run_chunk(co->program);
+    flush_output(&g_vm.out);
+    co->done = true;
+}
+
+/**
+ * Frees a coroutine's stacks, which it doesn't need once it's finished
+ * @param co The coroutine
+ */
+static void free_stacks(coroutine *co) {
+    if (co->c_stack != NULL) { munmap(co->c_stack, COROUTINE_STACK_SIZE + GUARD_SIZE); }
+    FREE_ARRAY(co->stack, value, co->stack_size);
+
+    co->c_stack = NULL;
+    co->stack = NULL;
+}
+
+/**
+ * Switches to a coroutine until it yields or finishes
+ * @param sched The scheduler
+ * @param co The coroutine to run
+ */
+static void resume(scheduler *sched, coroutine *co) {
+    g_vm.chunk = co->chunk;
+    g_vm.pc = co->pc;
+    g_vm.stack = co->stack;
+    g_vm.stack_top = co->stack_top;
+    g_vm.stack_end = co->stack + co->stack_size;
+    // coroutines only yield while printing a chunk's result, with no calls in progress,
+    // so they can all share the thread's frames
+    g_vm.out.sink = coroutine_sink;
+    g_vm.out.ctx = co;
+
+    sched->current = co;
+    swapcontext(&sched->context, &co->context);
+    sched->current = NULL;
+
+    co->chunk = g_vm.chunk;
+    co->pc = g_vm.pc;
+    co->stack_top = g_vm.stack_top;
+
+    if (co->done) {
+        free_stacks(co);
+        release_fd(co);
+    }
+}
+
+/**
+ * Moves the coroutines whose descriptors have become writable onto the run queue
+ * @param sched The scheduler
+ * @param timeout How long to wait in milliseconds, -1 to wait until one is writable
+ */
+static void poll_io(scheduler *sched, int timeout) {
+    struct epoll_event events[MAX_EVENTS];
+    int count = epoll_wait(sched->epoll_fd, events, MAX_EVENTS, timeout);
+
+    for (int i = 0; i < count; ++i) {
+        fd_waiters *waiters = &sched->waiters[events[i].data.fd];
+        coroutine *co = waiters->head;
+
+        // everyone retries, any that still can't write just park again
+        while (co != NULL) {
+            coroutine *next = co->next;
+            make_ready(sched, co);
+            --sched->blocked;
+            co = next;
+        }
+
+        waiters->head = NULL;
+        waiters->armed = false;
+    }
+}
+
+bool init_scheduler(scheduler *sched) {
+    sched->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    sched->ready_head = NULL;
+    sched->ready_tail = NULL;
+    sched->waiters = NULL;
+    sched->waiters_size = 0;
+    sched->blocked = 0;
+    sched->owned = NULL;
+    sched->current = NULL;
+
+    return sched->epoll_fd >= 0;
+}
+
+coroutine *spawn_coroutine(scheduler *sched, chunk *program, int fd) {
+    int flags = fcntl(fd, F_GETFL);
+    if (flags < 0) { return NULL; }
+
+    // the stack is sized from what verifying works out, and a chunk that doesn't verify
+    // wouldn't run anyway
+    if (!program->verified && (program->frozen || !verify_chunk(program, 0))) { return NULL; }
+
+    // compiling a body takes more C stack than running one, so it all happens up here
+    compile_functions(program);
+
+    // how deep a call goes isn't known up front, so chunks that can make any get as much
+    // stack as the VM's own
+    size_t depth = program->max_depth;
+    if (has_functions(program)) { depth = MAX_STACK_SIZE; }
+
+    // mapped rather than allocated, so the untouched part of the stack costs nothing
+    void *c_stack = mmap(NULL, COROUTINE_STACK_SIZE + GUARD_SIZE, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (c_stack == MAP_FAILED) { return NULL; }
+
+    mprotect(c_stack, GUARD_SIZE, PROT_NONE);
+
+    coroutine *co = ALLOCATE(coroutine, 1);
+    co->sched = sched;
+    co->program = program;
+    co->fd = fd;
+    co->done = false;
+    co->result = INTERPRET_OK;
+    co->chunk = NULL;
+    co->pc = NULL;
+    co->stack_size = depth;
+    co->stack = ALLOCATE(value, depth);
+    co->stack_top = co->stack;
+    co->c_stack = c_stack;
+
+    getcontext(&co->context);
+    co->context.uc_stack.ss_sp = (char *)c_stack + GUARD_SIZE;
+    co->context.uc_stack.ss_size = COROUTINE_STACK_SIZE;
+    co->context.uc_link = &sched->context;
+    makecontext(&co->context, coroutine_main, 0);
+
+    // coroutines writing to the same descriptor share its saved flags
+    fd_waiters *waiters = waiters_for(sched, (size_t)fd);
+    if (waiters->users++ == 0) {
+        waiters->flags = flags;
+        fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+    }
+
+    co->next_owned = sched->owned;
+    sched->owned = co;
+    make_ready(sched, co);
+
+    return co;
+}
+
+void run_scheduler(scheduler *sched) {
+    flush_output(&g_vm.out);
+
+    // the thread's own VM state, put back once every coroutine is done
+    chunk *script = g_vm.script;
+    chunk *chunk = g_vm.chunk;
+    uint8_t *pc = g_vm.pc;
+    value *stack = g_vm.stack;
+    value *stack_top = g_vm.stack_top;
+    value *stack_end = g_vm.stack_end;
+    output_sink sink = g_vm.out.sink;
+    void *ctx = g_vm.out.ctx;
+    bool interactive = g_vm.out.interactive;
+    // a collection would only see the running coroutine's stack, so there's none until
+    // they're all done
+    size_t next_gc = g_vm.next_gc;
+
+    scheduler *outer = s_running;
+    s_running = sched;
+    g_vm.out.interactive = false;
+    g_vm.next_gc = SIZE_MAX;
+
+    while (sched->ready_head != NULL || sched->blocked > 0) {
+        // blocked coroutines get a look in between every turn, but the loop only sleeps
+        // when nothing else can run
+        if (sched->blocked > 0) { poll_io(sched, sched->ready_head == NULL ? -1 : 0); }
+
+        coroutine *co = next_ready(sched);
+        if (co != NULL) { resume(sched, co); }
+    }
+
+    s_running = outer;
+    g_vm.chunk = chunk;
+    g_vm.script = script;
+    g_vm.pc = pc;
+    g_vm.stack = stack;
+    g_vm.stack_top = stack_top;
+    g_vm.stack_end = stack_end;
+    g_vm.out.sink = sink;
+    g_vm.out.ctx = ctx;
+    g_vm.out.interactive = interactive;
+    g_vm.next_gc = next_gc;
+}
+
+void free_scheduler(scheduler *sched) {
+    coroutine *co = sched->owned;
+
+    while (co != NULL) {
+        coroutine *next = co->next_owned;
+        if (!co->done) { release_fd(co); }
+        free_stacks(co);
+        FREE(coroutine, co);
+        co = next;
+    }
+
+    FREE_ARRAY(sched->waiters, fd_waiters, sched->waiters_size);
+    close(sched->epoll_fd);
+
+    sched->owned = NULL;
+    sched->waiters = NULL;
+    sched->waiters_size = 0;
+}
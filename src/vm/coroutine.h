@@ -0,0 +1,142 @@
+#pragma once
+
+#include "vm.h"
+#include <ucontext.h>
+
+/** Size of every coroutine's C stack, which is only committed as it's touched */
+#define COROUTINE_STACK_SIZE (64u * 1024u)
+
+/** Forward declaration for `scheduler` */
+typedef struct scheduler scheduler;
+
+/**
+ * A chunk running as a stackful coroutine. It has its own C stack, a value stack sized
+ * to what the chunk needs, and its own output file descriptor. When a write to that
+ * descriptor would block, the coroutine yields and the scheduler runs another one.
+ */
+typedef struct coroutine {
+    /** The scheduler the coroutine runs on */
+    scheduler *sched;
+
+    /** The chunk the coroutine runs */
+    chunk *program;
+
+    /** Where the coroutine's output goes, non-blocking until the coroutine finishes */
+    int fd;
+
+    /** Whether the coroutine has finished */
+    bool done;
+
+    /** The result of running the chunk, once `done` */
+    interpret_result result;
+
+    /** Saved `g_vm.chunk` while the coroutine isn't running */
+    chunk *chunk;
+
+    /** Saved `g_vm.pc` while the coroutine isn't running */
+    uint8_t *pc;
+
+    /** The coroutine's value stack */
+    value *stack;
+
+    /** The number of values `stack` can hold */
+    size_t stack_size;
+
+    /** Saved `g_vm.stack_top` while the coroutine isn't running */
+    value *stack_top;
+
+    /** The coroutine's C stack, including a guard page at the bottom */
+    void *c_stack;
+
+    /** Saved registers while the coroutine isn't running */
+    ucontext_t context;
+
+    /** The next coroutine in the run queue, or waiting on the same descriptor */
+    struct coroutine *next;
+
+    /** The next coroutine the scheduler owns, for `free_scheduler` */
+    struct coroutine *next_owned;
+} coroutine;
+
+/** The coroutines writing to a single file descriptor */
+typedef struct fd_waiters {
+    /** The blocked coroutines */
+    coroutine *head;
+
+    /** Unfinished coroutines writing to the descriptor */
+    size_t users;
+
+    /** The descriptor's status flags from before the first of them made it non-blocking */
+    int flags;
+
+    /** Whether the descriptor has been added to the epoll set */
+    bool registered;
+
+    /** Whether the descriptor's one-shot EPOLLOUT is armed */
+    bool armed;
+} fd_waiters;
+
+/**
+ * Runs coroutines on the calling thread. Ready coroutines take turns from a run queue,
+ * blocked ones wait in an epoll set until their descriptor is writable again.
+ */
+struct scheduler {
+    /** The epoll instance blocked descriptors are registered with */
+    int epoll_fd;
+
+    /** Front of the run queue */
+    coroutine *ready_head;
+
+    /** Back of the run queue */
+    coroutine *ready_tail;
+
+    /** Coroutines blocked on I/O, indexed by file descriptor */
+    fd_waiters *waiters;
+
+    /** The number of entries in `waiters` */
+    size_t waiters_size;
+
+    /** The number of coroutines blocked on I/O */
+    size_t blocked;
+
+    /** Every coroutine spawned on the scheduler */
+    coroutine *owned;
+
+    /** The coroutine that is running, NULL while in the scheduler */
+    coroutine *current;
+
+    /** Where a coroutine goes back to when it yields or finishes */
+    ucontext_t context;
+};
+
+/**
+ * Initializes a scheduler
+ * @param sched The scheduler to initialize
+ * @return Whether the epoll instance could be created
+ */
+bool init_scheduler(scheduler *sched);
+
+/**
+ * Adds a coroutine to the back of the run queue. It starts running on the next
+ * `run_scheduler`.
+ * @param sched The scheduler to run it on
+ * @param program The chunk to run, which has to outlive the coroutine
+ * @param fd Where the coroutine's output goes. It's made non-blocking, and its flags are put
+ * back once every coroutine writing to it has finished or been freed
+ * @return The coroutine, owned by the scheduler, or NULL if `fd` isn't open, the chunk
+ * doesn't verify or the stacks couldn't be allocated
+ */
+coroutine *spawn_coroutine(scheduler *sched, chunk *program, int fd);
+
+/**
+ * Runs coroutines until every one has finished. Anything the calling thread has
+ * buffered in `g_vm.out` is flushed first.
+ * @param sched The scheduler
+ */
+void run_scheduler(scheduler *sched);
+
+/**
+ * Frees a scheduler and all of its coroutines
+ * @param sched The scheduler to free
+ */
+void free_scheduler(scheduler *sched);
@@ -0,0 +1,569 @@
+#include "gc.h"
+#include "../common/memory.h"
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdlib.h>
+
+/** Slots every gray deque starts with, it doubles whenever it fills */
+#define GRAY_CAPACITY 1024
+
+/** Size of a cache line, which every marker's deque gets to itself */
+#define CACHE_LINE 64
+
+/**
+ * The slots of a gray deque, indexed modulo the capacity. A ring that fills is replaced
+ * by one twice the size, but a thief may still be reading it, so it's only freed once
+ * the collection's marking is done.
+ */
+typedef struct gray_ring {
+    /** The capacity minus one, the capacity is a power of two */
+    int64_t mask;
+
+    /** The ring this one replaced, NULL if none */
+    struct gray_ring *retired;
+
+    /** The gray objects */
+    _Atomic(object *) items[];
+} gray_ring;
+
+/**
+ * A Chase-Lev work-stealing deque of objects that have been marked but not traced. Its
+ * owner pushes and takes at the bottom, which only costs a fence unless a thief is after
+ * the last object. Markers that run out of work steal from the top.
+ */
+typedef struct gray_deque {
+    /** Where thieves steal from, only ever increases */
+    _Alignas(CACHE_LINE) atomic_int_least64_t top;
+
+    /** Where the owner pushes and takes, on a line of its own since only the owner writes it */
+    _Alignas(CACHE_LINE) atomic_int_least64_t bottom;
+
+    /** The slots */
+    _Atomic(gray_ring *) ring;
+} gray_deque;
+
+/** A thread that marks, and the deque it marks from */
+typedef struct marker {
+    /** The objects this marker has grayed */
+    gray_deque deque;
+
+    /** The pool the marker belongs to */
+    gc_pool *pool;
+
+    /** The marker's index in the pool, the collecting thread is 0 */
+    int index;
+
+    /** The marker's thread, unused for the collecting thread */
+    pthread_t thread;
+} marker;
+
+struct gc_pool {
+    /** The markers, `threads` of them */
+    marker *markers;
+
+    /** The number of markers, counting the collecting thread */
+    int threads;
+
+    /** Markers that have run out of work, marking is done once they all have */
+    atomic_int idle;
+
+    /** Guards everything below */
+    pthread_mutex_t lock;
+
+    /** Signalled when a collection starts or the pool stops */
+    pthread_cond_t start;
+
+    /** Signalled when the last marking thread is done with a collection */
+    pthread_cond_t finished;
+
+    /** Bumped by every collection, so marking threads can tell a new one has started */
+    uint64_t collections;
+
+    /** Marking threads still working on the current collection */
+    int running;
+
+    /** Whether the marking threads have to exit */
+    bool stopping;
+
+    /** Whether allocating instructions collect on their own, see `enable_gc` */
+    bool automatic;
+};
+
+/**
+ * Allocates a gray ring. The rings are the collector's own bookkeeping, allocated on
+ * the marking threads, so they're kept out of the VM's allocation counters.
+ * @param capacity The number of slots, a power of two
+ * @return The new ring
+ */
+static gray_ring *new_ring(int64_t capacity) {
+    gray_ring *ring = malloc(sizeof(gray_ring) + sizeof(object *) * (size_t)capacity);
+    if (ring == NULL) { abort(); }
+
+    ring->mask = capacity - 1;
+    ring->retired = NULL;
+
+    return ring;
+}
+
+/**
+ * Replaces a deque's full ring with one twice the size. Only the owner calls this.
+ * @param deque The deque
+ * @param ring The deque's ring
+ * @param top The deque's top
+ * @param bottom The deque's bottom
+ * @return The new ring
+ */
+static gray_ring *grow_ring(gray_deque *deque, gray_ring *ring, int64_t top, int64_t bottom) {
+    gray_ring *grown = new_ring((ring->mask + 1) * 2);
+
+    for (int64_t i = top; i < bottom; ++i) {
+        object *obj = atomic_load_explicit(&ring->items[i & ring->mask], memory_order_relaxed);
+        atomic_store_explicit(&grown->items[i & grown->mask], obj, memory_order_relaxed);
+    }
+
+    grown->retired = ring;
+    atomic_store_explicit(&deque->ring, grown, memory_order_release);
+
+    return grown;
+}
+
+/**
+ * Pushes an object onto the bottom of a deque. Only the owner calls this.
+ * @param deque The deque
+ * @param obj The object
+ */
+static void push_gray(gray_deque *deque, object *obj) {
+    int64_t bottom = atomic_load_explicit(&deque->bottom, memory_order_relaxed);
+    int64_t top = atomic_load_explicit(&deque->top, memory_order_acquire);
+    gray_ring *ring = atomic_load_explicit(&deque->ring, memory_order_relaxed);
+
+    if (bottom - top > ring->mask) { ring = grow_ring(deque, ring, top, bottom); }
+
+    atomic_store_explicit(&ring->items[bottom & ring->mask], obj, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    atomic_store_explicit(&deque->bottom, bottom + 1, memory_order_relaxed);
+}
+
+/**
+ * Takes the object at the bottom of a deque. Only the owner calls this.
+ * @param deque The deque
+ * @return The object, or NULL if the deque is empty
+ */
+static object *take_gray(gray_deque *deque) {
+    int64_t bottom = atomic_load_explicit(&deque->bottom, memory_order_relaxed) - 1;
+    gray_ring *ring = atomic_load_explicit(&deque->ring, memory_order_relaxed);
+    atomic_store_explicit(&deque->bottom, bottom, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    int64_t top = atomic_load_explicit(&deque->top, memory_order_relaxed);
+
+    if (top > bottom) {
+        atomic_store_explicit(&deque->bottom, bottom + 1, memory_order_relaxed);
+        return NULL;
+    }
+
+    object *obj = atomic_load_explicit(&ring->items[bottom & ring->mask], memory_order_relaxed);
+
+    // the last object, which a thief may be taking at the same time
+    if (top == bottom) {
+        if (!atomic_compare_exchange_strong_explicit(&deque->top, &top, top + 1,
+                                                     memory_order_seq_cst, memory_order_relaxed)) {
+            obj = NULL;
+        }
+
+        atomic_store_explicit(&deque->bottom, bottom + 1, memory_order_relaxed);
+    }
+
+    return obj;
+}
+
+/**
+ * Steals the object at the top of another marker's deque
+ * @param deque The deque
+ * @return The object, or NULL if the deque is empty or another thread took it first
+ */
+static object *steal_gray(gray_deque *deque) {
+    int64_t top = atomic_load_explicit(&deque->top, memory_order_acquire);
+    atomic_thread_fence(memory_order_seq_cst);
+    int64_t bottom = atomic_load_explicit(&deque->bottom, memory_order_acquire);
+
+    if (top >= bottom) { return NULL; }
+
+    gray_ring *ring = atomic_load_explicit(&deque->ring, memory_order_acquire);
+    object *obj = atomic_load_explicit(&ring->items[top & ring->mask], memory_order_relaxed);
+
+    if (!atomic_compare_exchange_strong_explicit(&deque->top, &top, top + 1,
+                                                 memory_order_seq_cst, memory_order_relaxed)) {
+        return NULL;
+    }
+
+    return obj;
+}
+
+/**
+ * Checks whether a deque looks like it has objects in it, without taking any
+ * @param deque The deque
+ * @return Whether it has
+ */
+static inline bool has_gray(gray_deque *deque) {
+    return atomic_load_explicit(&deque->top, memory_order_relaxed) <
+           atomic_load_explicit(&deque->bottom, memory_order_relaxed);
+}
+
+/**
+ * Marks an object, graying it if it can reach others
+ * @param m The marker that reached the object
+ * @param obj The object
+ */
+static inline void mark_object(marker *m, object *obj) {
+    // frozen objects only reach other frozen ones, and are never swept
+    if (obj->immortal) { return; }
+
+    // the exchange decides which marker grays the object, the load saves it once it's done
+    if (atomic_load_explicit(&obj->marked, memory_order_relaxed) ||
+        atomic_exchange_explicit(&obj->marked, true, memory_order_relaxed)) {
+        return;
+    }
+
+    if (obj->type != OBJ_STRING) { push_gray(&m->deque, obj); }
+}
+
+/**
+ * Marks a value's object, if it has one
+ * @param m The marker that reached the value
+ * @param val The value
+ */
+static inline void mark_value(marker *m, value val) {
+    if (is_object(val)) { mark_object(m, as_object(val)); }
+}
+
+/**
+ * Marks every object a gray object refers to
+ * @param m The marker tracing the object
+ * @param obj The object
+ */
+static void trace(marker *m, object *obj) {
+    switch (obj->type) {
+        case OBJ_STRING: break;
+        case OBJ_FUNCTION: {
+            function *fn = (function *)obj;
+            if (fn->name != NULL) { mark_object(m, &fn->name->header); }
+
+            for (int i = 0; i < fn->chunk.constant_pool.size; ++i) {
+                mark_value(m, fn->chunk.constant_pool.values[i]);
+            }
+
+            break;
+        }
+        case OBJ_INSTANCE: {
+            instance *inst = (instance *)obj;
+
+            for (uint32_t i = 0; i < inst->shape->slot_count; ++i) {
+                mark_value(m, inst->fields[i]);
+            }
+
+            break;
+        }
+    }
+}
+
+/**
+ * Steals an object from any other marker, trying each one once
+ * @param m The marker out of work
+ * @return The object, or NULL if none could be stolen
+ */
+static object *steal_any(marker *m) {
+    gc_pool *pool = m->pool;
+
+    for (int i = 1; i < pool->threads; ++i) {
+        marker *victim = &pool->markers[(m->index + i) % pool->threads];
+        object *obj = steal_gray(&victim->deque);
+
+        if (obj != NULL) { return obj; }
+    }
+
+    return NULL;
+}
+
+/**
+ * Checks whether any marker looks like it has objects to trace
+ * @param pool The pool
+ * @return Whether one has
+ */
+static bool any_gray(gc_pool *pool) {
+    for (int i = 0; i < pool->threads; ++i) {
+        if (has_gray(&pool->markers[i].deque)) { return true; }
+    }
+
+    return false;
+}
+
+/**
+ * Traces objects until every marker has run out of them
+ * @param m The marker
+ */
+static void mark(marker *m) {
+    gc_pool *pool = m->pool;
+
+    while (true) {
+        object *obj;
+        while ((obj = take_gray(&m->deque)) != NULL) {
+            trace(m, obj);
+        }
+
+        obj = steal_any(m);
+        if (obj != NULL) {
+            trace(m, obj);
+            continue;
+        }
+
+        // an idle marker never grays anything, so once they're all idle every deque is empty
+        atomic_fetch_add(&pool->idle, 1);
+
+        while (!any_gray(pool)) {
+            if (atomic_load(&pool->idle) == pool->threads) { return; }
+            sched_yield();
+        }
+
+        atomic_fetch_sub(&pool->idle, 1);
+    }
+}
+
+/**
+ * Where every marking thread waits for collections
+ * @param arg The thread's marker
+ * @return NULL
+ */
+static void *marker_main(void *arg) {
+    marker *m = arg;
+    gc_pool *pool = m->pool;
+    uint64_t seen = 0;
+
+    pthread_mutex_lock(&pool->lock);
+
+    while (true) {
+        while (pool->collections == seen && !pool->stopping) {
+            pthread_cond_wait(&pool->start, &pool->lock);
+        }
+
+        if (pool->stopping) { break; }
+
+        seen = pool->collections;
+        pthread_mutex_unlock(&pool->lock);
+
+        mark(m);
+
+        pthread_mutex_lock(&pool->lock);
+        if (--pool->running == 0) { pthread_cond_signal(&pool->finished); }
+    }
+
+    pthread_mutex_unlock(&pool->lock);
+
+    return NULL;
+}
+
+/**
+ * Stops a pool's marking threads and frees it
+ * @param pool The pool
+ * @param started The number of marking threads that were started
+ */
+static void free_pool(gc_pool *pool, int started) {
+    pthread_mutex_lock(&pool->lock);
+    pool->stopping = true;
+    pthread_cond_broadcast(&pool->start);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (int i = 1; i <= started; ++i) {
+        pthread_join(pool->markers[i].thread, NULL);
+    }
+
+    for (int i = 0; i < pool->threads; ++i) {
+        gray_ring *ring = atomic_load(&pool->markers[i].deque.ring);
+
+        while (ring != NULL) {
+            gray_ring *retired = ring->retired;
+            free(ring);
+            ring = retired;
+        }
+    }
+
+    pthread_cond_destroy(&pool->finished);
+    pthread_cond_destroy(&pool->start);
+    pthread_mutex_destroy(&pool->lock);
+    free(pool->markers);
+    free(pool);
+}
+
+/**
+ * Creates a pool and starts its marking threads
+ * @param threads The number of markers, counting the collecting thread
+ * @return The pool, or NULL if a thread couldn't be started
+ */
+static gc_pool *new_pool(int threads) {
+    gc_pool *pool = malloc(sizeof(gc_pool));
+    if (pool == NULL) { abort(); }
+
+    // every marker's deque gets its own cache lines
+    pool->markers = aligned_alloc(CACHE_LINE, sizeof(marker) * (size_t)threads);
+    if (pool->markers == NULL) { abort(); }
+
+    pool->threads = threads;
+    atomic_init(&pool->idle, 0);
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->start, NULL);
+    pthread_cond_init(&pool->finished, NULL);
+    pool->collections = 0;
+    pool->running = 0;
+    pool->stopping = false;
+    pool->automatic = false;
+
+    for (int i = 0; i < threads; ++i) {
+        marker *m = &pool->markers[i];
+        atomic_init(&m->deque.top, 0);
+        atomic_init(&m->deque.bottom, 0);
+        atomic_init(&m->deque.ring, new_ring(GRAY_CAPACITY));
+        m->pool = pool;
+        m->index = i;
+    }
+
+    // the markers start with every signal blocked, so handlers like the sampler's only
+    // run on the VM's own threads
+    sigset_t all;
+    sigset_t old;
+    sigfillset(&all);
+    pthread_sigmask(SIG_BLOCK, &all, &old);
+
+    for (int i = 1; i < threads; ++i) {
+        if (pthread_create(&pool->markers[i].thread, NULL, marker_main, &pool->markers[i]) != 0) {
+            pthread_sigmask(SIG_SETMASK, &old, NULL);
+            free_pool(pool, i - 1);
+            return NULL;
+        }
+    }
+
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+    return pool;
+}
+
+/**
+ * Marks the VM's roots, graying them onto the collecting thread's deque for the others
+ * to steal
+ * @param m The collecting thread's marker
+ */
+static void mark_roots(marker *m) {
+    // the frames' functions are in their slots
+    for (value *slot = g_vm.stack; slot < g_vm.stack_top; ++slot) {
+        mark_value(m, *slot);
+    }
+
+    chunk *script = g_vm.script;
+    if (script == NULL) { return; }
+
+    for (int i = 0; i < script->constant_pool.size; ++i) {
+        mark_value(m, script->constant_pool.values[i]);
+    }
+
+    for (uint32_t i = 0; i < script->input_count; ++i) {
+        mark_value(m, g_vm.inputs[i]);
+    }
+}
+
+/**
+ * Frees every object on the VM's list that wasn't marked, and clears the marks of the
+ * rest for the next collection
+ */
+static void sweep() {
+    object **link = &g_vm.objects;
+
+    while (*link != NULL) {
+        object *obj = *link;
+
+        if (atomic_load_explicit(&obj->marked, memory_order_relaxed)) {
+            atomic_store_explicit(&obj->marked, false, memory_order_relaxed);
+            link = &obj->next;
+        } else {
+            *link = obj->next;
+            free_object(obj);
+            --g_vm.object_count;
+        }
+    }
+}
+
+/**
+ * Works out how many objects the next collection waits for
+ * @return The object count
+ */
+static inline size_t next_threshold() {
+    size_t threshold = g_vm.object_count * GC_HEAP_GROWTH;
+
+    return threshold < GC_MIN_OBJECTS ? GC_MIN_OBJECTS : threshold;
+}
+
+bool enable_gc(int threads) {
+    if (threads < 1) { threads = 1; }
+    if (threads > MAX_GC_THREADS) { threads = MAX_GC_THREADS; }
+
+    disable_gc();
+
+    gc_pool *pool = new_pool(threads);
+    bool started = pool != NULL;
+    if (!started) { pool = new_pool(1); }
+
+    pool->automatic = true;
+    g_vm.gc = pool;
+    g_vm.next_gc = next_threshold();
+
+    return started;
+}
+
+void disable_gc() {
+    g_vm.next_gc = SIZE_MAX;
+    if (g_vm.gc == NULL) { return; }
+
+    free_pool(g_vm.gc, g_vm.gc->threads - 1);
+    g_vm.gc = NULL;
+}
+
+void collect_garbage() {
+    if (g_vm.gc == NULL) { g_vm.gc = new_pool(1); }
+
+    gc_pool *pool = g_vm.gc;
+    marker *collector = &pool->markers[0];
+    atomic_store(&pool->idle, 0);
+
+    mark_roots(collector);
+
+    if (pool->threads > 1) {
+        pthread_mutex_lock(&pool->lock);
+        ++pool->collections;
+        pool->running = pool->threads - 1;
+        pthread_cond_broadcast(&pool->start);
+        pthread_mutex_unlock(&pool->lock);
+    }
+
+    mark(collector);
+
+    if (pool->threads > 1) {
+        pthread_mutex_lock(&pool->lock);
+        while (pool->running > 0) {
+            pthread_cond_wait(&pool->finished, &pool->lock);
+        }
+        pthread_mutex_unlock(&pool->lock);
+    }
+
+    // no thief can be reading a ring that was replaced any more
+    for (int i = 0; i < pool->threads; ++i) {
+        gray_ring *ring = atomic_load_explicit(&pool->markers[i].deque.ring, memory_order_relaxed);
+
+        while (ring->retired != NULL) {
+            gray_ring *retired = ring->retired;
+            ring->retired = retired->retired;
+            free(retired);
+        }
+    }
+
+    sweep();
+
+    if (pool->automatic) { g_vm.next_gc = next_threshold(); }
+}
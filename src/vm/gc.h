@@ -0,0 +1,46 @@
+#pragma once
+
+#include "vm.h"
+
+/** Fewest objects the VM holds before a collection starts */
+#define GC_MIN_OBJECTS (64u * 1024u)
+
+/** The heap grows to this many times what survived a collection before the next one */
+#define GC_HEAP_GROWTH 2
+
+/** Most threads that can mark at once */
+#define MAX_GC_THREADS 64
+
+/** Forward declaration for the marking threads, see gc.c */
+typedef struct gc_pool gc_pool;
+
+/**
+ * Turns on collection for the calling thread's VM. Once there are enough objects, the
+ * instructions that allocate collect the garbage after themselves. The roots are the
+ * stack and the chunk being run with its inputs, so objects reached only from values an
+ * embedder holds, like `run_batch`'s results or the constants of a chunk that isn't
+ * running or frozen, don't survive. Collections are held off while a scheduler runs.
+ * @param threads Threads that mark, counting the one that collects. The graph is split
+ * between them by work stealing, so one thread marks alone and more pay off on big heaps
+ * @return Whether the marking threads could be started, if not the collecting thread
+ * marks alone
+ */
+bool enable_gc(int threads);
+
+/**
+ * Turns collection off again and stops the marking threads
+ */
+void disable_gc();
+
+/**
+ * Marks everything reachable from the VM's roots, then frees every other object on the
+ * VM's list. The VM's stack is all that's kept outside of a run, see `enable_gc`.
+ */
+void collect_garbage();
+
+/**
+ * Collects if the VM has grown enough objects since the last collection
+ */
+static inline void collect_if_due() {
+    if (g_vm.object_count > g_vm.next_gc) { collect_garbage(); }
+}
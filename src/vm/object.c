@@ -1,8 +1,7 @@
 #include "object.h"
 #include "../common/memory.h"
+#include "../util/probes.h"
 #include "vm.h"
-#include <stdio.h>
-#include <stdlib.h>
 #include <string.h>
 
 /**
@@ -21,9 +20,14 @@
  */
 static inline object *allocate_object(size_t size, obj_type type) {
     object *obj = reallocate(NULL, 0, size);
+    ++g_alloc_stats.objects;
+    CLOX_PROBE2(object__alloc, (int)type, size);
     obj->type = type;
+    obj->immortal = false;
+    atomic_init(&obj->marked, false);
     obj->next = g_vm.objects;
     g_vm.objects = obj;
+    ++g_vm.object_count;
 
     return obj;
 }
@@ -58,10 +62,75 @@ string *from_string(char *chars, int len) {
     return allocate_string(chars, len);
 }
 
+string *concatenate_strings(const string *a, const string *b) {
+    int len = a->len + b->len;
+    char *chars = ALLOCATE(char, len + 1);
+    memcpy(chars, a->chars, a->len);
+    memcpy(chars + a->len, b->chars, b->len);
+    chars[len] = '\0';
+
+    return allocate_string(chars, len);
+}
+
+string *concatenate_values(const value *strings, int count) {
+    int len = 0;
+    for (int i = 0; i < count; ++i) {
+        len += as_string(strings[i])->len;
+    }
+
+    char *chars = ALLOCATE(char, len + 1);
+    char *end = chars;
+
+    for (int i = 0; i < count; ++i) {
+        const string *str = as_string(strings[i]);
+        memcpy(end, str->chars, str->len);
+        end += str->len;
+    }
+
+    *end = '\0';
+
+    return allocate_string(chars, len);
+}
+
+function *new_function(string *name, int arity, const char *source, size_t line) {
+    function *fn = ALLOCATE_OBJECT(function, OBJ_FUNCTION);
+    fn->arity = arity;
+    fn->name = name;
+    fn->source = source;
+    fn->line = line;
+    fn->compiled = false;
+    init_chunk(&fn->chunk);
+
+    return fn;
+}
+
+instance *new_instance(shape *root) {
+    instance *inst = ALLOCATE_OBJECT(instance, OBJ_INSTANCE);
+    inst->shape = root;
+    inst->fields = NULL;
+    inst->capacity = 0;
+
+    return inst;
+}
+
 void print_object(value obj_val) {
     switch (as_object(obj_val)->type) {
-        case OBJ_STRING: printf("%s", as_c_string(obj_val)); break;
-        case OBJ_INSTANCE:
-        case OBJ_FUNCTION: exit(-1);
+        case OBJ_STRING: {
+            string *str = as_string(obj_val);
+            output_write(&g_vm.out, str->chars, str->len);
+            break;
+        }
+        case OBJ_FUNCTION: {
+            function *fn = as_function(obj_val);
+
+            if (fn->name == NULL) {
+                output_write(&g_vm.out, "<fn>", 4);
+            } else {
+                output_printf(&g_vm.out, "<fn %.*s>", fn->name->len, fn->name->chars);
+            }
+
+            break;
+        }
+        case OBJ_INSTANCE: output_write(&g_vm.out, "<instance>", 10); break;
     }
 }
\ No newline at end of file
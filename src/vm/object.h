@@ -1,8 +1,11 @@
 #pragma once
 
 #include "../common/common.h"
+#include "chunk.h"
+#include "shape.h"
 #include "value.h"
 #include <assert.h>
+#include <stdatomic.h>
 
 /**
  * Represents the type of the object
@@ -16,6 +19,12 @@ typedef struct object {
     /** Tag for the other object types */
     obj_type type;
 
+    /** Whether the object belongs to a frozen chunk rather than a VM, see `freeze_chunk` */
+    bool immortal;
+
+    /** Whether a collection has reached the object, set by the marking thread that got there */
+    atomic_bool marked;
+
     /** Pointer to the next object */
     struct object *next;
 } object;
@@ -34,6 +43,52 @@ typedef struct string {
     char *chars;
 } string;
 
+/**
+ * Represents a function. The compiler only skips over a function's body, which is
+ * compiled into `chunk` by `compile_function` the first time the function is called.
+ */
+typedef struct function {
+    /** Holds the type / other bookkeeping information */
+    object header;
+
+    /** The number of parameters the function takes */
+    int arity;
+
+    /** The function's name, NULL if it's anonymous */
+    string *name;
+
+    /** Where the parameter list starts in the source, NULL if the body failed to compile */
+    const char *source;
+
+    /** The line the parameter list starts on */
+    size_t line;
+
+    /** Whether `chunk` holds the compiled body, verified to run above the arguments */
+    bool compiled;
+
+    /** The compiled body, empty until the first call */
+    chunk chunk;
+} function;
+
+/**
+ * Represents an instance. Its fields are a flat array of slots, and which field is in
+ * which slot is described by its shape, shared with every instance that has the same
+ * fields.
+ */
+typedef struct instance {
+    /** Holds the type / other bookkeeping information */
+    object header;
+
+    /** The names and slots of the instance's fields */
+    shape *shape;
+
+    /** The values of the fields, `shape->slot_count` of them */
+    value *fields;
+
+    /** The capacity of `fields` */
+    uint32_t capacity;
+} instance;
+
 /**
  * Returns whether an object is of type `type`
  * @param val The value to check
@@ -75,6 +130,46 @@ static inline char *as_c_string(value val) {
     return as_string(val)->chars;
 }
 
+/**
+ * Returns if an object is a Function
+ * @param val The value to check
+ * @return If the value is both an object and a function
+ */
+static inline bool is_function(value val) {
+    return is_obj_type(val, OBJ_FUNCTION);
+}
+
+/**
+ * Reinterprets a value as a Function object
+ * @param val The value holding the function
+ * @return The function object contained in the value
+ */
+static inline function *as_function(value val) {
+    assert(is_function(val) && "Value being coerced to a function must be a function");
+
+    return (function *)as_object(val);
+}
+
+/**
+ * Returns if an object is an Instance
+ * @param val The value to check
+ * @return If the value is both an object and an instance
+ */
+static inline bool is_instance(value val) {
+    return is_obj_type(val, OBJ_INSTANCE);
+}
+
+/**
+ * Reinterprets a value as an Instance object
+ * @param val The value holding the instance
+ * @return The instance object contained in the value
+ */
+static inline instance *as_instance(value val) {
+    assert(is_instance(val) && "Value being coerced to an instance must be an instance");
+
+    return (instance *)as_object(val);
+}
+
 /**
  * Copies a C string into a String object
  * @param chars Pointer to the first character
@@ -91,6 +186,40 @@ string *copy_string(const char *chars, int length);
  */
 string *from_string(char *chars, int length);
 
+/**
+ * Concatenates two strings into a new String object
+ * @param a The first string
+ * @param b The string to append to it
+ * @return The new string
+ */
+string *concatenate_strings(const string *a, const string *b);
+
+/**
+ * Concatenates any number of strings into a new String object, copying each one once
+ * @param strings The strings, in order
+ * @param count The number of strings
+ * @return The new string
+ */
+string *concatenate_values(const value *strings, int count);
+
+/**
+ * Creates a function whose body hasn't been compiled yet
+ * @param name The function's name, may be NULL
+ * @param arity The number of parameters
+ * @param source The start of the parameter list in the source, which has to outlive the
+ * function until its body is compiled
+ * @param line The line the parameter list starts on
+ * @return The new function object
+ */
+function *new_function(string *name, int arity, const char *source, size_t line);
+
+/**
+ * Creates an instance with no fields
+ * @param root The empty shape of the VM's shape tree
+ * @return The new instance object
+ */
+instance *new_instance(shape *root);
+
 /**
  * Prints an object
  * @param obj_val The value holding the object to print
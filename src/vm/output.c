@@ -0,0 +1,100 @@
+#include "output.h"
+#include "../common/memory.h"
+#include <errno.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+void init_output(output *out) {
+    out->len = 0;
+    out->sink = fd_output_sink;
+    out->ctx = (void *)(intptr_t)STDOUT_FILENO;
+    out->interactive = isatty(STDOUT_FILENO);
+}
+
+void set_output_sink(output *out, output_sink sink, void *ctx, bool interactive) {
+    flush_output(out);
+
+    out->sink = sink;
+    out->ctx = ctx;
+    out->interactive = interactive;
+}
+
+void flush_output(output *out) {
+    if (out->len == 0) { return; }
+
+    struct iovec iov = {out->buf, out->len};
+    out->sink(out->ctx, &iov, 1);
+    out->len = 0;
+}
+
+void output_write(output *out, const char *data, size_t len) {
+    if (len >= OUTPUT_DIRECT_THRESHOLD) {
+        // large writes go out together with whatever is pending, without a copy
+        struct iovec iov[2] = {{out->buf, out->len}, {(void *)data, len}};
+        out->sink(out->ctx, out->len == 0 ? &iov[1] : iov, out->len == 0 ? 1 : 2);
+        out->len = 0;
+        return;
+    }
+
+    if (out->len + len > OUTPUT_BUFFER_SIZE) { flush_output(out); }
+
+    memcpy(out->buf + out->len, data, len);
+    out->len += len;
+}
+
+void output_printf(output *out, const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    size_t space = OUTPUT_BUFFER_SIZE - out->len;
+    int len = vsnprintf(out->buf + out->len, space, format, args);
+    va_end(args);
+
+    if (len < 0) { return; }
+
+    if ((size_t)len < space) {
+        out->len += (size_t)len;
+        return;
+    }
+
+    // didn't fit, format it on the side instead
+    char *formatted = ALLOCATE(char, len + 1);
+
+    va_start(args, format);
+    vsnprintf(formatted, (size_t)len + 1, format, args);
+    va_end(args);
+
+    output_write(out, formatted, (size_t)len);
+    FREE_ARRAY(formatted, char, len + 1);
+}
+
+void fd_output_sink(void *ctx, const struct iovec *iov, int count) {
+    int fd = (int)(intptr_t)ctx;
+    struct iovec pending[2];
+
+    // writev can write less than asked, so work on a copy that can be advanced
+    memcpy(pending, iov, sizeof(struct iovec) * count);
+    struct iovec *cur = pending;
+
+    while (count > 0) {
+        ssize_t written = writev(fd, cur, count);
+
+        if (written < 0) {
+            if (errno == EINTR) { continue; }
+            return;
+        }
+
+        while (count > 0 && (size_t)written >= cur->iov_len) {
+            written -= (ssize_t)cur->iov_len;
+            ++cur;
+            --count;
+        }
+
+        if (count > 0) {
+            cur->iov_base = (char *)cur->iov_base + written;
+            cur->iov_len -= (size_t)written;
+        }
+    }
+}
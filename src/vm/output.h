@@ -0,0 +1,96 @@
+#pragma once
+
+#include "../common/common.h"
+#include <sys/uio.h>
+
+/** Number of bytes buffered before the buffer is flushed to the sink */
+#define OUTPUT_BUFFER_SIZE 8192
+
+/** Writes at least this large skip the buffer and go straight to the sink */
+#define OUTPUT_DIRECT_THRESHOLD (OUTPUT_BUFFER_SIZE / 2)
+
+/**
+ * Receives flushed output. The output only ever hands a sink one or two segments: the
+ * buffer, and possibly a large write that bypassed it.
+ * @param ctx The context pointer the sink was installed with
+ * @param iov The segments to write, in order
+ * @param count The number of segments
+ */
+typedef void (*output_sink)(void *ctx, const struct iovec *iov, int count);
+
+/**
+ * A buffer that all of the VM's output goes through, flushed to a pluggable sink
+ */
+typedef struct output {
+    /** Bytes waiting to be flushed */
+    char buf[OUTPUT_BUFFER_SIZE];
+
+    /** The number of bytes in `buf` */
+    size_t len;
+
+    /** Where flushed bytes go */
+    output_sink sink;
+
+    /** Passed to every call of `sink` */
+    void *ctx;
+
+    /** Whether the output should be flushed after every interpretation */
+    bool interactive;
+} output;
+
+/**
+ * Initializes an output buffer that writes to stdout. It's interactive if stdout is
+ * a terminal.
+ * @param out The output to initialize
+ */
+void init_output(output *out);
+
+/**
+ * Flushes anything pending and then sends all further output to a different sink
+ * @param out The output to change
+ * @param sink The new sink
+ * @param ctx Passed to every call of `sink`
+ * @param interactive Whether to flush after every interpretation
+ */
+void set_output_sink(output *out, output_sink sink, void *ctx, bool interactive);
+
+/**
+ * Appends bytes to the output
+ * @param out The output to write to
+ * @param data The bytes to write
+ * @param len The number of bytes
+ */
+void output_write(output *out, const char *data, size_t len);
+
+/**
+ * Appends a printf-style formatted string to the output
+ * @param out The output to write to
+ * @param format The format string
+ * @param ... Any format arguments
+ */
+void output_printf(output *out, const char *format, ...) __attribute__((format(printf, 2, 3)));
+
+/**
+ * Sends everything that is buffered to the sink
+ * @param out The output to flush
+ */
+void flush_output(output *out);
+
+/**
+ * A sink that writes to a file descriptor with `writev`
+ * @param ctx The file descriptor, cast with `(void *)(intptr_t)fd`
+ * @param iov The segments to write
+ * @param count The number of segments
+ */
+void fd_output_sink(void *ctx, const struct iovec *iov, int count);
+
+/**
+ * Appends a single character to the output
+ * @param out The output to write to
+ * @param c The character
+ */
+static inline void output_char(output *out, char c) {
+    if (out->len == OUTPUT_BUFFER_SIZE) { flush_output(out); }
+
+    out->buf[out->len++] = c;
+}
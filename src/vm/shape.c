@@ -0,0 +1,71 @@
+#include "shape.h"
+#include "../common/memory.h"
+#include <string.h>
+
+/**
+ * Checks whether a shape adds the field `name`
+ * @param s The shape
+ * @param name The name of the field
+ * @param len The length of the name
+ * @return Whether the shape adds the field
+ */
+static inline bool adds_field(const shape *s, const char *name, int len) {
+    return s->len == len && memcmp(s->name, name, len) == 0;
+}
+
+void init_shape(shape *root) {
+    root->parent = NULL;
+    root->name = NULL;
+    root->len = 0;
+    root->slot_count = 0;
+    root->children = NULL;
+    root->child_count = 0;
+    root->child_capacity = 0;
+}
+
+int find_slot(const shape *s, const char *name, int len) {
+    for (; s->parent != NULL; s = s->parent) {
+        if (adds_field(s, name, len)) { return (int)s->slot_count - 1; }
+    }
+
+    return -1;
+}
+
+shape *add_field(shape *s, const char *name, int len) {
+    for (size_t i = 0; i < s->child_count; ++i) {
+        if (adds_field(s->children[i], name, len)) { return s->children[i]; }
+    }
+
+    shape *child = ALLOCATE(shape, 1);
+    init_shape(child);
+    child->parent = s;
+    child->name = ALLOCATE(char, len);
+    memcpy(child->name, name, len);
+    child->len = len;
+    child->slot_count = s->slot_count + 1;
+
+    if (s->child_count == s->child_capacity) {
+        size_t capacity = grow_capacity(s->child_capacity);
+        s->children = GROW_ARRAY(s->children, shape *, s->child_capacity, capacity);
+        s->child_capacity = capacity;
+    }
+
+    s->children[s->child_count++] = child;
+
+    return child;
+}
+
+void free_shapes(shape *root) {
+    for (size_t i = 0; i < root->child_count; ++i) {
+        shape *child = root->children[i];
+
+        free_shapes(child);
+        FREE_ARRAY(child->name, char, child->len);
+        FREE(shape, child);
+    }
+
+    FREE_ARRAY(root->children, shape *, root->child_capacity);
+    root->children = NULL;
+    root->child_count = 0;
+    root->child_capacity = 0;
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include "../common/common.h"
+
+/** Shapes a property access remembers before it stops caching new ones */
+#define CACHE_WAYS 4
+
+/**
+ * A hidden class: the names of an instance's fields and the slots they're in. Instances
+ * that were given the same fields in the same order share a shape, so where a field is
+ * only has to be worked out once per shape. Shapes form a tree rooted at the empty
+ * shape, each one adding a single field to its parent.
+ */
+typedef struct shape {
+    /** The shape this one adds a field to, NULL for the empty shape */
+    struct shape *parent;
+
+    /** The name of the field this shape adds, owned by the shape */
+    char *name;
+
+    /** Length of `name` */
+    int len;
+
+    /** Number of fields, the field this shape adds is in the last slot */
+    uint32_t slot_count;
+
+    /** Shapes that add a field to this one */
+    struct shape **children;
+
+    /** The number of shapes in `children` */
+    size_t child_count;
+
+    /** The capacity of `children` */
+    size_t child_capacity;
+} shape;
+
+/** A shape a property access has seen, and what it did to it */
+typedef struct cache_entry {
+    /** The shape of the instance */
+    const shape *shape;
+
+    /** The shape of the instance after a store, `shape` if the field was already there */
+    shape *next;
+
+    /** The slot the field is in */
+    uint32_t slot;
+} cache_entry;
+
+/**
+ * The inline cache of a single property access. The first entry is checked right in the
+ * dispatch loop, so an access that only ever sees one shape costs one compare.
+ */
+typedef struct property_cache {
+    /** Index of the property's name in the chunk's constant pool */
+    uint32_t name;
+
+    /** The number of entries in use, once it's CACHE_WAYS new shapes aren't cached */
+    uint32_t count;
+
+    /** The shapes seen so far, most recent first */
+    cache_entry entries[CACHE_WAYS];
+} property_cache;
+
+/**
+ * Initializes an empty shape, the root of a shape tree
+ * @param root The shape to initialize
+ */
+void init_shape(shape *root);
+
+/**
+ * Finds the slot of a field
+ * @param s The shape to look in
+ * @param name The name of the field
+ * @param len The length of the name
+ * @return The field's slot, or -1 if the shape doesn't have the field
+ */
+int find_slot(const shape *s, const char *name, int len);
+
+/**
+ * Gets the shape with one more field than `s`, making it the first time it's needed
+ * @param s The shape to add to
+ * @param name The name of the new field
+ * @param len The length of the name
+ * @return The shape with the field added
+ */
+shape *add_field(shape *s, const char *name, int len);
+
+/**
+ * Frees every shape below the root of a shape tree, leaving it empty again
+ * @param root The root of the tree
+ */
+void free_shapes(shape *root);
@@ -0,0 +1,605 @@
+#include "snapshot.h"
+#include "../common/memory.h"
+#include "verifier.h"
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/** The first bytes of every image */
+#define SNAPSHOT_MAGIC "CLOXSNAP"
+
+/** Every allocation in an image starts at a multiple of this */
+#define SNAPSHOT_ALIGN 16u
+
+/**
+ * The sizes of everything an image holds. An image is copied straight into memory, so
+ * it's only loaded by a build that lays its structures out the same way
+ */
+typedef struct snapshot_layout {
+    uint32_t pointer_size;
+    uint32_t value_size;
+    uint32_t chunk_size;
+    uint32_t cache_size;
+    uint32_t string_size;
+    uint32_t function_size;
+    uint32_t prepared_size;
+    uint32_t op_count;
+} snapshot_layout;
+
+/** The start of every image */
+typedef struct snapshot_header {
+    /** SNAPSHOT_MAGIC, without the terminator */
+    char magic[8];
+
+    /** The layout of the build that wrote the image */
+    snapshot_layout layout;
+
+    /** The size of the whole image */
+    uint64_t size;
+
+    /** Offset of the array of prepared sources */
+    uint64_t chunks;
+
+    /** The number of prepared sources */
+    uint64_t count;
+
+    /** Offset of the relocations: the offset of every pointer in the image */
+    uint64_t relocs;
+
+    /** The number of relocations */
+    uint64_t reloc_count;
+} snapshot_header;
+
+/** An image being built in memory by `save_snapshot` */
+typedef struct image_writer {
+    /** The image so far */
+    uint8_t *data;
+
+    /** The number of bytes in `data` */
+    size_t size;
+
+    /** The capacity of `data` */
+    size_t capacity;
+
+    /** The offset of every pointer written so far */
+    uint64_t *relocs;
+
+    /** The number of relocations */
+    size_t reloc_count;
+
+    /** The capacity of `relocs` */
+    size_t reloc_capacity;
+
+    /** Objects already in the image, an open-addressed table keyed by address */
+    const object **written;
+
+    /** Where each object in `written` is in the image */
+    size_t *offsets;
+
+    /** The number of objects in `written` */
+    size_t written_count;
+
+    /** The capacity of `written`, a power of two */
+    size_t written_capacity;
+
+    /** Whether something was reached that can't be saved */
+    bool failed;
+} image_writer;
+
+/**
+ * Fills in the layout of this build
+ * @param layout The layout to fill in
+ */
+static void get_layout(snapshot_layout *layout) {
+    // zeroed first, so layouts can be compared with memcmp
+    memset(layout, 0, sizeof(snapshot_layout));
+
+    layout->pointer_size = sizeof(void *);
+    layout->value_size = sizeof(value);
+    layout->chunk_size = sizeof(chunk);
+    layout->cache_size = sizeof(property_cache);
+    layout->string_size = sizeof(string);
+    layout->function_size = sizeof(function);
+    layout->prepared_size = sizeof(prepared);
+    layout->op_count = OP_COUNT;
+}
+
+/**
+ * Makes room for an allocation at the end of the image
+ * @param w The writer
+ * @param size The size of the allocation
+ * @return The offset of the allocation, which is zeroed
+ */
+static size_t reserve(image_writer *w, size_t size) {
+    size_t at = w->size;
+    size_t end = at + ((size + SNAPSHOT_ALIGN - 1) & ~(size_t)(SNAPSHOT_ALIGN - 1));
+
+    if (end > w->capacity) {
+        size_t capacity = grow_capacity(w->capacity);
+        while (capacity < end) {
+            capacity = grow_capacity(capacity);
+        }
+
+        w->data = GROW_ARRAY(w->data, uint8_t, w->capacity, capacity);
+        w->capacity = capacity;
+    }
+
+    memset(w->data + at, 0, end - at);
+    w->size = end;
+
+    return at;
+}
+
+/**
+ * Copies bytes to the end of the image
+ * @param w The writer
+ * @param src The bytes
+ * @param size The number of bytes
+ * @return The offset of the copy, 0 if there were no bytes
+ */
+static size_t write_bytes(image_writer *w, const void *src, size_t size) {
+    if (size == 0) { return 0; }
+
+    size_t at = reserve(w, size);
+    memcpy(w->data + at, src, size);
+
+    return at;
+}
+
+/**
+ * Writes a pointer into the image, as the offset it points to, and records where it is
+ * so the loader can relocate it
+ * @param w The writer
+ * @param field The offset of the pointer
+ * @param target The offset it points to, 0 for NULL
+ */
+static void write_pointer(image_writer *w, size_t field, size_t target) {
+    uintptr_t ptr = target;
+    memcpy(w->data + field, &ptr, sizeof(uintptr_t));
+
+    if (target == 0) { return; }
+
+    if (w->reloc_count == w->reloc_capacity) {
+        size_t capacity = grow_capacity(w->reloc_capacity);
+        w->relocs = GROW_ARRAY(w->relocs, uint64_t, w->reloc_capacity, capacity);
+        w->reloc_capacity = capacity;
+    }
+
+    w->relocs[w->reloc_count++] = field;
+}
+
+/**
+ * Finds an object's slot in the table of written objects
+ * @param w The writer
+ * @param obj The object
+ * @return The slot, which holds `obj` or is empty
+ */
+static size_t find_written(const image_writer *w, const object *obj) {
+    size_t mask = w->written_capacity - 1;
+    size_t slot = (size_t)(((uintptr_t)obj >> 4) * 0x9E3779B97F4A7C15ull) & mask;
+
+    while (w->written[slot] != NULL && w->written[slot] != obj) {
+        slot = (slot + 1) & mask;
+    }
+
+    return slot;
+}
+
+/**
+ * Records where an object was written, so objects reached twice are only written once
+ * @param w The writer
+ * @param obj The object
+ * @param at Where it is in the image
+ */
+static void record_written(image_writer *w, const object *obj, size_t at) {
+    if ((w->written_count + 1) * 4 > w->written_capacity * 3) {
+        const object **old = w->written;
+        size_t *old_offsets = w->offsets;
+        size_t old_capacity = w->written_capacity;
+
+        w->written_capacity = old_capacity == 0 ? 64 : old_capacity * 2;
+        w->written = ALLOCATE(const object *, w->written_capacity);
+        w->offsets = ALLOCATE(size_t, w->written_capacity);
+        memset(w->written, 0, sizeof(const object *) * w->written_capacity);
+
+        for (size_t i = 0; i < old_capacity; ++i) {
+            if (old[i] == NULL) { continue; }
+
+            size_t slot = find_written(w, old[i]);
+            w->written[slot] = old[i];
+            w->offsets[slot] = old_offsets[i];
+        }
+
+        FREE_ARRAY(old, const object *, old_capacity);
+        FREE_ARRAY(old_offsets, size_t, old_capacity);
+    }
+
+    size_t slot = find_written(w, obj);
+    w->written[slot] = obj;
+    w->offsets[slot] = at;
+    ++w->written_count;
+}
+
+static void write_chunk(image_writer *w, size_t at, const chunk *c);
+
+/**
+ * Writes an object to the image, unless it's already there
+ * @param w The writer
+ * @param obj The object
+ * @return Where the object is in the image
+ */
+static size_t write_object(image_writer *w, const object *obj) {
+    if (w->written_capacity > 0) {
+        size_t slot = find_written(w, obj);
+        if (w->written[slot] == obj) { return w->offsets[slot]; }
+    }
+
+    switch (obj->type) {
+        case OBJ_STRING: {
+            const string *str = (const string *)obj;
+
+            // the characters go right after the object
+            size_t at = reserve(w, sizeof(string) + (size_t)str->len + 1);
+            record_written(w, obj, at);
+
+            string *img = (string *)(w->data + at);
+            img->header.type = OBJ_STRING;
+            img->header.immortal = true;
+            img->len = str->len;
+            memcpy(w->data + at + sizeof(string), str->chars, (size_t)str->len + 1);
+            write_pointer(w, at + offsetof(string, chars), at + sizeof(string));
+
+            return at;
+        }
+        case OBJ_FUNCTION: {
+            const function *fn = (const function *)obj;
+
+            size_t at = reserve(w, sizeof(function));
+            record_written(w, obj, at);
+
+            // every body of a prepared source was compiled when it was frozen
+            if (!fn->compiled) { w->failed = true; }
+
+            function *img = (function *)(w->data + at);
+            img->header.type = OBJ_FUNCTION;
+            img->header.immortal = true;
+            img->arity = fn->arity;
+            img->line = fn->line;
+            img->compiled = fn->compiled;
+
+            if (fn->name != NULL) {
+                write_pointer(w, at + offsetof(function, name), write_object(w, &fn->name->header));
+            }
+
+            write_chunk(w, at + offsetof(function, chunk), &fn->chunk);
+
+            return at;
+        }
+        case OBJ_INSTANCE: break;
+    }
+
+    // instances are only made while running, so they're never a constant
+    w->failed = true;
+
+    return 0;
+}
+
+/**
+ * Writes a chunk's arrays and constants to the image, and the chunk itself into space
+ * already reserved for it
+ * @param w The writer
+ * @param at Where the chunk goes, zeroed
+ * @param c The chunk
+ */
+static void write_chunk(image_writer *w, size_t at, const chunk *c) {
+    size_t code = write_bytes(w, c->code, c->size);
+    size_t lines = write_bytes(w, c->lines, sizeof(size_t) * c->lines_size);
+    size_t values = reserve(w, sizeof(value) * (size_t)c->constant_pool.size);
+    size_t caches = reserve(w, sizeof(property_cache) * c->cache_count);
+
+    // the image's chunks are frozen, so their caches start and stay empty
+    for (size_t i = 0; i < c->cache_count; ++i) {
+        property_cache *cache = (property_cache *)(w->data + caches) + i;
+        cache->name = c->caches[i].name;
+    }
+
+    for (int i = 0; i < c->constant_pool.size; ++i) {
+        value constant = c->constant_pool.values[i];
+        size_t field = values + sizeof(value) * (size_t)i;
+
+        value *img = (value *)(w->data + field);
+        img->type = constant.type;
+        img->as = constant.as;
+
+        if (is_object(constant)) {
+            write_pointer(w, field + offsetof(value, as.obj), write_object(w, as_object(constant)));
+        }
+    }
+
+    chunk *img = (chunk *)(w->data + at);
+    img->size = c->size;
+    img->capacity = c->size;
+    img->constant_pool.size = c->constant_pool.size;
+    img->constant_pool.capacity = c->constant_pool.size;
+    img->lines_size = c->lines_size;
+    img->lines_capacity = c->lines_size;
+    img->frozen = true;
+    img->cache_count = c->cache_count;
+    img->cache_capacity = c->cache_count;
+
+    write_pointer(w, at + offsetof(chunk, code), code);
+    write_pointer(w, at + offsetof(chunk, lines), lines);
+    write_pointer(w, at + offsetof(chunk, constant_pool.values),
+                  c->constant_pool.size > 0 ? values : 0);
+    write_pointer(w, at + offsetof(chunk, caches), c->cache_count > 0 ? caches : 0);
+}
+
+bool save_snapshot(const char *path, prepared *const *chunks, size_t count) {
+    image_writer w = {0};
+
+    size_t header = reserve(&w, sizeof(snapshot_header));
+    size_t prepared_at = reserve(&w, sizeof(prepared) * count);
+
+    for (size_t i = 0; i < count; ++i) {
+        if (!chunks[i]->chunk.frozen) { w.failed = true; }
+
+        write_chunk(&w, prepared_at + sizeof(prepared) * i + offsetof(prepared, chunk),
+                    &chunks[i]->chunk);
+    }
+
+    size_t relocs = write_bytes(&w, w.relocs, sizeof(uint64_t) * w.reloc_count);
+
+    snapshot_header *hdr = (snapshot_header *)(w.data + header);
+    memcpy(hdr->magic, SNAPSHOT_MAGIC, sizeof(hdr->magic));
+    get_layout(&hdr->layout);
+    hdr->size = w.size;
+    hdr->chunks = prepared_at;
+    hdr->count = count;
+    hdr->relocs = relocs;
+    hdr->reloc_count = w.reloc_count;
+
+    bool saved = false;
+
+    if (!w.failed) {
+        FILE *file = fopen(path, "wb");
+
+        if (file != NULL) {
+            saved = fwrite(w.data, 1, w.size, file) == w.size;
+            saved &= fclose(file) == 0;
+        }
+    }
+
+    FREE_ARRAY(w.data, uint8_t, w.capacity);
+    FREE_ARRAY(w.relocs, uint64_t, w.reloc_capacity);
+    FREE_ARRAY(w.written, const object *, w.written_capacity);
+    FREE_ARRAY(w.offsets, size_t, w.written_capacity);
+
+    return saved;
+}
+
+/**
+ * Checks an image's header, and turns every pointer in it from an offset into an address
+ * @param base Where the image is mapped
+ * @param size The size of the image
+ * @return Whether the image is valid, for this build
+ */
+static bool relocate(uint8_t *base, size_t size) {
+    if (size < sizeof(snapshot_header)) { return false; }
+
+    const snapshot_header *hdr = (const snapshot_header *)base;
+    snapshot_layout layout;
+    get_layout(&layout);
+
+    if (memcmp(hdr->magic, SNAPSHOT_MAGIC, sizeof(hdr->magic)) != 0) { return false; }
+    if (memcmp(&hdr->layout, &layout, sizeof(snapshot_layout)) != 0) { return false; }
+    if (hdr->size != size || hdr->relocs > size) { return false; }
+    if (hdr->reloc_count > (size - hdr->relocs) / sizeof(uint64_t)) { return false; }
+    if (hdr->chunks > size || hdr->count > (size - hdr->chunks) / sizeof(prepared)) {
+        return false;
+    }
+
+    const uint64_t *relocs = (const uint64_t *)(base + hdr->relocs);
+
+    for (uint64_t i = 0; i < hdr->reloc_count; ++i) {
+        if (relocs[i] > size - sizeof(uintptr_t)) { return false; }
+
+        uintptr_t ptr;
+        memcpy(&ptr, base + relocs[i], sizeof(uintptr_t));
+        if (ptr >= size) { return false; }
+
+        ptr += (uintptr_t)base;
+        memcpy(base + relocs[i], &ptr, sizeof(uintptr_t));
+    }
+
+    return true;
+}
+
+/** A relocated image whose objects are being checked */
+typedef struct image_check {
+    /** Where the image is mapped */
+    uint8_t *base;
+
+    /** The size of the image */
+    size_t size;
+
+    /** One bit per SNAPSHOT_ALIGN bytes of the image, set for every function checked */
+    uint8_t *seen;
+} image_check;
+
+/**
+ * Checks that an allocation lies entirely inside the image, where `reserve` would have put it
+ * @param ic The image
+ * @param ptr The first element
+ * @param count The number of elements
+ * @param size The size of an element
+ * @return Whether every element is in the image, and the first is aligned
+ */
+static bool in_image(const image_check *ic, const void *ptr, size_t count, size_t size) {
+    uintptr_t at = (uintptr_t)ptr - (uintptr_t)ic->base;
+
+    if ((uintptr_t)ptr < (uintptr_t)ic->base || at > ic->size || at % SNAPSHOT_ALIGN != 0) {
+        return false;
+    }
+
+    return count <= (ic->size - at) / size;
+}
+
+static bool check_chunk(image_check *ic, chunk *c, size_t base);
+
+/**
+ * Checks an object a constant points to, and everything it points to in turn
+ * @param ic The image
+ * @param obj The object
+ * @return Whether the object is one `save_snapshot` could have written
+ */
+static bool check_object(image_check *ic, object *obj) {
+    if (!in_image(ic, obj, 1, sizeof(object))) { return false; }
+
+    obj->immortal = true;
+
+    switch (obj->type) {
+        case OBJ_STRING: {
+            string *str = (string *)obj;
+
+            // the characters are right after the string, and terminated
+            if (!in_image(ic, str, 1, sizeof(string)) || str->len < 0) { return false; }
+            if (str->chars != (char *)(str + 1)) { return false; }
+
+            return in_image(ic, str, sizeof(string) + (size_t)str->len + 1, 1) &&
+                   str->chars[str->len] == '\0';
+        }
+        case OBJ_FUNCTION: {
+            function *fn = (function *)obj;
+            size_t bit = (size_t)((uint8_t *)obj - ic->base) / SNAPSHOT_ALIGN;
+
+            // functions can be shared, and a corrupt image could even make them cycle
+            if (ic->seen[bit / 8] & (1u << bit % 8)) { return true; }
+            ic->seen[bit / 8] |= (uint8_t)(1u << bit % 8);
+
+            if (!in_image(ic, fn, 1, sizeof(function)) || !fn->compiled) { return false; }
+            if (fn->arity < 0 || fn->arity > UINT8_MAX) { return false; }
+
+            if (fn->name != NULL &&
+                (!check_object(ic, (object *)fn->name) || fn->name->header.type != OBJ_STRING)) {
+                return false;
+            }
+
+            return check_chunk(ic, &fn->chunk, (size_t)fn->arity + 1);
+        }
+        default: return false;
+    }
+}
+
+/**
+ * Checks a chunk in the image and everything its constants point to, and verifies it.
+ * Nothing the image says about the chunk beyond its contents is taken on trust
+ * @param ic The image
+ * @param c The chunk
+ * @param base Values on the stack below the chunk, see `verify_chunk`
+ * @return Whether the chunk is valid
+ */
+static bool check_chunk(image_check *ic, chunk *c, size_t base) {
+    c->frozen = true;
+    c->verified = false;
+    c->owned = NULL;
+    c->input_count = 0;
+
+    if (c->constant_pool.size < 0) { return false; }
+
+    size_t constants = (size_t)c->constant_pool.size;
+
+    if (!in_image(ic, c->code, c->size, 1) ||
+        !in_image(ic, c->lines, c->lines_size, sizeof(size_t))) {
+        return false;
+    }
+
+    if (constants > 0 && !in_image(ic, c->constant_pool.values, constants, sizeof(value))) {
+        return false;
+    }
+
+    if (c->cache_count > 0 &&
+        !in_image(ic, c->caches, c->cache_count, sizeof(property_cache))) {
+        return false;
+    }
+
+    // loaded chunks are frozen, so their caches start and stay empty
+    clear_caches(c);
+
+    for (size_t i = 0; i < constants; ++i) {
+        value constant = c->constant_pool.values[i];
+
+        if (constant.type > VAL_OBJ) { return false; }
+        if (is_object(constant) && !check_object(ic, as_object(constant))) { return false; }
+    }
+
+    return verify_chunk(c, base);
+}
+
+/**
+ * Checks every chunk of a relocated image, and every object they reach
+ * @param base Where the image is mapped
+ * @param size The size of the image
+ * @return Whether every chunk is valid and verifies
+ */
+static bool check_image(uint8_t *base, size_t size) {
+    const snapshot_header *hdr = (const snapshot_header *)base;
+    prepared *chunks = (prepared *)(base + hdr->chunks);
+
+    size_t seen_size = size / SNAPSHOT_ALIGN / 8 + 1;
+    image_check ic = {.base = base, .size = size, .seen = ALLOCATE(uint8_t, seen_size)};
+    memset(ic.seen, 0, seen_size);
+
+    bool valid = true;
+
+    for (uint64_t i = 0; valid && i < hdr->count; ++i) {
+        valid = check_chunk(&ic, &chunks[i].chunk, 0);
+    }
+
+    FREE_ARRAY(ic.seen, uint8_t, seen_size);
+
+    return valid;
+}
+
+snapshot *load_snapshot(const char *path) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) { return NULL; }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+        close(fd);
+        return NULL;
+    }
+
+    // private, so relocating writes to copies of the pages rather than the file
+    size_t size = (size_t)st.st_size;
+    void *base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if (base == MAP_FAILED) { return NULL; }
+
+    if (!relocate(base, size) || !check_image(base, size)) {
+        munmap(base, size);
+        return NULL;
+    }
+
+    const snapshot_header *hdr = base;
+
+    snapshot *snap = ALLOCATE(snapshot, 1);
+    snap->base = base;
+    snap->size = size;
+    snap->chunks = (prepared *)((uint8_t *)base + hdr->chunks);
+    snap->count = hdr->count;
+
+    return snap;
+}
+
+void release_snapshot(snapshot *snap) {
+    if (snap == NULL) { return; }
+
+    munmap(snap->base, snap->size);
+    FREE(snapshot, snap);
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include "vm.h"
+
+/**
+ * Prepared sources loaded from an image written by `save_snapshot`. The chunks and every
+ * object they reach live in the image's mapping, so loading one costs a page-in and a
+ * pass over its pointers rather than compiling the sources again.
+ */
+typedef struct snapshot {
+    /** The mapped image */
+    void *base;
+
+    /** The size of the mapping */
+    size_t size;
+
+    /** The prepared sources, in the order they were saved, inside the mapping */
+    prepared *chunks;
+
+    /** The number of prepared sources */
+    size_t count;
+} snapshot;
+
+/**
+ * Writes prepared sources, with every object their constants reach, to an image. Pointers
+ * are written as offsets from the start of the image, so it can be mapped anywhere.
+ * @param path Where to write the image
+ * @param chunks The prepared sources
+ * @param count The number of prepared sources
+ * @return Whether the image could be written
+ */
+bool save_snapshot(const char *path, prepared *const *chunks, size_t count);
+
+/**
+ * Maps an image and fixes its pointers up for where it landed. Every object in it is
+ * checked and every chunk verified before it's trusted, so a corrupt image is rejected
+ * rather than run. Its chunks are frozen, so any thread can run them with `clox_execute`,
+ * but they belong to the snapshot and must not be passed to `clox_release`.
+ * @param path The image, written by `save_snapshot` from the same build of clox
+ * @return The loaded snapshot, or NULL if the image couldn't be read or is from another
+ * build. Release it with `release_snapshot`
+ */
+snapshot *load_snapshot(const char *path);
+
+/**
+ * Unmaps a snapshot, after which none of its chunks or objects can be used
+ * @param snap The snapshot, may be NULL
+ */
+void release_snapshot(snapshot *snap);
@@ -1,7 +1,8 @@
 #include "value.h"
 #include "../common/memory.h"
+#include "../common/number_format.h"
 #include "object.h"
-#include <stdio.h>
+#include "vm.h"
 #include <string.h>
 
 void init_value_array(value_array *val_array) {
@@ -31,7 +32,29 @@ void free_value_array(value_array *val_array) {
     init_value_array(val_array);
 }
 
+/**
+ * Checks if an integer and a double are the same number, exactly
+ * @param i The integer
+ * @param d The double
+ * @return Whether they're equal
+ */
+static inline bool int_equals_double(int64_t i, double d) {
+    // 2^63 is the first double past INT64_MAX, converting anything at or above it is UB
+    if (!(d >= -9223372036854775808.0 && d < 9223372036854775808.0)) { return false; }
+
+    return (int64_t)d == i && (double)i == d;
+}
+
 bool are_equal(value lhs, value rhs) {
+    // the two kinds of number compare by value, so `1 == 1.0`
+    if (is_int(lhs) && rhs.type == VAL_NUMBER) {
+        return int_equals_double(as_int(lhs), rhs.as.number);
+    }
+
+    if (lhs.type == VAL_NUMBER && is_int(rhs)) {
+        return int_equals_double(as_int(rhs), lhs.as.number);
+    }
+
     if (lhs.type != rhs.type) {
         // Lox doesn't implicitly convert types for comparisons
         return false;
@@ -44,7 +67,11 @@ bool are_equal(value lhs, value rhs) {
         case VAL_BOOL: return as_bool(lhs) == as_bool(rhs);
         case VAL_NIL: return true;
         case VAL_NUMBER: return as_number(lhs) == as_number(rhs);
+        case VAL_INT: return as_int(lhs) == as_int(rhs);
         case VAL_OBJ: {
+            // only strings compare by contents, anything else is the same object or not
+            if (!is_string(lhs) || !is_string(rhs)) { return as_object(lhs) == as_object(rhs); }
+
             string *lh_str = as_string(lhs);
             string *rh_str = as_string(rhs);
 
@@ -57,9 +84,26 @@ bool are_equal(value lhs, value rhs) {
 
 void print_value(value val) {
     switch (val.type) {
-        case VAL_NUMBER: printf("%g", as_number(val)); break;
-        case VAL_BOOL: printf(as_bool(val) ? "true" : "false"); break;
-        case VAL_NIL: printf("nil"); break;
+        case VAL_NUMBER: {
+            char buf[NUMBER_FORMAT_MAX];
+            size_t len = format_number(as_number(val), buf);
+            output_write(&g_vm.out, buf, len);
+            break;
+        }
+        case VAL_INT: {
+            char buf[NUMBER_FORMAT_MAX];
+            size_t len = format_int(as_int(val), buf);
+            output_write(&g_vm.out, buf, len);
+            break;
+        }
+        case VAL_BOOL:
+            if (as_bool(val)) {
+                output_write(&g_vm.out, "true", 4);
+            } else {
+                output_write(&g_vm.out, "false", 5);
+            }
+            break;
+        case VAL_NIL: output_write(&g_vm.out, "nil", 3); break;
         case VAL_OBJ: print_object(val); break;
     }
 }
\ No newline at end of file
@@ -3,8 +3,12 @@
 #include "../common/common.h"
 #include <assert.h>
 
-/** The type of a Lox value */
-typedef enum value_type { VAL_BOOL, VAL_NIL, VAL_NUMBER, VAL_OBJ } value_type;
+/**
+ * The type of a Lox value. Numbers come in two kinds, VAL_NUMBER holds a double and
+ * VAL_INT an integer, which arithmetic promotes to a double when it would overflow.
+ * Lox code can't tell them apart.
+ */
+typedef enum value_type { VAL_BOOL, VAL_NIL, VAL_NUMBER, VAL_INT, VAL_OBJ } value_type;
 
 /** Forward declaration for `object` */
 typedef struct object object;
@@ -20,6 +24,7 @@ typedef struct value {
     union {
         bool boolean;
         double number;
+        int64_t integer;
         object *obj;
     } as;
 } value;
@@ -88,6 +93,15 @@ static inline value number_value(double val) {
     return ((value){VAL_NUMBER, {.number = val}});
 }
 
+/**
+ * Returns a value struct with an integer value
+ * @param val The integer value
+ * @return The value struct with an integer
+ */
+static inline value int_value(int64_t val) {
+    return ((value){VAL_INT, {.integer = val}});
+}
+
 /**
  * Returns a value struct with a value of nil
  * @return The value struct with nil
@@ -124,12 +138,21 @@ static inline bool is_nil(value val) {
 }
 
 /**
- * Returns if a value is a number
+ * Returns if a value is a number, of either kind
  * @param val The value to check
- * @return Whether or not the value is of type VAL_NUMBER
+ * @return Whether or not the value is of type VAL_NUMBER or VAL_INT
  */
 static inline bool is_number(value val) {
-    return val.type == VAL_NUMBER;
+    return val.type == VAL_NUMBER || val.type == VAL_INT;
+}
+
+/**
+ * Returns if a value is an integer
+ * @param val The value to check
+ * @return Whether or not the value is of type VAL_INT
+ */
+static inline bool is_int(value val) {
+    return val.type == VAL_INT;
 }
 
 /**
@@ -153,14 +176,25 @@ static inline bool as_bool(value val) {
 }
 
 /**
- * Returns the double value of a value struct
+ * Returns the double value of a value struct, converting integers
  * @param val The value struct
  * @return The double value
  */
 static inline double as_number(value val) {
     assert(is_number(val) && "Value being coerced to a number must be a number");
 
-    return val.as.number;
+    return val.type == VAL_INT ? (double)val.as.integer : val.as.number;
+}
+
+/**
+ * Returns the integer value of a value struct
+ * @param val The value struct
+ * @return The integer value
+ */
+static inline int64_t as_int(value val) {
+    assert(is_int(val) && "Value being coerced to an integer must be an integer");
+
+    return val.as.integer;
 }
 
 /**
@@ -0,0 +1,378 @@
+#include "verifier.h"
+#include "../common/memory.h"
+#include "object.h"
+#include <string.h>
+
+/** Marks an instruction no jump lands on */
+#define NO_JUMP SIZE_MAX
+
+/** What the jumps landing on one instruction have in common */
+typedef struct landing {
+    /** The stack depth they all expect */
+    size_t depth;
+
+    /** Whether each value on the stack is a number on every one of them */
+    bool *numbers;
+} landing;
+
+/** The state of a walk over a chunk */
+typedef struct verifier {
+    /** The chunk being verified */
+    const chunk *chunk;
+
+    /** Values on the stack below the chunk */
+    size_t base;
+
+    /** The stack depth before the instruction being checked */
+    size_t depth;
+
+    /** The deepest the stack has been */
+    size_t max;
+
+    /** Whether the instruction being checked can be reached without a jump */
+    bool reachable;
+
+    /**
+     * Where in `landings` the jumps landing on each instruction are, NO_JUMP where none
+     * do. Indexed by offset / INSTRUCTION_SIZE
+     */
+    size_t *targets;
+
+    /** One entry for every instruction a jump lands on */
+    landing *landings;
+
+    /** The number of entries in `landings` */
+    size_t landing_count;
+
+    /** The capacity of `landings` */
+    size_t landing_capacity;
+
+    /** Whether each value on the stack is sure to be a number, indexed by depth */
+    bool *numbers;
+} verifier;
+
+/**
+ * Checks that a chunk's line table covers every byte of its code
+ * @param c The chunk
+ * @return Whether `get_line` can look up every offset
+ */
+static bool check_lines(const chunk *c) {
+    if (c->lines_size % 2 != 0) { return false; }
+
+    size_t covered = 0;
+
+    for (size_t i = 0; i < c->lines_size; i += 2) {
+        if (c->lines[i] > c->size - covered) { return false; }
+
+        covered += c->lines[i];
+    }
+
+    return covered == c->size;
+}
+
+/**
+ * Checks the operand of a property access
+ * @param c The chunk
+ * @param idx Index of the access's inline cache
+ * @return Whether the cache exists and is named by a string constant
+ */
+static bool check_cache(const chunk *c, size_t idx) {
+    if (idx >= c->cache_count) { return false; }
+
+    size_t name = c->caches[idx].name;
+
+    return name < (size_t)c->constant_pool.size && is_string(c->constant_pool.values[name]);
+}
+
+/**
+ * Records a jump, which the walk checks once it reaches the target
+ * @param v The verifier
+ * @param target The offset the jump lands on
+ * @return Whether the target is in the chunk and expects the stack as deep
+ */
+static bool add_jump(verifier *v, size_t target) {
+    if (target >= v->chunk->size || target % INSTRUCTION_SIZE != 0) { return false; }
+
+    size_t *idx = &v->targets[target / INSTRUCTION_SIZE];
+
+    if (*idx == NO_JUMP) {
+        if (v->landing_count == v->landing_capacity) {
+            size_t capacity = grow_capacity(v->landing_capacity);
+            v->landings = GROW_ARRAY(v->landings, landing, v->landing_capacity, capacity);
+            v->landing_capacity = capacity;
+        }
+
+        *idx = v->landing_count++;
+        v->landings[*idx].depth = v->depth;
+        v->landings[*idx].numbers = ALLOCATE(bool, v->depth + 1);
+        memcpy(v->landings[*idx].numbers, v->numbers, v->depth);
+
+        return true;
+    }
+
+    landing *l = &v->landings[*idx];
+    if (l->depth != v->depth) { return false; }
+
+    for (size_t i = 0; i < v->depth; ++i) {
+        l->numbers[i] &= v->numbers[i];
+    }
+
+    return true;
+}
+
+/**
+ * Checks that the values at the top of the stack are sure to be numbers, which the
+ * unchecked opcodes take for granted
+ * @param v The verifier
+ * @param count The number of values
+ * @return Whether there are that many above the frame, and they're all numbers
+ */
+static bool are_numbers(const verifier *v, size_t count) {
+    if (v->depth < v->base + count) { return false; }
+
+    for (size_t i = v->depth - count; i < v->depth; ++i) {
+        if (!v->numbers[i]) { return false; }
+    }
+
+    return true;
+}
+
+/**
+ * Works out whether an instruction pushes a number, the same way the compiler does:
+ * arithmetic that didn't fail was done on numbers
+ * @param v The verifier, with the instruction's operands still on the stack
+ * @param at The offset of the instruction, which has been checked
+ * @param pops The number of values the instruction pops
+ * @return Whether the value the instruction pushes is sure to be a number
+ */
+static bool pushes_number(const verifier *v, size_t at, size_t pops) {
+    const chunk *c = v->chunk;
+    const uint8_t *operand = &c->code[at + INSTRUCTION_SIZE];
+    const bool *popped = &v->numbers[v->depth - pops];
+
+    switch (c->code[at]) {
+        case OP_LOAD_CONST: return is_number(c->constant_pool.values[read_word(operand)]);
+        case OP_LOAD_CONST_LONG: {
+            size_t idx = read_word(operand) | (size_t)read_word(operand + 2) << 16u;
+            return is_number(c->constant_pool.values[idx]);
+        }
+        case OP_LOAD_INT:
+        case OP_NEGATE:
+        case OP_SUBTRACT:
+        case OP_MULTIPLY:
+        case OP_DIVIDE:
+        case OP_ADD_NUM:
+        case OP_SUBTRACT_NUM:
+        case OP_MULTIPLY_NUM:
+        case OP_DIVIDE_NUM:
+        case OP_NEGATE_NUM: return true;
+        // the condition stays where it was
+        case OP_JUMP_IF_FALSE: return popped[0];
+        case OP_ADD:
+        case OP_CONCAT_N:
+            // a sum with a number in it can't have been a concatenation
+            for (size_t i = 0; i < pops; ++i) {
+                if (popped[i]) { return true; }
+            }
+
+            return false;
+        default: return false;
+    }
+}
+
+/**
+ * Checks an instruction's operands and applies its effect on the stack
+ * @param v The verifier
+ * @param at The offset of the instruction, whose operands are all in the chunk
+ * @return Whether the instruction is valid where it is
+ */
+static bool check_instruction(verifier *v, size_t at) {
+    const chunk *c = v->chunk;
+    uint8_t op = c->code[at];
+    uint8_t byte = c->code[at + 1];
+    const uint8_t *operand = &c->code[at + INSTRUCTION_SIZE];
+    size_t next = at + instruction_size(op);
+
+    size_t pops = 0;
+    size_t pushes = 1;
+
+    switch (op) {
+        case OP_LOAD_CONST:
+            if (read_word(operand) >= c->constant_pool.size) { return false; }
+            break;
+        case OP_LOAD_CONST_LONG: {
+            size_t idx = read_word(operand) | (size_t)read_word(operand + 2) << 16u;
+            if (idx >= (size_t)c->constant_pool.size) { return false; }
+            break;
+        }
+        case OP_LOAD_INT:
+        case OP_NIL:
+        case OP_TRUE:
+        case OP_FALSE:
+        case OP_INSTANCE: break;
+        case OP_LOAD_INPUT:
+            if (byte >= c->input_count) { return false; }
+            break;
+        case OP_GET_LOCAL:
+            if (byte >= v->base) { return false; }
+            break;
+        case OP_NOT:
+        case OP_NEGATE: pops = 1; break;
+        case OP_NEGATE_NUM:
+            if (!are_numbers(v, 1)) { return false; }
+            pops = 1;
+            break;
+        case OP_ADD_NUM:
+        case OP_SUBTRACT_NUM:
+        case OP_MULTIPLY_NUM:
+        case OP_DIVIDE_NUM:
+        case OP_GREATER_NUM:
+        case OP_LESS_NUM:
+            if (!are_numbers(v, 2)) { return false; }
+            pops = 2;
+            break;
+        case OP_CALL: pops = (size_t)byte + 1; break;
+        case OP_CONCAT_N:
+            if (byte < 2) { return false; }
+            pops = byte;
+            break;
+        case OP_GET_PROPERTY:
+            if (!check_cache(c, read_word(operand))) { return false; }
+            pops = 1;
+            break;
+        case OP_SET_PROPERTY:
+        case OP_DEFINE_PROPERTY:
+            if (!check_cache(c, read_word(operand))) { return false; }
+            pops = 2;
+            break;
+        case OP_JUMP:
+            if (!add_jump(v, next + read_word(operand))) { return false; }
+            pushes = 0;
+            v->reachable = false;
+            break;
+        case OP_JUMP_IF_FALSE:
+            // the condition stays on the stack on both paths
+            if (v->depth < v->base + 1 || !add_jump(v, next + read_word(operand))) {
+                return false;
+            }
+            pops = 1;
+            break;
+        case OP_POP:
+            pops = 1;
+            pushes = 0;
+            break;
+        case OP_RETURN:
+            if (v->depth != v->base + 1) { return false; }
+            pops = 1;
+            pushes = 0;
+            v->reachable = false;
+            break;
+        default:
+            if (op >= OP_COUNT) { return false; }
+
+            // every other opcode is a binary operator
+            pops = 2;
+            break;
+    }
+
+    // the frame below the chunk is never popped
+    if (v->depth < v->base + pops) { return false; }
+
+    bool number = pushes > 0 && pushes_number(v, at, pops);
+
+    v->depth = v->depth - pops + pushes;
+    if (pushes > 0) { v->numbers[v->depth - 1] = number; }
+
+    if (v->depth > v->max) { v->max = v->depth; }
+
+    return true;
+}
+
+/**
+ * Walks every instruction of a chunk
+ * @param v The verifier, with `targets` cleared
+ * @return Whether every instruction is valid
+ */
+static bool walk(verifier *v) {
+    const chunk *c = v->chunk;
+
+    for (size_t at = 0; at < c->size;) {
+        size_t idx = v->targets[at / INSTRUCTION_SIZE];
+
+        if (idx != NO_JUMP) {
+            landing *l = &v->landings[idx];
+            if (v->reachable && v->depth != l->depth) { return false; }
+
+            // a value is only sure to be a number if it is on every path here
+            for (size_t i = 0; i < l->depth; ++i) {
+                v->numbers[i] = l->numbers[i] && (v->numbers[i] || !v->reachable);
+            }
+
+            v->depth = l->depth;
+            v->reachable = true;
+        }
+
+        if (!v->reachable) { return false; }
+
+        size_t size = instruction_size(c->code[at]);
+        if (size > c->size - at) { return false; }
+
+        // jumps can't land in an instruction's operands
+        for (size_t word = at + INSTRUCTION_SIZE; word < at + size; word += INSTRUCTION_SIZE) {
+            if (v->targets[word / INSTRUCTION_SIZE] != NO_JUMP) { return false; }
+        }
+
+        if (!check_instruction(v, at)) { return false; }
+
+        at += size;
+    }
+
+    // the code can't run off its end
+    return !v->reachable;
+}
+
+bool verify_chunk(chunk *c, size_t base) {
+    if (c->size == 0 || c->size % INSTRUCTION_SIZE != 0) { return false; }
+    if ((uintptr_t)c->code % INSTRUCTION_SIZE != 0 || !check_lines(c)) { return false; }
+
+    // every instruction pushes at most one value
+    size_t words = c->size / INSTRUCTION_SIZE;
+    size_t max_depth = base + words;
+
+    verifier v = {
+        .chunk = c,
+        .base = base,
+        .depth = base,
+        .max = base,
+        .reachable = true,
+        .targets = ALLOCATE(size_t, words),
+        .landings = NULL,
+        .landing_count = 0,
+        .landing_capacity = 0,
+        .numbers = ALLOCATE(bool, max_depth),
+    };
+
+    for (size_t i = 0; i < words; ++i) {
+        v.targets[i] = NO_JUMP;
+    }
+
+    // the function and its arguments could be anything
+    memset(v.numbers, false, base);
+
+    bool valid = walk(&v);
+
+    for (size_t i = 0; i < v.landing_count; ++i) {
+        FREE_ARRAY(v.landings[i].numbers, bool, v.landings[i].depth + 1);
+    }
+
+    FREE_ARRAY(v.targets, size_t, words);
+    FREE_ARRAY(v.landings, landing, v.landing_capacity);
+    FREE_ARRAY(v.numbers, bool, max_depth);
+
+    if (valid) {
+        c->max_depth = v.max - base;
+        c->verified = true;
+    }
+
+    return valid;
+}
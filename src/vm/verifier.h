@@ -0,0 +1,22 @@
+#pragma once
+
+#include "chunk.h"
+
+/**
+ * Checks that a chunk can be run without the VM checking anything while it runs. Every
+ * opcode has to be known and every operand in bounds: constant, input and cache indices,
+ * local slots, and jumps, which have to land on an instruction. The stack can never go
+ * below the chunk's frame, has to be as deep on every path into an instruction, and holds
+ * exactly one value above the frame at every OP_RETURN. Code nothing reaches and code that
+ * runs off the end are rejected, neither of which the compiler writes. The unchecked
+ * number opcodes are only accepted on values sure to be numbers, worked out the same way
+ * the compiler does, so a chunk that wasn't compiled here can't slip one a string.
+ *
+ * On success the chunk is marked verified and its `max_depth` set. The constants have to
+ * be valid values, which for anything but a loaded snapshot they are.
+ * @param chunk The chunk
+ * @param base Values on the stack below the chunk: the function and its arguments for a
+ * function body, 0 otherwise
+ * @return Whether the chunk is valid
+ */
+bool verify_chunk(chunk *chunk, size_t base);
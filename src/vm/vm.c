@@ -2,8 +2,16 @@
 #include "../common/memory.h"
 #include "../compiler/compiler.h"
 #include "../util/debug.h"
+#include "../util/probes.h"
+#include "../util/profiler.h"
+#include "../util/sampler.h"
+#include "../util/stats.h"
+#include "arithmetic.h"
+#include "gc.h"
 #include "object.h"
+#include "verifier.h"
 #include <stdarg.h>
+#include <stdatomic.h>
 #include <stdio.h>
 #include <string.h>
 
@@ -11,7 +19,14 @@
 #include "../util/disassembler.h"
 #endif
 
-vm g_vm;
+_Thread_local vm g_vm;
+
+/** VMs the process has initialized, which numbers their generations */
+static atomic_uint_fast64_t s_generations;
+
+#ifdef CLOX_USDT
+unsigned short clox_dispatch_semaphore __attribute__((section(".probes"), used));
+#endif
 
 /**
  * "Resets" the stack to the stack, effectively hides all the values
@@ -19,6 +34,8 @@ vm g_vm;
  */
 static inline void reset_stack() {
     g_vm.stack_top = g_vm.stack;
+    g_vm.slots = NULL;
+    g_vm.frame_count = 0;
 }
 
 /**
@@ -67,13 +84,180 @@ static void runtime_error(const char *format, ...) {
     fputs("\n", stderr);
 
     size_t instr = g_vm.pc - g_vm.chunk->code - 1;
-    size_t line = g_vm.chunk->lines[instr];
+    size_t line = get_line(g_vm.chunk, instr);
 
+    CLOX_PROBE2(runtime__error, format, line);
     fprintf(stderr, "[line #%zu] in script\n", line);
 
     reset_stack();
 }
 
+/**
+ * Reads the next operand word of the instruction being run
+ * @return The operand
+ */
+static inline uint16_t read_operand() {
+    uint16_t word = read_word(g_vm.pc);
+    g_vm.pc += 2;
+
+    return word;
+}
+
+/**
+ * Reads the operand of a property access
+ * @return The inline cache of the access
+ */
+static inline property_cache *read_cache() {
+    return &g_vm.chunk->caches[read_operand()];
+}
+
+/**
+ * Puts a shape at the front of an inline cache. Frozen chunks are shared between threads
+ * whose shapes are their own, so their caches are left empty.
+ * @param cache The cache
+ * @param entry What the access did to the shape
+ */
+static void remember_shape(property_cache *cache, const cache_entry *entry) {
+    if (g_vm.chunk->frozen || cache->count == CACHE_WAYS) { return; }
+
+    memmove(&cache->entries[1], &cache->entries[0], sizeof(cache_entry) * cache->count);
+    cache->entries[0] = *entry;
+    ++cache->count;
+}
+
+/**
+ * Replaces the instance on top of the stack with one of its fields, for an access that
+ * missed its inline cache
+ * @param cache The access's inline cache
+ * @return Whether the instance has the field
+ */
+static bool __attribute__((noinline)) get_uncached(property_cache *cache) {
+    if (!is_instance(peek(0))) {
+        runtime_error("Only instances have properties.");
+        return false;
+    }
+
+    instance *inst = as_instance(peek(0));
+    string *name = as_string(g_vm.chunk->constant_pool.values[cache->name]);
+    int slot = find_slot(inst->shape, name->chars, name->len);
+
+    if (slot < 0) {
+        runtime_error("Undefined property '%s'.", name->chars);
+        return false;
+    }
+
+    cache_entry entry = {.shape = inst->shape, .next = inst->shape, .slot = (uint32_t)slot};
+    remember_shape(cache, &entry);
+
+    g_vm.stack_top[-1] = inst->fields[slot];
+
+    return true;
+}
+
+/**
+ * Replaces the instance on top of the stack with one of its fields
+ * @param cache The access's inline cache
+ * @return Whether the instance has the field
+ */
+static inline bool get_property(property_cache *cache) {
+    value receiver = peek(0);
+
+    if (is_instance(receiver)) {
+        instance *inst = as_instance(receiver);
+
+        // the newest entry, which an empty cache holds a NULL shape in
+        if (cache->entries[0].shape == inst->shape) {
+            g_vm.stack_top[-1] = inst->fields[cache->entries[0].slot];
+            return true;
+        }
+
+        for (uint32_t i = 1; i < cache->count; ++i) {
+            if (cache->entries[i].shape == inst->shape) {
+                g_vm.stack_top[-1] = inst->fields[cache->entries[i].slot];
+                return true;
+            }
+        }
+    }
+
+    return get_uncached(cache);
+}
+
+/**
+ * Stores into a field, giving the instance the field first if it needs it
+ * @param inst The instance
+ * @param entry Where the field is, and the shape the instance ends up with
+ * @param val The value to store
+ */
+static inline void store_field(instance *inst, const cache_entry *entry, value val) {
+    if (entry->next != inst->shape) {
+        if (entry->next->slot_count > inst->capacity) {
+            uint32_t capacity = (uint32_t)grow_capacity(inst->capacity);
+            inst->fields = GROW_ARRAY(inst->fields, value, inst->capacity, capacity);
+            inst->capacity = capacity;
+        }
+
+        inst->shape = entry->next;
+    }
+
+    inst->fields[entry->slot] = val;
+}
+
+/**
+ * Pops a value and stores it into a field of the instance below it, for an access that
+ * missed its inline cache
+ * @param cache The access's inline cache
+ * @return Whether there was an instance to store into
+ */
+static bool __attribute__((noinline)) set_uncached(property_cache *cache) {
+    if (!is_instance(peek(1))) {
+        runtime_error("Only instances have fields.");
+        return false;
+    }
+
+    instance *inst = as_instance(peek(1));
+    string *name = as_string(g_vm.chunk->constant_pool.values[cache->name]);
+    int slot = find_slot(inst->shape, name->chars, name->len);
+    cache_entry entry = {.shape = inst->shape, .next = inst->shape, .slot = (uint32_t)slot};
+
+    if (slot < 0) {
+        entry.next = add_field(inst->shape, name->chars, name->len);
+        entry.slot = inst->shape->slot_count;
+    }
+
+    remember_shape(cache, &entry);
+    store_field(inst, &entry, pop());
+
+    return true;
+}
+
+/**
+ * Pops a value and stores it into a field of the instance below it
+ * @param cache The access's inline cache
+ * @return Whether there was an instance to store into
+ */
+static inline bool set_property(property_cache *cache) {
+    value receiver = peek(1);
+
+    if (is_instance(receiver)) {
+        instance *inst = as_instance(receiver);
+
+        // the newest entry, which an empty cache holds a NULL shape in
+        if (cache->entries[0].shape == inst->shape) {
+            store_field(inst, &cache->entries[0], pop());
+            return true;
+        }
+
+        for (uint32_t i = 1; i < cache->count; ++i) {
+            if (cache->entries[i].shape == inst->shape) {
+                store_field(inst, &cache->entries[i], pop());
+                return true;
+            }
+        }
+    }
+
+    return set_uncached(cache);
+}
+
 /**
  * Concatenates two String objects and pushes the result onto the stack
  */
@@ -81,21 +265,138 @@ static void concatenate() {
     string *b = as_string(pop());
     string *a = as_string(pop());
 
-    int new_length = a->len + b->len;
-    char *new_string = ALLOCATE(char, new_length + 1);
-    memcpy(new_string, a->chars, a->len);
-    memcpy(new_string + a->len, b->chars, b->len);
-    new_string[new_length] = '\0';
+    push(object_value((object *)concatenate_strings(a, b)));
+}
+
+/**
+ * Adds a value to another the way OP_ADD does
+ * @param a The left operand, which the sum replaces
+ * @param b The right operand
+ * @return Whether the operands could be added
+ */
+static inline bool add_to(value *a, value b) {
+    if (is_int(*a) && is_int(b)) {
+        *a = add_ints(as_int(*a), as_int(b));
+    } else if (is_string(*a) && is_string(b)) {
+        *a = object_value((object *)concatenate_strings(as_string(*a), as_string(b)));
+    } else if (is_number(*a) && is_number(b)) {
+        *a = number_value(as_number(*a) + as_number(b));
+    } else {
+        runtime_error("Operands for operator#op must be numbers.");
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * Replaces the operands at the top of the stack with their concatenation, which copies
+ * every string once. If any of them isn't a string, they're added up from the left the
+ * way a chain of OP_ADD would add them instead.
+ * @param count The number of operands
+ * @return Whether the operands could be added
+ */
+static bool __attribute__((noinline)) concatenate_n(uint8_t count) {
+    value *operands = g_vm.stack_top - count;
+
+    bool strings = true;
+    for (int i = 0; i < count; ++i) {
+        strings &= is_string(operands[i]);
+    }
+
+    if (strings) {
+        operands[0] = object_value((object *)concatenate_values(operands, count));
+    } else {
+        for (int i = 1; i < count; ++i) {
+            if (!add_to(&operands[0], operands[i])) { return false; }
+        }
+    }
+
+    g_vm.stack_top = operands + 1;
 
-    string *res = from_string(new_string, new_length);
-    push(object_value((object *)res));
+    return true;
 }
 
+/** What `execute` records about every instruction */
+typedef enum run_mode {
+    /** Nothing */
+    RUN_PLAIN,
+
+    /** Counts in `g_op_profile` */
+    RUN_COUNTED,
+
+    /** Counts and cycles in `g_op_profile` */
+    RUN_PROFILED,
+
+    /** Fires the dispatch probe every DISPATCH_PROBE_INTERVAL instructions */
+    RUN_TRACED,
+} run_mode;
+
 /**
- * Runs the chunk and returns the result
+ * Checks a call that can't take the fast path, compiling the function's body if it's
+ * the first call
+ * @param callee The value being called
+ * @param argc The number of arguments
+ * @return INTERPRET_OK if `callee` is a compiled function taking `argc` arguments
+ */
+static interpret_result __attribute__((noinline)) prepare_call(value callee, uint8_t argc) {
+    if (!is_function(callee)) {
+        runtime_error("Can only call functions.");
+        return INTERPRET_RUNTIME_ERROR;
+    }
+
+    function *fn = as_function(callee);
+
+    if (argc != fn->arity) {
+        runtime_error("Expected %d arguments but got %d.", fn->arity, argc);
+        return INTERPRET_RUNTIME_ERROR;
+    }
+
+    if (!fn->compiled) {
+        // the error was reported when the body first failed to compile
+        if (fn->source == NULL || !compile_function(fn)) {
+            runtime_error("Function body failed to compile.");
+            return INTERPRET_COMPILE_ERROR;
+        }
+    }
+
+    return INTERPRET_OK;
+}
+
+/**
+ * Pushes a frame for a call, and starts running the function's body
+ * @param fn The function, with its arguments on top of the stack
+ * @param argc The number of arguments
+ * @return Whether there was room for the frame and the body's stack
+ */
+static inline bool push_frame(function *fn, uint8_t argc) {
+    if (g_vm.frame_count == MAX_FRAMES ||
+        (size_t)(g_vm.stack_end - g_vm.stack_top) < fn->chunk.max_depth) {
+        runtime_error("Stack overflow.");
+        return false;
+    }
+
+    call_frame *frame = &g_vm.frames[g_vm.frame_count++];
+    frame->pc = g_vm.pc;
+    frame->slots = g_vm.stack_top - argc - 1;
+    frame->fn = fn;
+
+    g_vm.slots = frame->slots;
+    g_vm.chunk = &fn->chunk;
+    g_vm.pc = fn->chunk.code;
+
+    return true;
+}
+
+/**
+ * Runs the chunk and returns the result. Always inlined into one function per mode,
+ * so the checks for the mode fold away
+ * @param mode What to record about every instruction
  * @return The result of the interpretation
  */
-static interpret_result run() {
+static inline __attribute__((always_inline)) interpret_result execute(run_mode mode) {
+    unsigned countdown = DISPATCH_PROBE_INTERVAL;
+
 #define BINARY_OP(type, op)                                                                        \
     do {                                                                                           \
         if (!is_number(peek(0)) || !is_number(peek(1))) {                                          \
@@ -107,15 +408,98 @@ static interpret_result run() {
         push(type(a op b));                                                                        \
     } while (false)
 
+// integers take an overflow-checked path, anything else is done on doubles
+#define ARITHMETIC_OP(int_op, op)                                                                  \
+    do {                                                                                           \
+        if (is_int(peek(0)) && is_int(peek(1))) {                                                  \
+            int64_t b = as_int(pop());                                                             \
+            int64_t a = as_int(pop());                                                             \
+            push(int_op(a, b));                                                                    \
+        } else {                                                                                   \
+            BINARY_OP(number_value, op);                                                           \
+        }                                                                                          \
+    } while (false)
+
+// integers compare exactly, even past 2^53, and so do integers against doubles
+#define COMPARISON_OP(op)                                                                          \
+    do {                                                                                           \
+        if (is_int(peek(0)) && is_int(peek(1))) {                                                  \
+            int64_t b = as_int(pop());                                                             \
+            int64_t a = as_int(pop());                                                             \
+            push(bool_value(a op b));                                                              \
+        } else if (is_int(peek(0)) != is_int(peek(1)) && is_number(peek(0)) &&                     \
+                   is_number(peek(1))) {                                                           \
+            value b = pop();                                                                       \
+            value a = pop();                                                                       \
+            push(bool_value(compare_numbers(a, b) op 0));                                          \
+        } else {                                                                                   \
+            BINARY_OP(bool_value, op);                                                             \
+        }                                                                                          \
+    } while (false)
+
+// the operands are known to be numbers, only whether they're both integers is checked
+#define NUMBER_OP(int_op, op)                                                                      \
+    do {                                                                                           \
+        if (is_int(peek(0)) && is_int(peek(1))) {                                                  \
+            int64_t b = as_int(pop());                                                             \
+            int64_t a = as_int(pop());                                                             \
+            push(int_op(a, b));                                                                    \
+        } else {                                                                                   \
+            double b = as_number(pop());                                                           \
+            double a = as_number(pop());                                                           \
+            push(number_value(a op b));                                                            \
+        }                                                                                          \
+    } while (false)
+
+// like COMPARISON_OP, for operands known to be numbers
+#define NUMBER_COMPARISON_OP(op)                                                                   \
+    do {                                                                                           \
+        if (is_int(peek(0)) && is_int(peek(1))) {                                                  \
+            int64_t b = as_int(pop());                                                             \
+            int64_t a = as_int(pop());                                                             \
+            push(bool_value(a op b));                                                              \
+        } else if (is_int(peek(0)) || is_int(peek(1))) {                                           \
+            value b = pop();                                                                       \
+            value a = pop();                                                                       \
+            push(bool_value(compare_numbers(a, b) op 0));                                          \
+        } else {                                                                                   \
+            double b = as_number(pop());                                                           \
+            double a = as_number(pop());                                                           \
+            push(bool_value(a op b));                                                              \
+        }                                                                                          \
+    } while (false)
+
     while (true) {
 #ifdef DEBUG_TRACE
-        verbose_log(&s_vm);
+        verbose_log(&g_vm);
 #endif
-        switch (*g_vm.pc++) {
-            case OP_LOAD_CONST: push(g_vm.chunk->constant_pool.values[*g_vm.pc++]); break;
+        if (mode == RUN_COUNTED) { ++g_op_profile.count[*g_vm.pc]; }
+        if (mode == RUN_PROFILED) { profile_dispatch(*g_vm.pc); }
+
+        if (mode == RUN_TRACED && --countdown == 0) {
+            countdown = DISPATCH_PROBE_INTERVAL;
+            CLOX_PROBE2(dispatch, *g_vm.pc, (size_t)(g_vm.pc - g_vm.chunk->code));
+        }
+
+        // costs no instructions, but keeps pc in memory where the sampler's SIGPROF can see it
+        atomic_signal_fence(memory_order_release);
+
+        uint8_t op = g_vm.pc[0];
+        uint8_t operand = g_vm.pc[1];
+        g_vm.pc += INSTRUCTION_SIZE;
+
+        switch (op) {
+            case OP_LOAD_CONST: push(g_vm.chunk->constant_pool.values[read_operand()]); break;
+            case OP_LOAD_INT: push(int_value((int16_t)read_operand())); break;
             case OP_ADD: {
-                if (is_string(peek(0)) && is_string(peek(1))) {
+                if (is_int(peek(0)) && is_int(peek(1))) {
+                    int64_t b = as_int(pop());
+                    int64_t a = as_int(pop());
+
+                    push(add_ints(a, b));
+                } else if (is_string(peek(0)) && is_string(peek(1))) {
                     concatenate();
+                    collect_if_due();
                 } else if (is_number(peek(0)) && is_number(peek(1))) {
                     double b = as_number(pop());
                     double a = as_number(pop());
@@ -128,19 +512,37 @@ static interpret_result run() {
 
                 break;
             }
-            case OP_SUBTRACT: BINARY_OP(number_value, -); break;
-            case OP_MULTIPLY: BINARY_OP(number_value, *); break;
+            case OP_SUBTRACT: ARITHMETIC_OP(subtract_ints, -); break;
+            case OP_MULTIPLY: ARITHMETIC_OP(multiply_ints, *); break;
             case OP_DIVIDE: BINARY_OP(number_value, /); break;
             case OP_EQUAL: push(bool_value(are_equal(pop(), pop()))); break;
-            case OP_GREATER: BINARY_OP(bool_value, >); break;
-            case OP_LESS: BINARY_OP(bool_value, <); break;
+            case OP_GREATER: COMPARISON_OP(>); break;
+            case OP_LESS: COMPARISON_OP(<); break;
             case OP_NOT: push(bool_value(is_falsey(pop()))); break;
             case OP_NIL: push(nil_value()); break;
             case OP_TRUE: push(bool_value(true)); break;
             case OP_FALSE: push(bool_value(false)); break;
             case OP_RETURN:
+                if (g_vm.frame_count > 0) {
+                    // the result replaces the function and its arguments
+                    call_frame *frame = &g_vm.frames[--g_vm.frame_count];
+                    *frame->slots = g_vm.stack_top[-1];
+                    g_vm.stack_top = frame->slots + 1;
+                    g_vm.pc = frame->pc;
+
+                    if (g_vm.frame_count > 0) {
+                        g_vm.slots = frame[-1].slots;
+                        g_vm.chunk = &frame[-1].fn->chunk;
+                    } else {
+                        g_vm.slots = NULL;
+                        g_vm.chunk = g_vm.script;
+                    }
+
+                    break;
+                }
+
                 print_value(pop());
-                printf("\n");
+                output_char(&g_vm.out, '\n');
                 return INTERPRET_OK;
             case OP_NEGATE:
                 if (!is_number(peek(0))) {
@@ -148,45 +550,346 @@ static interpret_result run() {
                     return INTERPRET_RUNTIME_ERROR;
                 }
 
-                push(number_value(-as_number(pop())));
+                if (is_int(peek(0))) {
+                    push(negate_int(as_int(pop())));
+                } else {
+                    push(number_value(-as_number(pop())));
+                }
+
                 break;
             case OP_LOAD_CONST_LONG: {
-                size_t bytes = from_bytes(*g_vm.pc++, *g_vm.pc++, *g_vm.pc++);
-                push(g_vm.chunk->constant_pool.values[bytes]);
+                size_t idx = read_operand();
+                idx |= (size_t)read_operand() << 16u;
+                push(g_vm.chunk->constant_pool.values[idx]);
+                break;
+            }
+            case OP_LOAD_INPUT: push(g_vm.inputs[operand]); break;
+            case OP_GET_LOCAL: push(g_vm.slots[operand]); break;
+            case OP_INSTANCE:
+                push(object_value((object *)new_instance(&g_vm.root_shape)));
+                collect_if_due();
+                break;
+            case OP_GET_PROPERTY:
+                if (!get_property(read_cache())) { return INTERPRET_RUNTIME_ERROR; }
+                break;
+            case OP_SET_PROPERTY: {
+                if (!set_property(read_cache())) { return INTERPRET_RUNTIME_ERROR; }
+
+                // an assignment's value is the value assigned, not the instance
+                g_vm.stack_top[-1] = g_vm.stack_top[0];
+                break;
+            }
+            case OP_DEFINE_PROPERTY:
+                if (!set_property(read_cache())) { return INTERPRET_RUNTIME_ERROR; }
+                break;
+            case OP_CALL: {
+                uint8_t argc = operand;
+                value callee = peek(argc);
+
+                // the fast path: a compiled function given as many arguments as it takes
+                if (!is_function(callee) || as_function(callee)->arity != argc ||
+                    !as_function(callee)->compiled) {
+                    interpret_result res = prepare_call(callee, argc);
+                    if (res != INTERPRET_OK) { return res; }
+                }
+
+                if (!push_frame(as_function(callee), argc)) { return INTERPRET_RUNTIME_ERROR; }
+                break;
+            }
+            case OP_JUMP: {
+                uint16_t offset = read_operand();
+                g_vm.pc += offset;
+                break;
+            }
+            case OP_JUMP_IF_FALSE: {
+                uint16_t offset = read_operand();
+
+                if (is_falsey(peek(0))) { g_vm.pc += offset; }
                 break;
             }
+            case OP_POP: pop(); break;
+            case OP_CONCAT_N:
+                if (!concatenate_n(operand)) { return INTERPRET_RUNTIME_ERROR; }
+                collect_if_due();
+                break;
+            case OP_ADD_NUM: NUMBER_OP(add_ints, +); break;
+            case OP_SUBTRACT_NUM: NUMBER_OP(subtract_ints, -); break;
+            case OP_MULTIPLY_NUM: NUMBER_OP(multiply_ints, *); break;
+            case OP_DIVIDE_NUM: {
+                double b = as_number(pop());
+                double a = as_number(pop());
+
+                push(number_value(a / b));
+                break;
+            }
+            case OP_GREATER_NUM: NUMBER_COMPARISON_OP(>); break;
+            case OP_LESS_NUM: NUMBER_COMPARISON_OP(<); break;
+            case OP_NEGATE_NUM:
+                if (is_int(peek(0))) {
+                    push(negate_int(as_int(pop())));
+                } else {
+                    push(number_value(-as_number(pop())));
+                }
+
+                break;
         }
     }
 
+#undef NUMBER_COMPARISON_OP
+#undef NUMBER_OP
+#undef COMPARISON_OP
+#undef ARITHMETIC_OP
 #undef BINARY_OP
 }
 
+static interpret_result run() {
+    return execute(RUN_PLAIN);
+}
+
+static interpret_result run_counted() {
+    return execute(RUN_COUNTED);
+}
+
+static interpret_result run_traced() {
+    return execute(RUN_TRACED);
+}
+
+static interpret_result run_profiled() {
+    return execute(RUN_PROFILED);
+}
+
 void init_vm() {
+    g_vm.stack = g_vm.stack_slots;
+    g_vm.stack_end = g_vm.stack_slots + MAX_STACK_SIZE;
     reset_stack();
     g_vm.chunk = NULL;
+    g_vm.script = NULL;
     g_vm.objects = NULL;
+    g_vm.object_count = 0;
+    g_vm.next_gc = SIZE_MAX;
+    g_vm.gc = NULL;
+    init_shape(&g_vm.root_shape);
+    g_vm.generation = atomic_fetch_add(&s_generations, 1) + 1;
+    g_vm.profile = false;
+    g_vm.sample = false;
+    g_vm.stats = false;
+    g_vm.inputs = NULL;
+    init_output(&g_vm.out);
 }
 
 void free_vm() {
+    flush_output(&g_vm.out);
+    disable_gc();
+    free_objects();
+    g_vm.objects = NULL;
+    g_vm.object_count = 0;
+
+    // unfrozen chunks that outlive the VM still remember these shapes, `run_chunk` empties
+    // their caches before they run in a VM whose shapes could have the same addresses
+    free_shapes(&g_vm.root_shape);
 }
 
-interpret_result interpret(const char *source) {
+/**
+ * Compiles and runs a source, measuring every phase into `g_stats` and printing them to
+ * stderr if the VM collects statistics
+ * @param source The source code to interpret
+ * @return The result of the interpretation
+ */
+static interpret_result compile_and_run(const char *source) {
     chunk chunk;
     init_chunk(&chunk);
 
-    if (!compile(source, &chunk)) {
-        free_chunk(&chunk);
+    if (g_vm.stats) { stats_start(); }
+
+    bool compiled = compile(source, &chunk);
+    if (g_vm.stats) { stats_compiled(&chunk); }
+
+    interpret_result res = compiled ? run_chunk(&chunk) : INTERPRET_COMPILE_ERROR;
+    free_chunk(&chunk);
+
+    if (g_vm.stats) {
+        stats_finished(compiled);
+
+        // keeps the report after the program's output on a terminal
+        flush_output(&g_vm.out);
+        print_stats(stderr);
+    } else if (g_vm.out.interactive) {
+        flush_output(&g_vm.out);
+    }
+
+    return res;
+}
+
+interpret_result interpret(const char *source) {
+    CLOX_PROBE1(interpret__start, source);
+
+    interpret_result res = compile_and_run(source);
+
+    CLOX_PROBE1(interpret__done, (int)res);
+
+    return res;
+}
+
+interpret_result run_chunk(chunk *c) {
+    // chunks the compiler didn't write, like hand-built ones, are verified on their first run
+    if (!c->verified && (c->frozen || !verify_chunk(c, 0))) {
+        fputs("Chunk failed verification.\n", stderr);
         return INTERPRET_COMPILE_ERROR;
     }
 
-    g_vm.chunk = &chunk;
-    g_vm.pc = g_vm.chunk->code;
+    // the caches may hold shapes of a VM that's been freed, and this one's can reuse their
+    // memory. Function bodies don't need this, they're freed with their VM or frozen.
+    if (!c->frozen && c->cache_generation != g_vm.generation) {
+        clear_caches(c);
+        c->cache_generation = g_vm.generation;
+    }
+
+    g_vm.chunk = c;
+    g_vm.script = c;
+    g_vm.pc = c->code;
+
+    // the room the chunk needs is checked up front, so nothing it pushes has to be
+    if (c->max_depth > (size_t)(g_vm.stack_end - g_vm.stack_top)) {
+        // reported against the chunk's first instruction
+        g_vm.pc += INSTRUCTION_SIZE;
+        runtime_error("Stack overflow.");
+        g_vm.chunk = NULL;
+        g_vm.script = NULL;
+
+        return INTERPRET_RUNTIME_ERROR;
+    }
+
+    interpret_result res;
+
+    // checked once per chunk, so the plain loop doesn't pay for the dispatch probe
+    if (g_vm.profile) {
+        profile_begin(*g_vm.pc);
+        res = run_profiled();
+        profile_end();
+    } else if (CLOX_DISPATCH_PROBE_ENABLED()) {
+        res = run_traced();
+    } else if (g_vm.stats) {
+        res = run_counted();
+    } else {
+        res = run();
+    }
+
+    // the sampler has to stop seeing the chunk before it's gone
+    g_vm.chunk = NULL;
+    g_vm.script = NULL;
+    atomic_signal_fence(memory_order_seq_cst);
+
+    if (g_vm.sample) { drain_samples(); }
 
-    interpret_result res = run();
-    free_chunk(&chunk);
     return res;
 }
 
+/**
+ * Makes a constant's object immortal, and if it's a function, compiles its body and
+ * does the same for the body's constants
+ * @param constant The constant
+ * @return Whether every function body reached from the constant compiled
+ */
+static bool freeze_constant(value constant) {
+    // a constant another chunk froze stays with that chunk, and other threads may be
+    // reading it, so it's left untouched
+    if (!is_object(constant) || as_object(constant)->immortal) { return true; }
+
+    as_object(constant)->immortal = true;
+    if (!is_function(constant)) { return true; }
+
+    function *fn = as_function(constant);
+    if (fn->name != NULL) { fn->name->header.immortal = true; }
+
+    if (!fn->compiled && (fn->source == NULL || !compile_function(fn))) { return false; }
+
+    bool compiled = true;
+    for (int i = 0; i < fn->chunk.constant_pool.size; ++i) {
+        compiled &= freeze_constant(fn->chunk.constant_pool.values[i]);
+    }
+
+    // the body's objects go with the outermost chunk's, which frees the function
+    fn->chunk.frozen = true;
+
+    return compiled;
+}
+
+void compile_functions(chunk *c) {
+    // freezing compiled every body already
+    if (c->frozen) { return; }
+
+    for (int i = 0; i < c->constant_pool.size; ++i) {
+        if (!is_function(c->constant_pool.values[i])) { continue; }
+
+        function *fn = as_function(c->constant_pool.values[i]);
+        if (!fn->compiled && (fn->source == NULL || !compile_function(fn))) { continue; }
+
+        compile_functions(&fn->chunk);
+    }
+}
+
+bool freeze_chunk(chunk *c) {
+    if (c->frozen) { return true; }
+
+    // a frozen chunk can't be marked verified later
+    if (!c->verified && !verify_chunk(c, 0)) { return false; }
+
+    bool compiled = true;
+    for (int i = 0; i < c->constant_pool.size; ++i) {
+        compiled &= freeze_constant(c->constant_pool.values[i]);
+    }
+
+    // the newly immortal objects move from the VM's list onto the chunk's
+    object **link = &g_vm.objects;
+
+    while (*link != NULL) {
+        object *obj = *link;
+
+        if (obj->immortal) {
+            *link = obj->next;
+            obj->next = c->owned;
+            c->owned = obj;
+            --g_vm.object_count;
+        } else {
+            link = &obj->next;
+        }
+    }
+
+    c->frozen = true;
+
+    return compiled;
+}
+
+prepared *clox_prepare(const char *source) {
+    prepared *prep = ALLOCATE(prepared, 1);
+    init_chunk(&prep->chunk);
+
+    // bodies that don't compile are caught here rather than on some thread's first call
+    if (!compile(source, &prep->chunk) || !freeze_chunk(&prep->chunk)) {
+        clox_release(prep);
+        return NULL;
+    }
+
+    return prep;
+}
+
+interpret_result clox_execute(prepared *prep) {
+    reset_stack();
+
+    interpret_result res = run_chunk(&prep->chunk);
+
+    if (g_vm.out.interactive) { flush_output(&g_vm.out); }
+
+    return res;
+}
+
+void clox_release(prepared *prep) {
+    if (prep == NULL) { return; }
+
+    free_chunk(&prep->chunk);
+    FREE(prepared, prep);
+}
+
 void push(value v) {
     *g_vm.stack_top = v;
     ++g_vm.stack_top;
@@ -2,9 +2,25 @@
 
 #include "chunk.h"
 #include "object.h"
+#include "output.h"
 
 #define MAX_STACK_SIZE 256
 
+/** Most calls that can be in progress at once */
+#define MAX_FRAMES 64
+
+/** A call in progress */
+typedef struct call_frame {
+    /** Where the caller continues once the call returns */
+    uint8_t *pc;
+
+    /** The function's slots on the stack: itself, then its arguments */
+    value *slots;
+
+    /** The function being run */
+    function *fn;
+} call_frame;
+
 /**
  * Represents the virtual machine
  */
@@ -12,20 +28,73 @@ typedef struct vm {
     /** Pointer to the chunk being executed */
     chunk *chunk;
 
+    /** The chunk `run_chunk` started, which returning from the outermost frame goes back to */
+    chunk *script;
+
     /** The program counter */
     uint8_t *pc;
 
-    /** The "stack" for the VM */
-    value stack[MAX_STACK_SIZE];
+    /** The "stack" for the VM, `stack_slots` unless a coroutine is running */
+    value *stack;
+
+    /** The thread's own stack, coroutines bring their own, see coroutine.h */
+    value stack_slots[MAX_STACK_SIZE];
 
     /** Stack pointer */
     value *stack_top;
 
+    /** One past the last slot of `stack` */
+    value *stack_end;
+
+    /** The slots of the innermost frame, NULL at the top level */
+    value *slots;
+
+    /** The calls in progress, innermost last. Calls only push and pop these */
+    call_frame frames[MAX_FRAMES];
+
+    /** The number of frames in use */
+    int frame_count;
+
     /** Pointer to the linked list of objects */
     object *objects;
+
+    /** The number of objects on `objects` */
+    size_t object_count;
+
+    /** The object count past which the next collection starts, SIZE_MAX while there's none */
+    size_t next_gc;
+
+    /** The collector's marking threads, NULL until the first collection, see gc.h */
+    struct gc_pool *gc;
+
+    /** The empty shape, root of the tree of every shape the VM's instances have had */
+    shape root_shape;
+
+    /** Different for every VM the process has had, see `chunk.cache_generation` */
+    uint64_t generation;
+
+    /** Buffer that everything the VM prints goes through */
+    output out;
+
+    /** Whether `run()` keeps a per-opcode profile, see profiler.h */
+    bool profile;
+
+    /** Whether the sampling profiler is running, see sampler.h */
+    bool sample;
+
+    /** Whether every `interpret()` prints its statistics, see stats.h */
+    bool stats;
+
+    /** Values OP_LOAD_INPUT loads, for chunks compiled with `compile_with_inputs` */
+    const value *inputs;
 } vm;
 
-extern vm g_vm;
+/**
+ * The VM of the calling thread. Every thread that runs chunks has its own stack, objects
+ * and output, and has to call `init_vm` and `free_vm` itself. Only frozen chunks can be
+ * shared between threads, and compiling is still done on one thread at a time.
+ */
+extern _Thread_local vm g_vm;
 
 /**
  * Represents a result of an interpretation
@@ -42,7 +111,8 @@ typedef enum interpret_result {
 void init_vm();
 
 /**
- * Leaves the VM in a state ready for deletion
+ * Leaves the VM in a state ready for deletion, flushing any buffered output and
+ * freeing every object
  */
 void free_vm();
 
@@ -53,6 +123,61 @@ void free_vm();
  */
 interpret_result interpret(const char *source);
 
+/**
+ * Runs a chunk that has already been compiled
+ * @param chunk The chunk to run
+ * @return The result of running the chunk
+ */
+interpret_result run_chunk(chunk *chunk);
+
+/**
+ * Compiles the body of every function a chunk can reach, so none is compiled by its first
+ * call. A body that fails to compile is reported now, and its calls fail as they would have.
+ * @param chunk The chunk
+ */
+void compile_functions(chunk *chunk);
+
+/**
+ * Freezes a compiled chunk. Its constants' objects become immortal: they're taken off
+ * the VM's object list, so `free_vm` no longer frees them, and are owned by the chunk
+ * until `free_chunk`. Function bodies are compiled up front, so nothing is written on
+ * the first call. Afterwards the chunk is read-only, and any number of threads can run
+ * it at once. Freezing a frozen chunk does nothing.
+ * @param chunk The chunk to freeze, compiled on this thread
+ * @return Whether the chunk verified and every function body in it compiled. A chunk
+ * that doesn't verify isn't frozen
+ */
+bool freeze_chunk(chunk *chunk);
+
+/**
+ * A source compiled once by `clox_prepare`, which `clox_execute` can run any number
+ * of times without paying for the compile again
+ */
+typedef struct prepared {
+    /** The compiled source */
+    chunk chunk;
+} prepared;
+
+/**
+ * Compiles and freezes a source for `clox_execute`, so it can be run by any thread
+ * @param source The source code to compile
+ * @return The compiled source, or NULL if it didn't compile. Release it with `clox_release`
+ */
+prepared *clox_prepare(const char *source);
+
+/**
+ * Runs a prepared source. Only the stack is reset, the VM's objects are kept
+ * @param prep The prepared source
+ * @return The result of running it
+ */
+interpret_result clox_execute(prepared *prep);
+
+/**
+ * Frees a prepared source
+ * @param prep The prepared source, may be NULL
+ */
+void clox_release(prepared *prep);
+
 /**
  * Pushes a value onto the VM's stack
  * @param val The value to push
@@ -0,0 +1,226 @@
+#include "../src/vm/batch.h"
+#include "../src/vm/object.h"
+#include "../src/vm/vm.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/** Edge values every column kind is filled from */
+#define EDGES 10
+
+/** Rows of every run, every combination of the three inputs' edge values */
+#define ROWS (EDGES * EDGES * EDGES)
+
+/** The inputs every expression can refer to */
+#define INPUTS 3
+
+/** Mismatches printed before the rest are only counted */
+#define MAX_REPORTED 20
+
+/** Rows checked so far */
+static int s_checks;
+
+/** Rows `run_batch` and `run_chunk` disagreed on */
+static int s_failures;
+
+/** Integers around the edges of overflow and of the doubles that hold them exactly */
+static const int64_t s_ints[EDGES] = {
+    0, 1, -1, 3, -7, INT64_MAX, INT64_MIN, INT64_MAX - 1, (INT64_C(1) << 53) + 1, INT64_C(1) << 62,
+};
+
+/** Doubles including -0, infinity and the integers' neighbours */
+static const double s_doubles[EDGES] = {
+    0.0, -0.0, 1.0, -1.5, 3.0, 0.5, 1e300, 9223372036854775808.0, 9007199254740992.0, INFINITY,
+};
+
+/** Arbitrary values, filled in by `main` since strings need the VM */
+static value s_values[EDGES];
+
+/** Expressions covering every opcode the batch evaluator runs */
+static const char *s_expressions[] = {
+    "x + y",  "x - y",     "x * y", "x / y", "x < y",     "x > y",     "x <= y",     "x >= y",
+    "x == y", "!(x == y)", "-x",    "!x",    "x + y + z", "x * y - z", "-x * y + z", "x + 1 + y",
+};
+
+/**
+ * Discards what `run_chunk` prints, the results are read off the stack instead
+ */
+static void discard(void *ctx, const struct iovec *iov, int count) {
+    (void)ctx;
+    (void)iov;
+    (void)count;
+}
+
+/**
+ * Checks whether two values are the same, down to their kind and the sign of a zero
+ * @param a The first value
+ * @param b The second value
+ * @return Whether they are
+ */
+static bool same_value(value a, value b) {
+    if (a.type != b.type) { return false; }
+
+    switch (a.type) {
+        case VAL_NUMBER: {
+            double x = as_number(a);
+            double y = as_number(b);
+
+            return (isnan(x) && isnan(y)) || (x == y && signbit(x) == signbit(y));
+        }
+        case VAL_INT: return as_int(a) == as_int(b);
+        default: return are_equal(a, b);
+    }
+}
+
+/**
+ * Prints a value to stdout, the VM's own output is discarded
+ * @param val The value, which can only be a string if it's an object
+ */
+static void describe(value val) {
+    switch (val.type) {
+        case VAL_NUMBER: printf("%a", as_number(val)); break;
+        case VAL_INT: printf("%lld", (long long)as_int(val)); break;
+        case VAL_BOOL: printf(as_bool(val) ? "true" : "false"); break;
+        case VAL_NIL: printf("nil"); break;
+        case VAL_OBJ: printf("\"%s\"", as_string(val)->chars); break;
+    }
+}
+
+/**
+ * Prints the result of a row to stdout
+ * @param ok Whether the row ran without an error
+ * @param val The row's value, if it did
+ */
+static void describe_result(bool ok, value val) {
+    if (ok) {
+        describe(val);
+    } else {
+        printf("an error");
+    }
+}
+
+/**
+ * Gets a row of a column as the value `run_chunk` loads
+ * @param col The column
+ * @param row The row
+ * @return The row's value
+ */
+static value row_value(const column *col, size_t row) {
+    switch (col->type) {
+        case COLUMN_INT: return int_value(col->as.ints[row]);
+        case COLUMN_DOUBLE: return number_value(col->as.doubles[row]);
+        default: return col->as.values[row];
+    }
+}
+
+/**
+ * Evaluates an expression over the rows both ways and records every row they disagree on
+ * @param source The expression
+ * @param columns One column per input
+ */
+static void check(const char *source, const column *columns) {
+    static const char *names[INPUTS] = {"x", "y", "z"};
+    static value out[ROWS];
+    static bool failed[ROWS];
+
+    batch_program prog;
+    if (compile_batch(&prog, source, names, INPUTS) != BATCH_COMPILED) {
+        printf("%s can't be evaluated in batches\n", source);
+        ++s_failures;
+        free_batch(&prog);
+        return;
+    }
+
+    run_batch(&prog, columns, ROWS, out, failed);
+
+    for (size_t row = 0; row < ROWS; ++row) {
+        value inputs[INPUTS];
+        for (int i = 0; i < INPUTS; ++i) {
+            inputs[i] = row_value(&columns[i], row);
+        }
+
+        g_vm.inputs = inputs;
+        g_vm.stack_top = g_vm.stack;
+        bool ok = run_chunk(&prog.chunk) == INTERPRET_OK;
+        // the result was printed as it was popped, so it's still in the slot it left
+        value expected = ok ? g_vm.stack_top[0] : nil_value();
+
+        ++s_checks;
+
+        if (ok == !failed[row] && (!ok || same_value(expected, out[row]))) { continue; }
+        if (++s_failures > MAX_REPORTED) { continue; }
+
+        printf("%s with x = ", source);
+        describe(inputs[0]);
+        printf(", y = ");
+        describe(inputs[1]);
+        printf(", z = ");
+        describe(inputs[2]);
+        printf("\n    run_batch gives ");
+        describe_result(!failed[row], out[row]);
+        printf(", run_chunk gives ");
+        describe_result(ok, expected);
+        printf("\n");
+    }
+
+    free_batch(&prog);
+}
+
+int main() {
+    init_vm();
+    set_output_sink(&g_vm.out, discard, NULL, false);
+    // every row that fails reports its runtime error
+    if (freopen("/dev/null", "w", stderr) == NULL) { return EXIT_FAILURE; }
+
+    s_values[0] = int_value(2);
+    s_values[1] = number_value(-0.0);
+    s_values[2] = object_value((object *)copy_string("a", 1));
+    s_values[3] = object_value((object *)copy_string("", 0));
+    s_values[4] = nil_value();
+    s_values[5] = bool_value(true);
+    s_values[6] = int_value(INT64_MIN);
+    s_values[7] = number_value(2.5);
+    s_values[8] = object_value((object *)copy_string("bc", 2));
+    s_values[9] = bool_value(false);
+
+    // each input walks through its edge values at its own pace, so every combination is a row
+    static int64_t ints[INPUTS][ROWS];
+    static double doubles[INPUTS][ROWS];
+    static value values[INPUTS][ROWS];
+
+    for (int i = 0; i < INPUTS; ++i) {
+        int pace = i == 0 ? 1 : i == 1 ? EDGES : EDGES * EDGES;
+
+        for (size_t row = 0; row < ROWS; ++row) {
+            size_t edge = row / (size_t)pace % EDGES;
+            ints[i][row] = s_ints[edge];
+            doubles[i][row] = s_doubles[edge];
+            values[i][row] = s_values[edge];
+        }
+    }
+
+    // every mix of column kinds for the three inputs
+    for (int kinds = 0; kinds < 27; ++kinds) {
+        column columns[INPUTS];
+
+        for (int i = 0, k = kinds; i < INPUTS; ++i, k /= 3) {
+            columns[i].type = (column_type)(k % 3);
+
+            switch (columns[i].type) {
+                case COLUMN_INT: columns[i].as.ints = ints[i]; break;
+                case COLUMN_DOUBLE: columns[i].as.doubles = doubles[i]; break;
+                case COLUMN_VALUE: columns[i].as.values = values[i]; break;
+            }
+        }
+
+        for (size_t e = 0; e < sizeof(s_expressions) / sizeof(s_expressions[0]); ++e) {
+            check(s_expressions[e], columns);
+        }
+    }
+
+    printf("%d of %d rows differ between run_batch and run_chunk\n", s_failures, s_checks);
+
+    free_vm();
+
+    return s_failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
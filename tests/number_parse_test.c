@@ -0,0 +1,336 @@
+#include "../src/compiler/number_parse.h"
+#include <float.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/** Fraction digits that print any double, or the midpoint of two, exactly */
+#define FRACTION_DIGITS 1076
+
+/** Width every exact expansion is zero-padded to, so they can be added digit by digit */
+#define FIXED_WIDTH 1400
+
+/** Size of every literal buffer, enough for an exact expansion and a terminator */
+#define LITERAL_SIZE 1600
+
+/** Random doubles checked on top of the hand-picked ones */
+#define RANDOM_DOUBLES 20000
+
+/** Random digit strings checked */
+#define RANDOM_LITERALS 200000
+
+/** Mismatches printed before the rest are only counted */
+#define MAX_REPORTED 20
+
+/** Literals checked so far */
+static int s_checks;
+
+/** Literals that didn't parse to the same bits as `strtod` */
+static int s_failures;
+
+/** State of the xorshift generator, fixed so failures reproduce */
+static uint64_t s_seed = UINT64_C(0x9E3779B97F4A7C15);
+
+/**
+ * Draws the next pseudo-random number
+ * @return 64 random bits
+ */
+static uint64_t next_random() {
+    s_seed ^= s_seed << 13;
+    s_seed ^= s_seed >> 7;
+    s_seed ^= s_seed << 17;
+
+    return s_seed;
+}
+
+static inline double from_bits(uint64_t bits) {
+    double d;
+    memcpy(&d, &bits, sizeof(d));
+
+    return d;
+}
+
+static inline uint64_t to_bits(double d) {
+    uint64_t bits;
+    memcpy(&bits, &d, sizeof(bits));
+
+    return bits;
+}
+
+/**
+ * Parses a literal both ways and records whether the bits agree. The literal is parsed
+ * from a copy followed by more digits, so reading past its length would show.
+ * @param literal The literal, NUL-terminated
+ */
+static void check(const char *literal) {
+    static char padded[LITERAL_SIZE + 4];
+
+    size_t len = strlen(literal);
+    memcpy(padded, literal, len);
+    memcpy(padded + len, "999", 4);
+
+    double expected = strtod(literal, NULL);
+    double actual = parse_number(padded, len);
+
+    ++s_checks;
+
+    if (to_bits(expected) != to_bits(actual) && ++s_failures <= MAX_REPORTED) {
+        fprintf(stderr, "%s\n    parsed as %a, strtod gives %a\n", literal, actual, expected);
+    }
+}
+
+/**
+ * Writes significant digits as a literal the scanner accepts, without an exponent
+ * @param digits The significant digits, without leading zeros
+ * @param count The number of digits
+ * @param point How many of the digits come before the decimal point, may be negative or
+ * more than `count`
+ * @param out Where the literal is written
+ */
+static void write_plain(const char *digits, int count, int point, char *out) {
+    if (count == 0) {
+        strcpy(out, "0");
+    } else if (point <= 0) {
+        out += sprintf(out, "0.");
+        memset(out, '0', (size_t)-point);
+        memcpy(out - point, digits, (size_t)count);
+        out[count - point] = '\0';
+    } else if (point >= count) {
+        memcpy(out, digits, (size_t)count);
+        memset(out + count, '0', (size_t)(point - count));
+        out[point] = '\0';
+    } else {
+        memcpy(out, digits, (size_t)point);
+        out[point] = '.';
+        memcpy(out + point + 1, digits + point, (size_t)(count - point));
+        out[count + 1] = '\0';
+    }
+}
+
+/**
+ * Turns a decimal into a literal, optionally cut to a number of significant digits
+ * @param decimal Digits with an optional decimal point, leading zeros are skipped
+ * @param shift Power of ten the decimal is multiplied by
+ * @param sig Significant digits to keep, 0 keeps them all
+ * @param bump Whether to add one to the last kept digit, which lands just past a value
+ * the cut one was just short of
+ * @param out Where the literal is written
+ */
+static void write_literal(const char *decimal, int shift, int sig, bool bump, char *out) {
+    char digits[LITERAL_SIZE];
+    int count = 0;
+    int point = shift;
+    bool fraction = false;
+
+    for (const char *c = decimal; *c != '\0'; ++c) {
+        if (*c == '.') {
+            fraction = true;
+            continue;
+        }
+
+        if (count == 0 && *c == '0') {
+            if (fraction) { --point; }
+            continue;
+        }
+
+        digits[count++] = *c;
+        if (!fraction) { ++point; }
+    }
+
+    if (sig != 0 && count > sig) { count = sig; }
+
+    if (bump && count != 0) {
+        int i = count - 1;
+        while (i >= 0 && digits[i] == '9') { digits[i--] = '0'; }
+
+        if (i >= 0) {
+            ++digits[i];
+        } else {
+            memmove(digits + 1, digits, (size_t)count);
+            digits[0] = '1';
+            ++point;
+        }
+    }
+
+    while (count != 0 && digits[count - 1] == '0') { --count; }
+
+    write_plain(digits, count, point, out);
+}
+
+/**
+ * Writes the exact value of a double, zero-padded to `FIXED_WIDTH`
+ * @param d The double, finite and not negative
+ * @param out Where it's written
+ */
+static void write_fixed(double d, char *out) {
+    snprintf(out, LITERAL_SIZE, "%0*.*f", FIXED_WIDTH, FRACTION_DIGITS, d);
+}
+
+/**
+ * Adds one exact expansion to another
+ * @param sum The first addend, which receives the sum
+ * @param addend The second addend
+ */
+static void add_fixed(char *sum, const char *addend) {
+    int carry = 0;
+
+    for (int i = FIXED_WIDTH - 1; i >= 0; --i) {
+        if (sum[i] == '.') { continue; }
+
+        int digit = (sum[i] - '0') + (addend[i] - '0') + carry;
+        sum[i] = (char)('0' + digit % 10);
+        carry = digit / 10;
+    }
+}
+
+/**
+ * Halves an exact expansion, which never needs more than its fraction digits for the
+ * expansions added here
+ * @param fixed The expansion
+ */
+static void halve_fixed(char *fixed) {
+    int remainder = 0;
+
+    for (int i = 0; i < FIXED_WIDTH; ++i) {
+        if (fixed[i] == '.') { continue; }
+
+        int digit = remainder * 10 + (fixed[i] - '0');
+        fixed[i] = (char)('0' + digit / 2);
+        remainder = digit % 2;
+    }
+}
+
+/**
+ * Checks a double's rounded, exact and cut representations, and the same for the point
+ * halfway between it and the next double up, where ties to even decide the result
+ * @param d The double, finite and not negative
+ */
+static void check_double(double d) {
+    static char exact[LITERAL_SIZE], half_ulp[LITERAL_SIZE], literal[LITERAL_SIZE];
+
+    // correctly rounded to 15 through 19 significant digits, the lengths that take the
+    // fast paths, and the 17 always round-trip
+    for (int sig = 15; sig <= 19; ++sig) {
+        snprintf(exact, sizeof(exact), "%.*e", sig - 1, d);
+
+        char *e = strchr(exact, 'e');
+        int shift = atoi(e + 1);
+        *e = '\0';
+
+        write_literal(exact, shift, 0, false, literal);
+        check(literal);
+    }
+
+    write_fixed(d, exact);
+    write_literal(exact, 0, 0, false, literal);
+    check(literal);
+
+    // the gap to the next double up, or to the one below for the largest
+    uint64_t bits = to_bits(d);
+    double next = from_bits(bits + 1);
+    double ulp = next <= DBL_MAX ? next - d : d - from_bits(bits - 1);
+
+    write_fixed(ulp, half_ulp);
+    halve_fixed(half_ulp);
+    add_fixed(exact, half_ulp);
+
+    write_literal(exact, 0, 0, false, literal);
+    check(literal);
+
+    for (int sig = 17; sig <= 20; ++sig) {
+        write_literal(exact, 0, sig, false, literal);
+        check(literal);
+        write_literal(exact, 0, sig, true, literal);
+        check(literal);
+    }
+}
+
+/**
+ * Checks a random string of digits with a random decimal point
+ * @param max_digits The most digits the string can have
+ */
+static void check_random_literal(int max_digits) {
+    char digits[LITERAL_SIZE], literal[LITERAL_SIZE];
+
+    int count = 1 + (int)(next_random() % (uint64_t)max_digits);
+    for (int i = 0; i < count; ++i) { digits[i] = (char)('0' + next_random() % 10); }
+
+    // between a fraction with a run of zeros and an integer with trailing ones
+    int point = (int)(next_random() % (uint64_t)(count + 40)) - 20;
+    if (point < 1 && next_random() % 2 == 0) { point = 1; }
+
+    write_plain(digits, count, point, literal);
+    check(literal);
+}
+
+int main() {
+    static const char *hand_picked[] = {
+        "0",
+        "0.0",
+        "00000.00000",
+        "1",
+        "0.1",
+        "0.2",
+        "0.3",
+        "1.5",
+        "9007199254740991",
+        "9007199254740992",
+        "9007199254740993",
+        "9007199254740994",
+        "9007199254740995",
+        "18446744073709551615",
+        "18446744073709551616",
+        "10000000000000000000000",
+        "9999999999999999999",
+        "99999999999999999999",
+        "0.0000000000000000000000000000000000000000000000000000000000000000000000000000001",
+        "123456789012345678901234567890.123456789012345678901234567890",
+        "3.141592653589793238462643383279502884197169399375105820974944592307816406286",
+        "2.718281828459045235360287471352662497757247093699959574966967627724076630353",
+        "0.30000000000000000555111512312578270211815834045410156250000000000000001",
+        "0.30000000000000001665334536937734810635447502136230468749999999999999999",
+        "0.30000000000000001665334536937734810635447502136230468750000000000000000",
+        "0.30000000000000001665334536937734810635447502136230468750000000000000001",
+    };
+
+    for (size_t i = 0; i < sizeof(hand_picked) / sizeof(hand_picked[0]); ++i) {
+        check(hand_picked[i]);
+    }
+
+    // every power of two, from the smallest subnormal up, and the doubles around them
+    for (uint64_t exponent = 0; exponent < 2047; ++exponent) {
+        uint64_t bits = exponent == 0 ? 1 : exponent << 52;
+
+        check_double(from_bits(bits));
+        check_double(from_bits(bits + 1));
+        if (bits > 1) { check_double(from_bits(bits - 1)); }
+    }
+
+    check_double(DBL_MAX);
+    check_double(DBL_MIN);
+    check_double(DBL_TRUE_MIN);
+
+    // the powers of ten, which the fast paths scale by
+    for (int exponent = -324; exponent <= 308; ++exponent) {
+        char power[16];
+        snprintf(power, sizeof(power), "1e%d", exponent);
+
+        check_double(strtod(power, NULL));
+    }
+
+    // every binade, with as many subnormals as normals
+    for (int i = 0; i < RANDOM_DOUBLES; ++i) {
+        uint64_t bits = next_random() & UINT64_C(0x7FFFFFFFFFFFFFFF);
+        if (i % 4 == 0) { bits &= UINT64_C(0x000FFFFFFFFFFFFF); }
+
+        double d = from_bits(bits);
+        if (d <= DBL_MAX) { check_double(d); }
+    }
+
+    // short literals take the fast paths, long ones have more digits than a uint64_t
+    for (int i = 0; i < RANDOM_LITERALS; ++i) { check_random_literal(i % 2 == 0 ? 19 : 800); }
+
+    printf("%d of %d literals differ from strtod\n", s_failures, s_checks);
+
+    return s_failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}